@@ -0,0 +1,16 @@
+#ifndef CERTSTOREBEARSSL_h
+#define CERTSTOREBEARSSL_h
+
+#include "FS.h"
+
+namespace BearSSL
+{
+  // Certificates are never checked on the host, so none are loaded
+  class CertStore
+  {
+  public:
+    int initCertStore(fs::FS &fs, const char *indexFile, const char *dataFile) { return 0; }
+  };
+}
+
+#endif
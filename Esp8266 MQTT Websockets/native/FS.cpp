@@ -0,0 +1,213 @@
+#include "LittleFS.h"
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+fs::FS LittleFS;
+
+static String fsRoot;
+
+const char *nativeFsRoot()
+{
+  return fsRoot.c_str();
+}
+
+namespace fs
+{
+  File::File(FILE *file, bool directory) : _directory(directory)
+  {
+    if (file != nullptr)
+    {
+      _file.reset(file, fclose);
+    }
+  }
+
+  void File::_switchTo(bool writing)
+  {
+    if (_writing != writing)
+    {
+      fseek(_file.get(), 0, SEEK_CUR);
+      _writing = writing;
+    }
+  }
+
+  size_t File::write(const uint8_t *buffer, size_t size)
+  {
+    if (!_file)
+    {
+      return 0;
+    }
+    _switchTo(true);
+    return fwrite(buffer, 1, size, _file.get());
+  }
+
+  int File::available()
+  {
+    if (!_file)
+    {
+      return 0;
+    }
+    return size() - position();
+  }
+
+  int File::read()
+  {
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+  }
+
+  size_t File::read(uint8_t *buffer, size_t size)
+  {
+    if (!_file)
+    {
+      return 0;
+    }
+    _switchTo(false);
+    return fread(buffer, 1, size, _file.get());
+  }
+
+  int File::peek()
+  {
+    if (!_file)
+    {
+      return -1;
+    }
+    _switchTo(false);
+    int c = fgetc(_file.get());
+    if (c != EOF)
+    {
+      ungetc(c, _file.get());
+    }
+    return c == EOF ? -1 : c;
+  }
+
+  void File::flush()
+  {
+    if (_file)
+    {
+      fflush(_file.get());
+    }
+  }
+
+  bool File::seek(uint32_t position, SeekMode mode)
+  {
+    if (!_file)
+    {
+      return false;
+    }
+    static const int whence[] = {SEEK_SET, SEEK_CUR, SEEK_END};
+    return fseek(_file.get(), position, whence[mode]) == 0;
+  }
+
+  size_t File::position() const
+  {
+    return _file ? ftell(_file.get()) : 0;
+  }
+
+  size_t File::size() const
+  {
+    if (!_file)
+    {
+      return 0;
+    }
+    fflush(_file.get());
+    struct stat status;
+    return fstat(fileno(_file.get()), &status) == 0 ? status.st_size : 0;
+  }
+
+  void File::close()
+  {
+    _file.reset();
+    _directory = false;
+  }
+
+  bool FS::begin()
+  {
+    if (fsRoot.length() > 0)
+    {
+      return true;
+    }
+
+    const char *directory = getenv("NATIVE_FS_DIR");
+    if (directory != nullptr && directory[0] != '\0')
+    {
+      if (::mkdir(directory, 0755) != 0 && errno != EEXIST)
+      {
+        return false;
+      }
+      fsRoot = directory;
+      return true;
+    }
+
+    char temporary[] = "/tmp/littlefs-XXXXXX";
+    if (mkdtemp(temporary) == nullptr)
+    {
+      return false;
+    }
+    fsRoot = temporary;
+    return true;
+  }
+
+  String FS::_path(const char *path) const
+  {
+    while (*path == '/')
+    {
+      path++;
+    }
+    return fsRoot + "/" + path;
+  }
+
+  bool FS::format()
+  {
+    DIR *directory = opendir(fsRoot.c_str());
+    if (directory == nullptr)
+    {
+      return false;
+    }
+    while (dirent *entry = readdir(directory))
+    {
+      if (entry->d_type != DT_DIR)
+      {
+        unlink(_path(entry->d_name).c_str());
+      }
+    }
+    closedir(directory);
+    return true;
+  }
+
+  File FS::open(const char *path, const char *mode)
+  {
+    String full = _path(path);
+    struct stat status;
+    if (stat(full.c_str(), &status) == 0 && S_ISDIR(status.st_mode))
+    {
+      return File(nullptr, true);
+    }
+
+    // Binary mode is the default, as on the ESP8266
+    String binaryMode = String(mode) + "b";
+    return File(fopen(full.c_str(), binaryMode.c_str()), false);
+  }
+
+  bool FS::exists(const char *path)
+  {
+    struct stat status;
+    return stat(_path(path).c_str(), &status) == 0;
+  }
+
+  bool FS::remove(const char *path)
+  {
+    return unlink(_path(path).c_str()) == 0;
+  }
+
+  bool FS::rename(const char *from, const char *to)
+  {
+    return ::rename(_path(from).c_str(), _path(to).c_str()) == 0;
+  }
+
+  bool FS::mkdir(const char *path)
+  {
+    return ::mkdir(_path(path).c_str(), 0755) == 0 || errno == EEXIST;
+  }
+}
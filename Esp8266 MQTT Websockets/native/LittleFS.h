@@ -0,0 +1,8 @@
+#ifndef LITTLEFS_h
+#define LITTLEFS_h
+
+#include "FS.h"
+
+extern fs::FS LittleFS;
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef NATIVE_h
+#define NATIVE_h
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Host only additions to the shim, for tests, benchmarks and the load
+ * harness. Firmware sources never include this directly.
+ */
+
+// Called after every digitalWrite(), from the thread that wrote the pin
+typedef void (*PinWriteHook)(uint8_t pin, uint8_t value);
+void setPinWriteHook(PinWriteHook hook);
+
+// Where Serial output goes, NULL to discard it. Defaults to stdout.
+void setSerialOutput(FILE *out);
+
+/*
+ * Directory that backs LittleFS. Taken from the NATIVE_FS_DIR environment
+ * variable when set, otherwise a new temporary directory. Valid after
+ * LittleFS.begin().
+ */
+const char *nativeFsRoot();
+
+#endif
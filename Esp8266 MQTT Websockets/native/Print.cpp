@@ -0,0 +1,78 @@
+#include "Print.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <vector>
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+  size_t written = 0;
+  while (written < size && write(buffer[written]) == 1)
+  {
+    written++;
+  }
+  return written;
+}
+
+static size_t writeFormatted(Print &out, const char *format, va_list args)
+{
+  char buffer[64];
+  va_list copy;
+  va_copy(copy, args);
+  int length = vsnprintf(buffer, sizeof(buffer), format, copy);
+  va_end(copy);
+  if (length < 0)
+  {
+    return 0;
+  }
+  if ((size_t)length < sizeof(buffer))
+  {
+    return out.write((const uint8_t *)buffer, length);
+  }
+
+  std::vector<char> large(length + 1);
+  vsnprintf(large.data(), large.size(), format, args);
+  return out.write((const uint8_t *)large.data(), length);
+}
+
+size_t Print::printf(const char *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  size_t written = writeFormatted(*this, format, args);
+  va_end(args);
+  return written;
+}
+
+size_t Print::printf_P(const char *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  size_t written = writeFormatted(*this, format, args);
+  va_end(args);
+  return written;
+}
+
+size_t Print::print(long value, int base)
+{
+  return print(String(value, base));
+}
+
+size_t Print::print(unsigned long value, int base)
+{
+  return print(String(value, base));
+}
+
+size_t Print::print(long long value, int base)
+{
+  return print(String(value, base));
+}
+
+size_t Print::print(unsigned long long value, int base)
+{
+  return print(String(value, base));
+}
+
+size_t Print::print(double value, int decimals)
+{
+  return print(String(value, decimals));
+}
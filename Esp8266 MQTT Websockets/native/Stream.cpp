@@ -0,0 +1,115 @@
+#include "Arduino.h"
+
+int Stream::timedRead()
+{
+  unsigned long start = millis();
+  do
+  {
+    int c = read();
+    if (c >= 0)
+    {
+      return c;
+    }
+    yield();
+  } while (millis() - start < _timeout);
+  return -1;
+}
+
+int Stream::timedPeek()
+{
+  unsigned long start = millis();
+  do
+  {
+    int c = peek();
+    if (c >= 0)
+    {
+      return c;
+    }
+    yield();
+  } while (millis() - start < _timeout);
+  return -1;
+}
+
+bool Stream::find(const char *target)
+{
+  return find(target, strlen(target));
+}
+
+bool Stream::find(const char *target, size_t length)
+{
+  if (length == 0)
+  {
+    return true;
+  }
+
+  // Restarting at the first character is enough for the targets used here
+  size_t matched = 0;
+  int c;
+  while ((c = timedRead()) >= 0)
+  {
+    if (c == target[matched])
+    {
+      if (++matched == length)
+      {
+        return true;
+      }
+    }
+    else
+    {
+      matched = c == target[0] ? 1 : 0;
+    }
+  }
+  return false;
+}
+
+size_t Stream::readBytes(char *buffer, size_t length)
+{
+  size_t count = 0;
+  while (count < length)
+  {
+    int c = timedRead();
+    if (c < 0)
+    {
+      break;
+    }
+    buffer[count++] = (char)c;
+  }
+  return count;
+}
+
+size_t Stream::readBytesUntil(char terminator, char *buffer, size_t length)
+{
+  size_t count = 0;
+  while (count < length)
+  {
+    int c = timedRead();
+    if (c < 0 || c == terminator)
+    {
+      break;
+    }
+    buffer[count++] = (char)c;
+  }
+  return count;
+}
+
+String Stream::readString()
+{
+  String result;
+  int c;
+  while ((c = timedRead()) >= 0)
+  {
+    result += (char)c;
+  }
+  return result;
+}
+
+String Stream::readStringUntil(char terminator)
+{
+  String result;
+  int c;
+  while ((c = timedRead()) >= 0 && c != terminator)
+  {
+    result += (char)c;
+  }
+  return result;
+}
@@ -0,0 +1,14 @@
+#ifndef TICKER_h
+#define TICKER_h
+
+#include <stdint.h>
+
+// Timers never fire on the host, where the heap is not measured anyway
+class Ticker
+{
+public:
+  void attach_ms(uint32_t milliseconds, void (*callback)()) {}
+  void detach() {}
+};
+
+#endif
@@ -0,0 +1,64 @@
+#include "TimeLib.h"
+
+static time_t offset = 0; // Set with setTime(), relative to the host clock
+
+time_t now()
+{
+  return time(nullptr) + offset;
+}
+
+void setTime(time_t t)
+{
+  offset = t - time(nullptr);
+}
+
+void setSyncProvider(getExternalTime provider) {}
+
+void setSyncInterval(time_t interval) {}
+
+timeStatus_t timeStatus()
+{
+  return timeSet;
+}
+
+static struct tm fields(time_t t)
+{
+  struct tm result;
+  gmtime_r(&t, &result);
+  return result;
+}
+
+int hour(time_t t)
+{
+  return fields(t).tm_hour;
+}
+
+int minute(time_t t)
+{
+  return fields(t).tm_min;
+}
+
+int second(time_t t)
+{
+  return fields(t).tm_sec;
+}
+
+int day(time_t t)
+{
+  return fields(t).tm_mday;
+}
+
+int weekday(time_t t)
+{
+  return fields(t).tm_wday + 1;
+}
+
+int month(time_t t)
+{
+  return fields(t).tm_mon + 1;
+}
+
+int year(time_t t)
+{
+  return fields(t).tm_year + 1900;
+}
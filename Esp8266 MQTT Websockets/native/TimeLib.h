@@ -0,0 +1,46 @@
+#ifndef TIMELIB_h
+#define TIMELIB_h
+
+#include <time.h>
+
+#define SECS_PER_MIN 60UL
+#define SECS_PER_HOUR 3600UL
+#define SECS_PER_DAY 86400UL
+
+typedef time_t (*getExternalTime)();
+
+enum timeStatus_t
+{
+  timeNotSet,
+  timeNeedsSync,
+  timeSet
+};
+
+/*
+ * The host clock is already synchronised, so now() follows it and a sync
+ * provider is stored but never called. The fields are in UTC, like the
+ * NTP time the firmware sets.
+ */
+time_t now();
+void setTime(time_t t);
+void setSyncProvider(getExternalTime provider);
+void setSyncInterval(time_t interval);
+timeStatus_t timeStatus();
+
+int hour(time_t t);
+int minute(time_t t);
+int second(time_t t);
+int day(time_t t);
+int weekday(time_t t); // Sunday is 1
+int month(time_t t);
+int year(time_t t);
+
+inline int hour() { return hour(now()); }
+inline int minute() { return minute(now()); }
+inline int second() { return second(now()); }
+inline int day() { return day(now()); }
+inline int weekday() { return weekday(now()); }
+inline int month() { return month(now()); }
+inline int year() { return year(now()); }
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef WSTRING_h
+#define WSTRING_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+class __FlashStringHelper;
+#define FPSTR(p) (reinterpret_cast<const __FlashStringHelper *>(p))
+#define F(s) FPSTR(s)
+
+/**
+ * Arduino String on top of std::string. Allocation costs differ from the
+ * ESP8266 core, so benchmark numbers are only comparable between host
+ * runs.
+ */
+class String
+{
+public:
+  String() {}
+  String(const char *text) : _text(text != nullptr ? text : "") {}
+  String(const char *text, size_t length) : _text(text, length) {}
+  String(const __FlashStringHelper *text) : String(reinterpret_cast<const char *>(text)) {}
+  explicit String(char c) : _text(1, c) {}
+  explicit String(unsigned char value, unsigned char base = 10);
+  explicit String(int value, unsigned char base = 10);
+  explicit String(unsigned int value, unsigned char base = 10);
+  explicit String(long value, unsigned char base = 10);
+  explicit String(unsigned long value, unsigned char base = 10);
+  explicit String(long long value, unsigned char base = 10);
+  explicit String(unsigned long long value, unsigned char base = 10);
+  explicit String(float value, unsigned char decimals = 2);
+  explicit String(double value, unsigned char decimals = 2);
+
+  const char *c_str() const { return _text.c_str(); }
+  unsigned int length() const { return _text.size(); }
+  bool isEmpty() const { return _text.empty(); }
+  bool reserve(unsigned int size);
+
+  bool concat(const String &text);
+  bool concat(const char *text);
+  bool concat(const char *text, unsigned int length);
+  bool concat(char c);
+  bool concat(int value) { return concat(String(value)); }
+  bool concat(unsigned int value) { return concat(String(value)); }
+  bool concat(long value) { return concat(String(value)); }
+  bool concat(unsigned long value) { return concat(String(value)); }
+
+  String &operator+=(const String &text) { concat(text); return *this; }
+  String &operator+=(const char *text) { concat(text); return *this; }
+  String &operator+=(const __FlashStringHelper *text) { concat(reinterpret_cast<const char *>(text)); return *this; }
+  String &operator+=(char c) { concat(c); return *this; }
+  String &operator+=(unsigned char value) { concat(String(value)); return *this; }
+  String &operator+=(int value) { concat(value); return *this; }
+  String &operator+=(unsigned int value) { concat(value); return *this; }
+  String &operator+=(long value) { concat(value); return *this; }
+  String &operator+=(unsigned long value) { concat(value); return *this; }
+
+  bool equals(const String &other) const { return _text == other._text; }
+  bool equals(const char *other) const { return _text == other; }
+  bool equalsIgnoreCase(const String &other) const;
+  bool startsWith(const String &prefix) const;
+  bool endsWith(const String &suffix) const;
+  bool operator==(const String &other) const { return equals(other); }
+  bool operator==(const char *other) const { return equals(other); }
+  bool operator!=(const String &other) const { return !equals(other); }
+  bool operator!=(const char *other) const { return !equals(other); }
+  bool operator<(const String &other) const { return _text < other._text; }
+
+  char charAt(unsigned int index) const;
+  void setCharAt(unsigned int index, char c);
+  char operator[](unsigned int index) const { return charAt(index); }
+  char &operator[](unsigned int index);
+  void getBytes(unsigned char *buffer, unsigned int size, unsigned int index = 0) const;
+  void toCharArray(char *buffer, unsigned int size, unsigned int index = 0) const;
+
+  int indexOf(char c, unsigned int from = 0) const;
+  int indexOf(const String &text, unsigned int from = 0) const;
+  int lastIndexOf(char c) const;
+  int lastIndexOf(const String &text) const;
+  String substring(unsigned int from) const;
+  String substring(unsigned int from, unsigned int to) const;
+
+  void replace(char find, char replacement);
+  void replace(const String &find, const String &replacement);
+  void remove(unsigned int index);
+  void remove(unsigned int index, unsigned int count);
+  void toLowerCase();
+  void toUpperCase();
+  void trim();
+
+  long toInt() const { return atol(_text.c_str()); }
+  float toFloat() const { return atof(_text.c_str()); }
+  double toDouble() const { return atof(_text.c_str()); }
+
+private:
+  std::string _text;
+};
+
+String operator+(const String &lhs, const String &rhs);
+String operator+(const String &lhs, const char *rhs);
+String operator+(const char *lhs, const String &rhs);
+String operator+(const String &lhs, const __FlashStringHelper *rhs);
+String operator+(const String &lhs, char rhs);
+String operator+(const String &lhs, int rhs);
+String operator+(const String &lhs, unsigned int rhs);
+String operator+(const String &lhs, long rhs);
+String operator+(const String &lhs, unsigned long rhs);
+
+#endif
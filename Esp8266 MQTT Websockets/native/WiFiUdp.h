@@ -0,0 +1,42 @@
+#ifndef WIFIUDP_h
+#define WIFIUDP_h
+
+#include <vector>
+#include "ESP8266WiFi.h"
+
+// UDP over a non-blocking POSIX socket, IPv4 only
+class WiFiUDP : public Stream
+{
+public:
+  ~WiFiUDP() { stop(); }
+
+  uint8_t begin(uint16_t port);
+  void stop();
+  int beginPacket(IPAddress ip, uint16_t port);
+  int beginPacket(const char *host, uint16_t port);
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override;
+  int endPacket();
+  int parsePacket();
+  int available() override { return _rx.size() - _rxPosition; }
+  int read() override { return available() > 0 ? _rx[_rxPosition++] : -1; }
+  int read(uint8_t *buffer, size_t size);
+  int peek() override { return available() > 0 ? _rx[_rxPosition] : -1; }
+  IPAddress remoteIP() const { return _remoteIP; }
+  uint16_t remotePort() const { return _remotePort; }
+  using Print::write;
+
+private:
+  int _fd = -1;
+  std::vector<uint8_t> _tx;
+  std::vector<uint8_t> _rx;
+  size_t _rxPosition = 0;
+  IPAddress _txIP;
+  uint16_t _txPort = 0;
+  IPAddress _remoteIP;
+  uint16_t _remotePort = 0;
+
+  bool _open();
+};
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef BASE64_h
+#define BASE64_h
+
+#include "Arduino.h"
+
+class base64
+{
+public:
+  // Like the core, a newline follows every 72 characters when asked for
+  static String encode(const uint8_t *data, size_t length, bool doNewLines = true);
+  static String encode(const String &text, bool doNewLines = true)
+  {
+    return encode((const uint8_t *)text.c_str(), text.length(), doNewLines);
+  }
+};
+
+#endif
@@ -0,0 +1,430 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <PubSubClient.h>
+#include <ESP8266WiFi.h>
+#include <getopt.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "ChannelTable.h"
+#include "NewRemoteTransmitter.h"
+#include "RemoteProtocols.h"
+#include "RfDecoder.h"
+
+/*
+ * Load harness for the MQTT firmware, built with "pio run -e load". The
+ * firmware runs unchanged in the main thread against a local broker, while
+ * a second client publishes <base>/channelN/set at a fixed rate:
+ *
+ *   mosquitto -p 1883 &
+ *   .pio/build/load/program --rate 20 --seconds 60
+ *
+ * The pin writes of the transmitter are decoded again, so every command is
+ * followed from the publish to the first edge of the telegram that carries
+ * it. The result is one line of key=value pairs, followed by the firmware's
+ * own <base>/stats:
+ *
+ *   rate=20,published=1200,arrived=..,transmitted=..,coalesced=..,dropped=..,
+ *   latency_p50=..,latency_p90=..,latency_p99=..,latency_max=..,
+ *   pings=..,ping_jitter_avg=..,ping_jitter_max=..
+ *
+ * Latencies are in ms. Coalesced commands were replaced by a later command
+ * for the same channel before they were sent, which the RF queue does on
+ * purpose; dropped commands were not sent within --drain seconds after the
+ * last publish although nothing replaced them. TLS is not emulated, so the
+ * broker has to listen without it.
+ */
+
+#define LOAD_BASE_TOPIC "kaku/load"
+#define LOAD_IDLE_GAP 20000  // A quiet pin for this many us separates two transmissions
+#define LOAD_QUIET_TIME 5000 // The firmware is done after this many ms without a transmission
+#define RF_PIN D5            // As in main.cpp
+#define PING_INTERVAL 10000  // As in main.cpp
+
+// From main.cpp
+void handleMessage(char *topic, uint8_t *payload, unsigned int length);
+void publishStats();
+extern ChannelTable channels;
+extern PubSubClient mqttClient;
+
+struct Options
+{
+  const char *host = "localhost";
+  uint16_t port = 1883;
+  float rate = 10;         // Commands per second
+  unsigned long seconds = 60;
+  unsigned long drain = 30; // Seconds to wait for commands still in flight
+  byte channelCount = 8;
+  bool verbose = false;
+};
+
+struct Published
+{
+  unsigned long at; // micros()
+  byte channel;
+  bool switchOn;
+  bool transmitted;
+  bool coalesced;
+  uint32_t latency; // us, valid when transmitted
+};
+
+static Options options;
+static std::mutex publishedLock;
+static std::vector<Published> published;
+static size_t arrived = 0; // Commands handed to the firmware, in publish order
+static std::vector<unsigned long> pings; // micros() of every <base>/ping
+static String firmwareStats;
+static std::atomic<bool> generating(true);
+static std::atomic<bool> finished(false);
+
+static RfDecoder decoder;
+static unsigned long lastEdge = 0;
+static unsigned long transmissionStart = 0;
+static unsigned long telegramStart = 0;
+static byte telegram = 0; // Telegrams sent of the current transmission
+static RfCode transmissionCode;
+static bool transmissionDecoded = false;
+
+/**
+ * Mark the command that a telegram carried. The RF queue keeps the last
+ * command per channel, so that is the last one that reached the firmware
+ * before the telegram started. Earlier ones that are still waiting were
+ * replaced.
+ */
+static void matchTransmission(byte channel, bool switchOn)
+{
+  std::lock_guard<std::mutex> guard(publishedLock);
+
+  int match = -1;
+  for (size_t i = 0; i < arrived; i++)
+  {
+    const Published &command = published[i];
+    if (command.channel == channel && !command.transmitted && !command.coalesced)
+    {
+      match = i;
+    }
+  }
+  if (match < 0 || published[match].switchOn != switchOn)
+  {
+    return;
+  }
+
+  for (int i = 0; i < match; i++)
+  {
+    Published &command = published[i];
+    if (command.channel == channel && !command.transmitted)
+    {
+      command.coalesced = true;
+    }
+  }
+  published[match].transmitted = true;
+  published[match].latency = transmissionStart - published[match].at;
+}
+
+static bool sameCode(const RfCode &a, const RfCode &b)
+{
+  return a.address == b.address && a.unit == b.unit && a.switchType == b.switchType && a.group == b.group;
+}
+
+static void handlePinWrite(uint8_t pin, uint8_t value)
+{
+  if (pin != RF_PIN)
+  {
+    return;
+  }
+
+  unsigned long now = micros();
+  unsigned long duration = now - lastEdge;
+  lastEdge = now;
+
+  // The stop gap completes the telegram that started at telegramStart. Only
+  // the first of the repeated telegrams counts, but a different code means
+  // the next command followed without a pause.
+  RfCode code;
+  if (decoder.feed(min(duration, 65535UL), code) && (!transmissionDecoded || !sameCode(code, transmissionCode)))
+  {
+    if (transmissionDecoded)
+    {
+      transmissionStart = telegramStart;
+      telegram = 0;
+    }
+    transmissionDecoded = true;
+    transmissionCode = code;
+
+    for (byte i = 0; i < options.channelCount && !code.group; i++)
+    {
+      const ChannelTarget &target = channels[i];
+      if (target.protocol == PROTOCOL_KAKU && target.address == code.address && target.unit == code.unit)
+      {
+        matchTransmission(i, code.switchType == NewRemoteTransmitter::SWITCH_ON);
+        break;
+      }
+    }
+  }
+
+  // A low longer than any gap inside a telegram ends one. The same command
+  // twice in a row is only told apart by the number of telegrams.
+  if (value == HIGH && duration > DECODER_SYNC_MAX)
+  {
+    telegramStart = now;
+    telegram++;
+    if (duration > LOAD_IDLE_GAP || telegram >= KakuProtocol::telegrams || transmissionStart == 0)
+    {
+      telegram = 0;
+      transmissionStart = now;
+      transmissionDecoded = false;
+    }
+  }
+}
+
+/**
+ * Callback of the firmware's client. Notes the arrival of every command
+ * before the firmware handles it.
+ */
+static void handleFirmwareMessage(char *topic, uint8_t *payload, unsigned int length)
+{
+  const char *suffix = topic + strlen(LOAD_BASE_TOPIC);
+  if (strncmp(topic, LOAD_BASE_TOPIC, strlen(LOAD_BASE_TOPIC)) == 0 && strncmp(suffix, "/channel", 8) == 0)
+  {
+    std::lock_guard<std::mutex> guard(publishedLock);
+    arrived++;
+  }
+  handleMessage(topic, payload, length);
+}
+
+static void handleGeneratorMessage(char *topic, uint8_t *payload, unsigned int length)
+{
+  std::lock_guard<std::mutex> guard(publishedLock);
+  if (strcmp(topic, LOAD_BASE_TOPIC "/ping") == 0)
+  {
+    pings.push_back(micros());
+  }
+  else if (strcmp(topic, LOAD_BASE_TOPIC "/stats") == 0)
+  {
+    firmwareStats = String((const char *)payload, length);
+  }
+}
+
+/**
+ * Publish alternating ON and OFF to the channels in turn, at options.rate
+ * per second, then keep listening until the main thread is done.
+ */
+static void generate()
+{
+  WiFiClient client;
+  PubSubClient generator;
+  generator.setClient(client);
+  generator.setServer(options.host, options.port);
+  generator.setCallback(handleGeneratorMessage);
+  if (!generator.connect("kaku-load-generator"))
+  {
+    fprintf(stderr, "Generator unable to connect to %s:%u\n", options.host, options.port);
+    exit(1);
+  }
+  generator.subscribe(LOAD_BASE_TOPIC "/ping");
+  generator.subscribe(LOAD_BASE_TOPIC "/stats");
+
+  unsigned long interval = 1000000 / options.rate;
+  unsigned long start = micros();
+  unsigned long next = start;
+  uint32_t count = 0;
+  while (!finished)
+  {
+    generator.loop();
+    if (generating && (long)(micros() - next) >= 0)
+    {
+      if (micros() - start >= options.seconds * 1000000UL)
+      {
+        generating = false;
+        continue;
+      }
+
+      byte channel = count % options.channelCount;
+      bool switchOn = (count / options.channelCount) % 2 == 0;
+      char topic[64];
+      snprintf(topic, sizeof(topic), LOAD_BASE_TOPIC "/channel%u/set", channel);
+      {
+        std::lock_guard<std::mutex> guard(publishedLock);
+        published.push_back({micros(), channel, switchOn, false, false, 0});
+      }
+      generator.publish(topic, switchOn ? "ON" : "OFF");
+      count++;
+      next += interval;
+    }
+    delay(1);
+  }
+  generator.disconnect();
+}
+
+static uint32_t percentile(const std::vector<uint32_t> &sorted, float fraction)
+{
+  if (sorted.empty())
+  {
+    return 0;
+  }
+  return sorted[min(sorted.size() - 1, (size_t)(fraction * sorted.size()))];
+}
+
+static void report()
+{
+  std::lock_guard<std::mutex> guard(publishedLock);
+
+  std::vector<uint32_t> latencies;
+  uint32_t coalesced = 0;
+  for (const Published &command : published)
+  {
+    if (command.transmitted)
+    {
+      latencies.push_back(command.latency / 1000);
+    }
+    else if (command.coalesced)
+    {
+      coalesced++;
+    }
+  }
+  std::sort(latencies.begin(), latencies.end());
+  uint32_t dropped = published.size() - latencies.size() - coalesced;
+
+  // Deviation of every ping from PING_INTERVAL, in ms
+  uint32_t jitterTotal = 0;
+  uint32_t jitterMax = 0;
+  for (size_t i = 1; i < pings.size(); i++)
+  {
+    long interval = (pings[i] - pings[i - 1]) / 1000;
+    uint32_t jitter = abs(interval - PING_INTERVAL);
+    jitterTotal += jitter;
+    jitterMax = max(jitterMax, jitter);
+  }
+  uint32_t jitterCount = pings.size() > 1 ? pings.size() - 1 : 0;
+
+  printf("rate=%g,published=%u,arrived=%u,transmitted=%u,coalesced=%u,dropped=%u,"
+         "latency_p50=%u,latency_p90=%u,latency_p99=%u,latency_max=%u,"
+         "pings=%u,ping_jitter_avg=%u,ping_jitter_max=%u\n",
+         options.rate, (unsigned)published.size(), (unsigned)arrived, (unsigned)latencies.size(), coalesced, dropped,
+         percentile(latencies, 0.5), percentile(latencies, 0.9), percentile(latencies, 0.99),
+         latencies.empty() ? 0 : latencies.back(),
+         (unsigned)pings.size(), jitterCount > 0 ? jitterTotal / jitterCount : 0, jitterMax);
+  printf("%s\n", firmwareStats.c_str());
+}
+
+static void runLoop()
+{
+  // setupMQTT() sets the firmware's own callback after every reconnect
+  mqttClient.setCallback(handleFirmwareMessage);
+  loop();
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "Usage: %s [--host localhost] [--port 1883] [--rate 10] [--seconds 60] [--channels 8] [--drain 30] [--verbose]\n", name);
+  exit(2);
+}
+
+static void parseOptions(int argc, char **argv)
+{
+  static const option longOptions[] = {
+      {"host", required_argument, nullptr, 'h'},
+      {"port", required_argument, nullptr, 'p'},
+      {"rate", required_argument, nullptr, 'r'},
+      {"seconds", required_argument, nullptr, 's'},
+      {"channels", required_argument, nullptr, 'c'},
+      {"drain", required_argument, nullptr, 'd'},
+      {"verbose", no_argument, nullptr, 'v'},
+      {nullptr, 0, nullptr, 0},
+  };
+
+  int option;
+  while ((option = getopt_long(argc, argv, "h:p:r:s:c:d:v", longOptions, nullptr)) != -1)
+  {
+    switch (option)
+    {
+    case 'h':
+      options.host = optarg;
+      break;
+    case 'p':
+      options.port = atoi(optarg);
+      break;
+    case 'r':
+      options.rate = atof(optarg);
+      break;
+    case 's':
+      options.seconds = atol(optarg);
+      break;
+    case 'c':
+      options.channelCount = constrain(atoi(optarg), 1, MAX_CHANNELS);
+      break;
+    case 'd':
+      options.drain = atol(optarg);
+      break;
+    case 'v':
+      options.verbose = true;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+
+  if (options.rate <= 0 || options.seconds == 0)
+  {
+    usage(argv[0]);
+  }
+}
+
+/**
+ * Give the firmware a finished setup and a cached broker configuration,
+ * the configuration server is not reachable from the host.
+ */
+static void prepareStorage()
+{
+  LittleFS.begin();
+
+  File file = LittleFS.open("hasSetup", "w");
+  file.close();
+
+  file = LittleFS.open("mqttConfig", "w");
+  file.printf("%s\n%u\nload\nload\nkaku-load-bridge\n%s\n", options.host, options.port, LOAD_BASE_TOPIC);
+  file.close();
+}
+
+int main(int argc, char **argv)
+{
+  parseOptions(argc, argv);
+  if (!options.verbose)
+  {
+    setSerialOutput(nullptr);
+  }
+
+  prepareStorage();
+  setup();
+  if (!mqttClient.connected())
+  {
+    fprintf(stderr, "Firmware unable to connect to %s:%u\n", options.host, options.port);
+    return 1;
+  }
+  setPinWriteHook(handlePinWrite);
+
+  std::thread generator(generate);
+  while (generating)
+  {
+    runLoop();
+  }
+
+  // Commands still in flight count as dropped when they are not sent in time
+  unsigned long drainStart = millis();
+  while (millis() - drainStart < options.drain * 1000 && (micros() - lastEdge) / 1000 < LOAD_QUIET_TIME)
+  {
+    runLoop();
+  }
+  publishStats();
+  for (unsigned long start = millis(); millis() - start < 1000;)
+  {
+    runLoop();
+  }
+
+  finished = true;
+  generator.join();
+  report();
+  return 0;
+}
@@ -0,0 +1,131 @@
+#include "ChannelTable.h"
+#include <LittleFS.h>
+
+static const char *const protocolNames[PROTOCOL_COUNT] = {"kaku", "kakuold", "action", "elro"};
+
+// Highest address and unit accepted per protocol
+static const unsigned long protocolMaxAddress[PROTOCOL_COUNT] = {(1UL << 26) - 1, 15, 31, 31};
+static const byte protocolMaxUnit[PROTOCOL_COUNT] = {15, 15, 4, 4};
+
+void ChannelTable::begin(unsigned long defaultAddress)
+{
+  _defaultAddress = defaultAddress;
+  for (byte i = 0; i < MAX_CHANNELS; i++)
+  {
+    _targets[i] = _default(i);
+  }
+}
+
+void ChannelTable::load()
+{
+  File file = LittleFS.open("channels", "r");
+  if (!file)
+  {
+    return;
+  }
+
+  char line[48];
+  while (file.available())
+  {
+    size_t length = file.readBytesUntil('\n', line, sizeof(line) - 1);
+    line[length] = '\0';
+
+    char *text;
+    long channel = strtol(line, &text, 10);
+    if (channel >= 0 && channel < MAX_CHANNELS && text != line)
+    {
+      configure(channel, text);
+    }
+  }
+  file.close();
+}
+
+void ChannelTable::save()
+{
+  File file = LittleFS.open("channels", "w");
+  if (!file)
+  {
+    Serial.println("Failed to open file for writing");
+    return;
+  }
+
+  ChannelTarget target;
+  for (byte i = 0; i < MAX_CHANNELS; i++)
+  {
+    target = _default(i);
+    if (target.protocol != _targets[i].protocol || target.unit != _targets[i].unit || target.address != _targets[i].address)
+    {
+      file.print(i);
+      file.print(' ');
+      file.println(describe(i));
+    }
+  }
+  file.close();
+}
+
+bool ChannelTable::configure(byte channel, const char *text)
+{
+  char name[12];
+  unsigned long address;
+  unsigned int unit;
+
+  int fields = sscanf(text, " %11s %lu %u", name, &address, &unit);
+  if (channel >= MAX_CHANNELS || fields < 1)
+  {
+    return false;
+  }
+
+  byte protocol = PROTOCOL_COUNT;
+  for (byte i = 0; i < PROTOCOL_COUNT; i++)
+  {
+    if (strcasecmp(name, protocolNames[i]) == 0)
+    {
+      protocol = i;
+    }
+  }
+
+  if (protocol == PROTOCOL_COUNT)
+  {
+    return false;
+  }
+
+  if (fields == 1 && protocol == PROTOCOL_KAKU)
+  {
+    _targets[channel] = _default(channel);
+    return true;
+  }
+
+  if (fields != 3 || address > protocolMaxAddress[protocol] || unit > protocolMaxUnit[protocol])
+  {
+    return false;
+  }
+
+  _targets[channel] = {protocol, (byte)unit, address};
+  return true;
+}
+
+String ChannelTable::describe(byte channel) const
+{
+  const ChannelTarget &target = _targets[channel];
+  String result = protocolNames[target.protocol];
+  result += ' ';
+  result += target.address;
+  result += ' ';
+  result += target.unit;
+  return result;
+}
+
+void ChannelTable::send(NewRemoteTransmitter &transmitter, byte channel, byte switchType, byte dimLevel) const
+{
+  const ChannelTarget &target = _targets[channel];
+  sendRemote(transmitter, target.protocol, target.address, target.unit, switchType, dimLevel);
+}
+
+ChannelTarget ChannelTable::_default(byte channel) const
+{
+  ChannelTarget target = {};
+  target.protocol = PROTOCOL_KAKU;
+  target.unit = channel % UNITS_PER_ADDRESS;
+  target.address = (_defaultAddress & 0xFFFFFF) | (unsigned long)(channel / UNITS_PER_ADDRESS) << 24;
+  return target;
+}
@@ -0,0 +1,60 @@
+#ifndef COMMANDCACHE_h
+#define COMMANDCACHE_h
+
+#include <Arduino.h>
+
+#define COMMAND_CACHE_SIZE 16
+
+/**
+ * The most recent commands that carried a sequence number, so a command
+ * that is delivered again after a reconnect is recognised and not
+ * transmitted a second time. Commands are keyed by a hash of the topic and
+ * the sequence number; the oldest entry is overwritten when the cache is
+ * full.
+ */
+class CommandCache
+{
+public:
+  /**
+   * Remember a command, returns false when it has been seen before.
+   */
+  bool remember(const char *topic, uint32_t sequence)
+  {
+    uint32_t key = _hash(topic);
+    for (byte i = 0; i < _count; i++)
+    {
+      if (_keys[i] == key && _sequences[i] == sequence)
+      {
+        return false;
+      }
+    }
+
+    _keys[_next] = key;
+    _sequences[_next] = sequence;
+    _next = (_next + 1) % COMMAND_CACHE_SIZE;
+    if (_count < COMMAND_CACHE_SIZE)
+    {
+      _count++;
+    }
+    return true;
+  }
+
+private:
+  uint32_t _keys[COMMAND_CACHE_SIZE];
+  uint32_t _sequences[COMMAND_CACHE_SIZE];
+  byte _next = 0;
+  byte _count = 0;
+
+  // FNV-1a
+  static uint32_t _hash(const char *text)
+  {
+    uint32_t result = 2166136261u;
+    while (*text != '\0')
+    {
+      result = (result ^ (byte)*text++) * 16777619u;
+    }
+    return result;
+  }
+};
+
+#endif
@@ -0,0 +1,135 @@
+#include "I2sTransmitter.h"
+#ifdef ESP8266
+#include <i2s.h>
+#endif
+
+I2sTransmitter::I2sTransmitter(NewRemoteTransmitter &encoder) : _encoder(encoder) {
+	_words = 0;
+	_position = 0;
+	_repeatsLeft = 0;
+}
+
+boolean I2sTransmitter::begin() {
+#ifdef ESP8266
+	if (!i2s_begin()) {
+		return false;
+	}
+
+	// The I2S base clock is 160 MHz, a bit clock that is off would stretch every pulse
+	uint8_t div1, div2;
+	if (!findDividers(160UL * I2S_SAMPLE_USEC, div1, div2)) {
+		Serial.printf("No I2S dividers for a bit time of %u us\n", I2S_SAMPLE_USEC);
+		return false;
+	}
+	i2s_set_dividers(div1, div2);
+	return true;
+#else
+	return false;
+#endif
+}
+
+boolean I2sTransmitter::findDividers(uint32_t product, uint8_t &div1, uint8_t &div2) {
+	for (div1 = 2; div1 <= 63; div1++) {
+		uint32_t other = product / div1;
+		if (other >= 2 && other <= 63 && div1 * other == product) {
+			div2 = other;
+			return true;
+		}
+	}
+	return false;
+}
+
+boolean I2sTransmitter::sendUnit(byte unit, boolean switchOn) {
+	return send(PROTOCOL_KAKU, _encoder._address, false, switchOn ? NewRemoteTransmitter::SWITCH_ON : NewRemoteTransmitter::SWITCH_OFF, unit, 0);
+}
+
+boolean I2sTransmitter::sendUnit(unsigned long address, byte unit, boolean switchOn) {
+	return send(PROTOCOL_KAKU, address, false, switchOn ? NewRemoteTransmitter::SWITCH_ON : NewRemoteTransmitter::SWITCH_OFF, unit, 0);
+}
+
+boolean I2sTransmitter::sendGroup(boolean switchOn) {
+	return send(PROTOCOL_KAKU, _encoder._address, true, switchOn ? NewRemoteTransmitter::SWITCH_ON : NewRemoteTransmitter::SWITCH_OFF, 0, 0);
+}
+
+boolean I2sTransmitter::sendDim(byte unit, byte dimLevel) {
+	return send(PROTOCOL_KAKU, _encoder._address, false, NewRemoteTransmitter::SWITCH_DIM, unit, dimLevel);
+}
+
+boolean I2sTransmitter::sendGroupDim(byte dimLevel) {
+	return send(PROTOCOL_KAKU, _encoder._address, true, NewRemoteTransmitter::SWITCH_DIM, 0, dimLevel);
+}
+
+boolean I2sTransmitter::send(byte protocol, unsigned long address, boolean group, byte switchType, byte unit, byte dimLevel) {
+	if (group) {
+		return sendProtocol<KakuGroupProtocol>(address, 0, switchType, dimLevel);
+	}
+
+	switch (protocol) {
+		case PROTOCOL_KAKU_OLD:
+			return sendProtocol<KakuOldProtocol>(address, unit, switchType, dimLevel);
+		case PROTOCOL_ACTION:
+			return sendProtocol<ActionProtocol>(address, unit, switchType, dimLevel);
+		case PROTOCOL_ELRO:
+			return sendProtocol<ElroProtocol>(address, unit, switchType, dimLevel);
+		default:
+			return sendProtocol<KakuProtocol>(address, unit, switchType, dimLevel);
+	}
+}
+
+boolean I2sTransmitter::_send(const byte *symbols, byte count, const NewRemoteTransmitter::SymbolTiming &symbolTiming, byte telegrams) {
+	if (busy()) {
+		return false;
+	}
+
+	_words = renderTelegram(symbols, count, symbolTiming, I2S_SAMPLE_USEC, _buffer, I2S_MAX_WORDS);
+	_position = 0;
+	_repeatsLeft = telegrams - 1; // The first telegram is not a repeat
+	return _words > 0;
+}
+
+void I2sTransmitter::loop() {
+#ifdef ESP8266
+	while (busy()) {
+		if (_position == _words) {
+			_position = 0;
+			_repeatsLeft--;
+			continue;
+		}
+
+		if (!i2s_write_sample_nb(_buffer[_position])) {
+			// DMA queue is full, come back on the next loop
+			return;
+		}
+		_position++;
+	}
+#endif
+}
+
+size_t I2sTransmitter::renderTelegram(const byte *symbols, byte count, const NewRemoteTransmitter::SymbolTiming &symbolTiming,
+		unsigned int sampleusec, uint32_t *words, size_t maxWords) {
+	size_t maxBits = maxWords * 32;
+	unsigned long elapsed = 0;
+	size_t bit = 0;
+
+	for (size_t i = 0; i < maxWords; i++) {
+		words[i] = 0;
+	}
+
+	for (byte i = 0; i < count; i++) {
+		byte symbol = symbols[i] & 3;
+		elapsed += symbolTiming.high[symbol];
+		size_t fall = (elapsed + sampleusec / 2) / sampleusec;
+		elapsed += symbolTiming.low[symbol];
+		size_t end = (elapsed + sampleusec / 2) / sampleusec;
+		if (end > maxBits) {
+			return 0;
+		}
+
+		for (; bit < fall; bit++) {
+			words[bit / 32] |= 0x80000000UL >> (bit % 32);
+		}
+		bit = end;
+	}
+
+	return (bit + 31) / 32;
+}
@@ -0,0 +1,93 @@
+#ifndef I2sTransmitter_h
+#define I2sTransmitter_h
+
+#include <Arduino.h>
+#include "NewRemoteTransmitter.h"
+#include "RemoteProtocols.h"
+
+#define I2S_SAMPLE_USEC 10 // Output bit time, the KaKu, Action and Elro periods are whole multiples
+#define I2S_MAX_WORDS 280  // Longest telegram: KaKu dim, 340.5 periods of 260 us in 10 us bits
+
+/**
+ * Alternative back-end for NewRemoteTransmitter that clocks telegrams out of the
+ * I2S data line (GPIO3, the RX pin) instead of toggling RF_PIN from the CPU.
+ *
+ * A telegram is rendered once into a bitstream of 32-bit words. loop() then
+ * hands words to the I2S DMA queue whenever it has room, without waiting. The
+ * peripheral clocks them out at a fixed bit rate, so the CPU only works when a
+ * DMA buffer is released and the WiFi stack can run during transmission.
+ *
+ * Every protocol in RemoteProtocols.h is rendered from its own timing table at
+ * the same bit rate, so all channels work in an I2S build. Edges land on the
+ * nearest bit, kakuold pulses are off by at most half a bit.
+ *
+ * The transmitter data pin must be wired to GPIO3. Serial output keeps working,
+ * Serial input does not.
+ */
+class I2sTransmitter {
+	public:
+		I2sTransmitter(NewRemoteTransmitter &encoder);
+
+		/**
+		 * Starts the I2S peripheral with a bit clock of one bit per I2S_SAMPLE_USEC.
+		 * Returns false when the bit clock cannot be divided exactly from 160 MHz.
+		 */
+		boolean begin();
+
+		/**
+		 * Queue a command. Returns false while the previous one is still being sent.
+		 */
+		boolean sendUnit(byte unit, boolean switchOn);
+		boolean sendUnit(unsigned long address, byte unit, boolean switchOn); // KaKu receiver on another address
+		boolean sendGroup(boolean switchOn);
+		boolean sendDim(byte unit, byte dimLevel);
+		boolean sendGroupDim(byte dimLevel);
+
+		/**
+		 * Queue a command with the protocol selected at runtime, like sendRemote().
+		 * Group commands are KaKu only.
+		 */
+		boolean send(byte protocol, unsigned long address, boolean group, byte switchType, byte unit, byte dimLevel);
+
+		template <class Protocol>
+		boolean sendProtocol(unsigned long address, byte unit, byte switchType, byte dimLevel) {
+			byte symbols[Protocol::maxSymbols];
+			byte count = Protocol::encode(address, unit, switchType, dimLevel, symbols);
+			return _send(symbols, count, protocolTiming<Protocol>(), Protocol::telegrams);
+		}
+
+		/**
+		 * Feed the DMA queue. Call from loop().
+		 */
+		void loop();
+
+		boolean busy() const { return _repeatsLeft > 0 || _position < _words; }
+
+		/**
+		 * Renders a symbol list into a bitstream, most significant bit first, one
+		 * bit per sampleusec. Every edge is placed on the bit nearest to its time
+		 * from the start of the telegram, so rounding does not add up. Bits past
+		 * the end of the telegram in the last word are low. This is a pure function.
+		 *
+		 * @return Number of words written, 0 if maxWords is too small.
+		 */
+		static size_t renderTelegram(const byte *symbols, byte count, const NewRemoteTransmitter::SymbolTiming &symbolTiming,
+				unsigned int sampleusec, uint32_t *words, size_t maxWords);
+
+		/**
+		 * Finds the two clock dividers [2..63] of the I2S peripheral whose product
+		 * is exactly product. Returns false when there are none.
+		 */
+		static boolean findDividers(uint32_t product, uint8_t &div1, uint8_t &div2);
+
+	private:
+		NewRemoteTransmitter &_encoder;
+		uint32_t _buffer[I2S_MAX_WORDS];
+		size_t _words;
+		size_t _position;
+		byte _repeatsLeft;
+
+		boolean _send(const byte *symbols, byte count, const NewRemoteTransmitter::SymbolTiming &symbolTiming, byte telegrams);
+};
+
+#endif
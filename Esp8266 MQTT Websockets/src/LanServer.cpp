@@ -0,0 +1,384 @@
+#include "LanServer.h"
+#include <bearssl/bearssl_hash.h>
+
+// WebSocket opcodes, RFC 6455
+#define WS_TEXT 0x1
+#define WS_CLOSE 0x8
+#define WS_PING 0x9
+#define WS_PONG 0xA
+
+static const char websocketGuid[] PROGMEM = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+static const char base64Digits[] PROGMEM = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static void encodeBase64(const uint8_t *data, size_t length, char *out)
+{
+  for (size_t i = 0; i < length; i += 3)
+  {
+    uint32_t group = data[i] << 16 | (i + 1 < length ? data[i + 1] << 8 : 0) | (i + 2 < length ? data[i + 2] : 0);
+    *out++ = pgm_read_byte(base64Digits + (group >> 18 & 63));
+    *out++ = pgm_read_byte(base64Digits + (group >> 12 & 63));
+    *out++ = i + 1 < length ? pgm_read_byte(base64Digits + (group >> 6 & 63)) : '=';
+    *out++ = i + 2 < length ? pgm_read_byte(base64Digits + (group & 63)) : '=';
+  }
+  *out = '\0';
+}
+
+// Value of a header in a complete request head, returns its length, 0 when missing
+static size_t findHeader(const char *head, const char *name, const char **value)
+{
+  size_t nameLength = strlen(name);
+  const char *line = strstr(head, "\r\n");
+  while (line != NULL && line[2] != '\r')
+  {
+    line += 2;
+    if (strncasecmp(line, name, nameLength) == 0 && line[nameLength] == ':')
+    {
+      const char *start = line + nameLength + 1;
+      while (*start == ' ')
+      {
+        start++;
+      }
+      *value = start;
+      return strstr(start, "\r\n") - start;
+    }
+    line = strstr(line, "\r\n");
+  }
+  return 0;
+}
+
+static const char *statusText(int status)
+{
+  switch (status)
+  {
+  case 200:
+    return "OK";
+  case 400:
+    return "Bad Request";
+  case 404:
+    return "Not Found";
+  case 408:
+    return "Request Timeout";
+  case 413:
+    return "Payload Too Large";
+  default:
+    return "Service Unavailable";
+  }
+}
+
+void LanServer::begin(LanCommandHandler handler, LanStateFormatter formatter)
+{
+  _handler = handler;
+  _formatter = formatter;
+  for (Connection &connection : _connections)
+  {
+    connection.state = LAN_FREE;
+  }
+
+  _server.begin();
+  _server.setNoDelay(true);
+}
+
+void LanServer::loop()
+{
+  _accept();
+
+  for (Connection &connection : _connections)
+  {
+    if (connection.state == LAN_FREE)
+    {
+      continue;
+    }
+
+    if (!connection.client.connected() && connection.client.available() == 0)
+    {
+      _close(connection);
+    }
+    else if (connection.state == LAN_REQUEST)
+    {
+      _readRequest(connection);
+    }
+    else
+    {
+      _readFrames(connection);
+    }
+  }
+}
+
+void LanServer::pushState()
+{
+  for (Connection &connection : _connections)
+  {
+    if (connection.state == LAN_WEBSOCKET)
+    {
+      _sendState(connection);
+    }
+  }
+}
+
+void LanServer::_accept()
+{
+  WiFiClient client = _server.available();
+  if (!client)
+  {
+    return;
+  }
+
+  for (Connection &connection : _connections)
+  {
+    if (connection.state == LAN_FREE)
+    {
+      connection.client = client;
+      connection.client.setNoDelay(true);
+      connection.state = LAN_REQUEST;
+      connection.length = 0;
+      connection.request[0] = '\0';
+      connection.since = millis();
+      return;
+    }
+  }
+
+  // Every connection is in use
+  client.print(F("HTTP/1.1 503 Service Unavailable\r\nConnection: close\r\nContent-Length: 0\r\n\r\n"));
+  client.stop();
+}
+
+bool LanServer::_receive(Connection &connection)
+{
+  size_t room = LAN_REQUEST_SIZE - 1 - connection.length;
+  size_t available = min((size_t)connection.client.available(), room);
+  if (available > 0)
+  {
+    int count = connection.client.read((uint8_t *)connection.request + connection.length, available);
+    if (count > 0)
+    {
+      connection.length += count;
+    }
+    connection.request[connection.length] = '\0';
+  }
+  return connection.length < LAN_REQUEST_SIZE - 1;
+}
+
+void LanServer::_readRequest(Connection &connection)
+{
+  bool room = _receive(connection);
+
+  // Wait for the end of the headers and the complete body
+  char *end = strstr(connection.request, "\r\n\r\n");
+  if (end != NULL)
+  {
+    size_t headLength = end + 4 - connection.request;
+    size_t bodyLength = 0;
+    const char *value;
+    if (findHeader(connection.request, "Content-Length", &value) > 0)
+    {
+      bodyLength = strtoul(value, NULL, 10);
+    }
+
+    if (bodyLength >= LAN_REQUEST_SIZE)
+    {
+      _respond(connection, 413, NULL);
+      return;
+    }
+    if (headLength + bodyLength <= connection.length)
+    {
+      _handleRequest(connection, headLength, bodyLength);
+      return;
+    }
+  }
+
+  if (!room)
+  {
+    _respond(connection, 413, NULL);
+  }
+  else if (millis() - connection.since >= LAN_TIMEOUT)
+  {
+    _respond(connection, 408, NULL);
+  }
+}
+
+void LanServer::_handleRequest(Connection &connection, size_t headLength, size_t bodyLength)
+{
+  char *request = connection.request;
+  uint8_t *body = (uint8_t *)request + headLength;
+
+  const char *key;
+  size_t keyLength = findHeader(request, "Sec-WebSocket-Key", &key);
+
+  // Split "<method> <path> HTTP/1.1" in place
+  char *lineEnd = strstr(request, "\r\n");
+  char *path = strchr(request, ' ');
+  char *version = path != NULL ? strchr(path + 1, ' ') : NULL;
+  if (version == NULL || version > lineEnd)
+  {
+    _respond(connection, 400, NULL);
+    return;
+  }
+  *path++ = '\0';
+  *version = '\0';
+
+  char state[160];
+  if (strcmp(request, "GET") == 0 && strcmp(path, "/ws") == 0 && keyLength > 0)
+  {
+    _upgrade(connection, key, keyLength);
+  }
+  else if (strcmp(request, "GET") == 0 && strcmp(path, "/state") == 0)
+  {
+    _formatter(state, sizeof(state));
+    _respond(connection, 200, state);
+  }
+  else if (strcmp(request, "POST") == 0)
+  {
+    // Answered with the state, which already includes the command
+    _handler(path, body, bodyLength);
+    _formatter(state, sizeof(state));
+    _respond(connection, 200, state);
+  }
+  else
+  {
+    _respond(connection, 404, NULL);
+  }
+}
+
+void LanServer::_respond(Connection &connection, int status, const char *body)
+{
+  size_t bodyLength = body != NULL ? strlen(body) : 0;
+  char head[128];
+  int headLength = snprintf_P(head, sizeof(head), PSTR("HTTP/1.1 %d %s\r\nContent-Type: text/plain\r\nContent-Length: %u\r\nConnection: close\r\n\r\n"),
+                              status, statusText(status), bodyLength);
+
+  connection.client.write((const uint8_t *)head, headLength);
+  if (bodyLength > 0)
+  {
+    connection.client.write((const uint8_t *)body, bodyLength);
+  }
+  _close(connection);
+}
+
+void LanServer::_upgrade(Connection &connection, const char *key, size_t keyLength)
+{
+  // The accept key proves the handshake was understood
+  char guid[sizeof(websocketGuid)];
+  strcpy_P(guid, websocketGuid);
+
+  br_sha1_context sha1;
+  uint8_t digest[br_sha1_SIZE];
+  br_sha1_init(&sha1);
+  br_sha1_update(&sha1, key, keyLength);
+  br_sha1_update(&sha1, guid, strlen(guid));
+  br_sha1_out(&sha1, digest);
+
+  char accept[32];
+  encodeBase64(digest, sizeof(digest), accept);
+
+  char response[160];
+  int length = snprintf_P(response, sizeof(response), PSTR("HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n\r\n"), accept);
+  connection.client.write((const uint8_t *)response, length);
+
+  connection.state = LAN_WEBSOCKET;
+  connection.length = 0;
+  _sendState(connection);
+}
+
+void LanServer::_readFrames(Connection &connection)
+{
+  _receive(connection);
+
+  uint8_t *data = (uint8_t *)connection.request;
+  while (connection.length >= 2)
+  {
+    byte opcode = data[0] & 0x0F;
+    size_t payloadLength = data[1] & 0x7F;
+    size_t headerLength = 2;
+    if (payloadLength == 126)
+    {
+      if (connection.length < 4)
+      {
+        return;
+      }
+      payloadLength = data[2] << 8 | data[3];
+      headerLength = 4;
+    }
+
+    // Frames from clients are always masked, and must fit in the buffer
+    size_t frameLength = headerLength + 4 + payloadLength;
+    if (!(data[1] & 0x80) || data[1] == 0xFF || frameLength > LAN_REQUEST_SIZE - 1)
+    {
+      _sendFrame(connection, WS_CLOSE, NULL, 0);
+      _close(connection);
+      return;
+    }
+    if (connection.length < frameLength)
+    {
+      return;
+    }
+
+    const uint8_t *mask = data + headerLength;
+    char *payload = (char *)data + headerLength + 4;
+    for (size_t i = 0; i < payloadLength; i++)
+    {
+      payload[i] ^= mask[i & 3];
+    }
+
+    if (opcode == WS_CLOSE)
+    {
+      _sendFrame(connection, WS_CLOSE, NULL, 0);
+      _close(connection);
+      return;
+    }
+    else if (opcode == WS_PING)
+    {
+      _sendFrame(connection, WS_PONG, payload, payloadLength);
+    }
+    else if (opcode == WS_TEXT)
+    {
+      // "<path> <body>", the path is terminated in place for the handler
+      char *space = (char *)memchr(payload, ' ', payloadLength);
+      size_t pathLength = space != NULL ? space - payload : payloadLength;
+      char next = payload[pathLength];
+      payload[pathLength] = '\0';
+      _handler(payload, (uint8_t *)payload + pathLength + 1, space != NULL ? payloadLength - pathLength - 1 : 0);
+      payload[pathLength] = next;
+    }
+
+    connection.length -= frameLength;
+    memmove(data, data + frameLength, connection.length);
+  }
+}
+
+void LanServer::_sendFrame(Connection &connection, byte opcode, const char *payload, size_t length)
+{
+  uint8_t header[4];
+  size_t headerLength = 2;
+  header[0] = 0x80 | opcode; // Final fragment
+  if (length < 126)
+  {
+    header[1] = length;
+  }
+  else
+  {
+    header[1] = 126;
+    header[2] = length >> 8;
+    header[3] = length & 0xFF;
+    headerLength = 4;
+  }
+
+  connection.client.write(header, headerLength);
+  if (length > 0)
+  {
+    connection.client.write((const uint8_t *)payload, length);
+  }
+}
+
+void LanServer::_sendState(Connection &connection)
+{
+  char state[160];
+  size_t length = _formatter(state, sizeof(state));
+  _sendFrame(connection, WS_TEXT, state, length);
+}
+
+void LanServer::_close(Connection &connection)
+{
+  connection.client.stop();
+  connection.state = LAN_FREE;
+  connection.length = 0;
+}
@@ -0,0 +1,75 @@
+#ifndef LANSERVER_h
+#define LANSERVER_h
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+#define LAN_CONNECTIONS 4
+#define LAN_REQUEST_SIZE 384 // Request line, headers and body, or one WebSocket frame
+#define LAN_TIMEOUT 2000     // Time in ms to send a complete HTTP request
+
+typedef void (*LanCommandHandler)(const char *path, uint8_t *body, size_t length);
+typedef size_t (*LanStateFormatter)(char *buffer, size_t size);
+
+/**
+ * Local HTTP API and WebSocket state stream, so controllers on the same
+ * network do not depend on the broker.
+ *
+ * POST /<path> runs the command that a publish to <base>/<path> would, e.g.
+ * POST /channel3/set with body ON, and answers with the state snapshot.
+ * GET /state returns the snapshot. GET /ws upgrades to a WebSocket that
+ * receives the snapshot on every change, and takes commands as text frames
+ * "<path> <body>", e.g. "/batch 0:ON,3:OFF".
+ *
+ * Connections come from a fixed pool, each with a fixed request buffer, so
+ * handling a request does not allocate. Requests that do not fit are
+ * refused.
+ */
+class LanServer
+{
+public:
+  LanServer(uint16_t port) : _server(port) {}
+
+  void begin(LanCommandHandler handler, LanStateFormatter formatter);
+  void loop();
+
+  /**
+   * Send the current state to every WebSocket client.
+   */
+  void pushState();
+
+private:
+  enum ConnectionState : byte
+  {
+    LAN_FREE,
+    LAN_REQUEST,
+    LAN_WEBSOCKET,
+  };
+
+  struct Connection
+  {
+    WiFiClient client;
+    byte state;
+    uint16_t length;
+    unsigned long since;
+    char request[LAN_REQUEST_SIZE];
+  };
+
+  WiFiServer _server;
+  Connection _connections[LAN_CONNECTIONS];
+  LanCommandHandler _handler;
+  LanStateFormatter _formatter;
+
+  void _accept();
+  bool _receive(Connection &connection);
+  void _readRequest(Connection &connection);
+  void _handleRequest(Connection &connection, size_t headLength, size_t bodyLength);
+  void _respond(Connection &connection, int status, const char *body);
+  void _upgrade(Connection &connection, const char *key, size_t keyLength);
+  void _readFrames(Connection &connection);
+  void _sendFrame(Connection &connection, byte opcode, const char *payload, size_t length);
+  void _sendState(Connection &connection);
+  void _close(Connection &connection);
+};
+
+#endif
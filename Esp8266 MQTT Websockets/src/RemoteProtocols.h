@@ -0,0 +1,203 @@
+#ifndef RemoteProtocols_h
+#define RemoteProtocols_h
+
+#include <Arduino.h>
+#include "NewRemoteTransmitter.h"
+
+/**
+ * Compile time descriptions of the 433MHz protocols the bridge can speak.
+ *
+ * Every protocol provides:
+ * - periodusec	Length of one period in microseconds.
+ * - telegrams	Number of times a telegram is sent per command.
+ * - maxSymbols	Longest symbol list encode() can produce.
+ * - symbol(s)	High and low time of symbol s, in half periods.
+ * - encode()	Fills a symbol list for an address, unit and switch type.
+ *
+ * sendProtocol<P>() turns the description into a timing table once per command and
+ * hands the symbols to NewRemoteTransmitter's engine, so the pulse loop never has
+ * to know which protocol it is playing. The old style protocols follow the
+ * RemoteSwitch library by Randy Simons.
+ */
+
+enum RemoteProtocol {
+	PROTOCOL_KAKU = 0,		// KaKu automatic code (NewRemoteSwitch)
+	PROTOCOL_KAKU_OLD = 1,	// KaKu code wheel, address A..P is 0..15
+	PROTOCOL_ACTION = 2,	// Action / Impuls, DIP switch system code 0..31, unit A..E is 0..4
+	PROTOCOL_ELRO = 3,		// Elro AB440, DIP switch system code 0..31, unit A..E is 0..4
+	PROTOCOL_COUNT
+};
+
+struct ProtocolSymbol {
+	byte high;	// Half periods
+	byte low;	// Half periods
+};
+
+struct KakuProtocol {
+	static constexpr unsigned int periodusec = 260;
+	static constexpr byte telegrams = 16;
+	static constexpr byte maxSymbols = NewRemoteTransmitter::maxPulses;
+
+	static constexpr ProtocolSymbol symbol(byte s) {
+		return s == NewRemoteTransmitter::PULSE_LONG ? ProtocolSymbol{2, 10}
+			: s == NewRemoteTransmitter::PULSE_START ? ProtocolSymbol{2, 21}
+			: s == NewRemoteTransmitter::PULSE_STOP ? ProtocolSymbol{2, 80}
+			: ProtocolSymbol{2, 2};
+	}
+
+	static byte encode(unsigned long address, byte unit, byte switchType, byte dimLevel, byte *symbols) {
+		return NewRemoteTransmitter::encodeTelegram(address, false, switchType, unit, dimLevel, symbols);
+	}
+};
+
+/**
+ * KaKu command for every unit on an address at once.
+ */
+struct KakuGroupProtocol : KakuProtocol {
+	static byte encode(unsigned long address, byte unit, byte switchType, byte dimLevel, byte *symbols) {
+		return NewRemoteTransmitter::encodeTelegram(address, true, switchType, unit, dimLevel, symbols);
+	}
+};
+
+/**
+ * Old style telegram: 12 trits followed by a sync pulse. Trit 0 is short-short,
+ * trit 1 long-long and trit 2 (float) short-long, where short is 1T high 3T low
+ * and long is 3T high 1T low. Layout fills the trits.
+ */
+template <class Layout>
+struct TritProtocol {
+	static constexpr unsigned int periodusec = Layout::periodusec;
+	static constexpr byte telegrams = 8;
+	static constexpr byte maxSymbols = 12 * 2 + 1;
+
+	static constexpr ProtocolSymbol symbol(byte s) {
+		return s == 0 ? ProtocolSymbol{2, 6}	// Short
+			: s == 1 ? ProtocolSymbol{6, 2}	// Long
+			: ProtocolSymbol{2, 62};			// Sync, 32 periods in total
+	}
+
+	static byte encode(unsigned long address, byte unit, byte switchType, byte /* dimLevel */, byte *symbols) {
+		byte trits[12];
+		Layout::trits(address, unit, switchType != NewRemoteTransmitter::SWITCH_OFF, trits);
+
+		byte count = 0;
+		for (byte i = 0; i < 12; i++) {
+			symbols[count++] = trits[i] == 1 ? 1 : 0;
+			symbols[count++] = trits[i] == 0 ? 0 : 1;
+		}
+		symbols[count++] = 2;
+		return count;
+	}
+};
+
+struct KakuOldLayout {
+	static constexpr unsigned int periodusec = 375;
+
+	static void trits(unsigned long address, byte unit, boolean on, byte *trits) {
+		for (byte i = 0; i < 4; i++) {
+			trits[i] = (address >> i) & 1 ? 2 : 0;
+			trits[i + 4] = (unit >> i) & 1 ? 2 : 0;
+		}
+		// Trits 8-10 seem to be fixed
+		trits[8] = 0;
+		trits[9] = 2;
+		trits[10] = 2;
+		trits[11] = on ? 2 : 0;
+	}
+};
+
+struct ActionLayout {
+	static constexpr unsigned int periodusec = 190;
+
+	static void trits(unsigned long address, byte unit, boolean on, byte *trits) {
+		for (byte i = 0; i < 5; i++) {
+			trits[i] = (address >> i) & 1 ? 1 : 2;
+			// Only the trit of the selected unit is 0, the others float
+			trits[i + 5] = i == unit ? 0 : 2;
+		}
+		trits[10] = on ? 2 : 0;
+		trits[11] = on ? 0 : 2;
+	}
+};
+
+struct ElroLayout {
+	static constexpr unsigned int periodusec = 320;
+
+	static void trits(unsigned long address, byte unit, boolean on, byte *trits) {
+		for (byte i = 0; i < 5; i++) {
+			trits[i] = (address >> i) & 1 ? 0 : 2;
+			trits[i + 5] = i == unit ? 0 : 2;
+		}
+		trits[10] = on ? 0 : 2;
+		trits[11] = on ? 2 : 0;
+	}
+};
+
+typedef TritProtocol<KakuOldLayout> KakuOldProtocol;
+typedef TritProtocol<ActionLayout> ActionProtocol;
+typedef TritProtocol<ElroLayout> ElroProtocol;
+
+/**
+ * High and low time in microseconds of the symbols of a protocol. Folded to
+ * constants, the engines only look symbols up in this table.
+ */
+template <class Protocol>
+NewRemoteTransmitter::SymbolTiming protocolTiming() {
+	NewRemoteTransmitter::SymbolTiming symbolTiming;
+	for (byte i = 0; i < 4; i++) {
+		symbolTiming.high[i] = Protocol::symbol(i).high * Protocol::periodusec / 2;
+		symbolTiming.low[i] = Protocol::symbol(i).low * Protocol::periodusec / 2;
+	}
+	return symbolTiming;
+}
+
+template <class Protocol>
+void sendProtocol(NewRemoteTransmitter &transmitter, unsigned long address, byte unit, byte switchType, byte dimLevel) {
+	byte symbols[Protocol::maxSymbols];
+	byte count = Protocol::encode(address, unit, switchType, dimLevel, symbols);
+	transmitter._transmit(symbols, count, protocolTiming<Protocol>(), Protocol::telegrams);
+}
+
+/**
+ * Send a command with the protocol selected at runtime. The protocol is resolved
+ * once per command, not per pulse. Dimming is only supported by PROTOCOL_KAKU,
+ * the other protocols switch on instead.
+ */
+inline void sendRemote(NewRemoteTransmitter &transmitter, byte protocol, unsigned long address, byte unit, byte switchType, byte dimLevel = 0) {
+	switch (protocol) {
+		case PROTOCOL_KAKU_OLD:
+			sendProtocol<KakuOldProtocol>(transmitter, address, unit, switchType, dimLevel);
+			break;
+		case PROTOCOL_ACTION:
+			sendProtocol<ActionProtocol>(transmitter, address, unit, switchType, dimLevel);
+			break;
+		case PROTOCOL_ELRO:
+			sendProtocol<ElroProtocol>(transmitter, address, unit, switchType, dimLevel);
+			break;
+		default:
+			sendProtocol<KakuProtocol>(transmitter, address, unit, switchType, dimLevel);
+			break;
+	}
+}
+
+/**
+ * Number of telegrams sent per command, as sendRemote() and group commands do.
+ */
+inline byte protocolTelegrams(byte protocol, boolean group) {
+	if (group) {
+		return KakuGroupProtocol::telegrams;
+	}
+
+	switch (protocol) {
+		case PROTOCOL_KAKU_OLD:
+			return KakuOldProtocol::telegrams;
+		case PROTOCOL_ACTION:
+			return ActionProtocol::telegrams;
+		case PROTOCOL_ELRO:
+			return ElroProtocol::telegrams;
+		default:
+			return KakuProtocol::telegrams;
+	}
+}
+
+#endif
@@ -0,0 +1,160 @@
+#include "RfDecoder.h"
+
+/*
+ * Bits are shifted in as they arrive: 26 address bits, group, switch and 4
+ * unit bits fill _value from the top, the 4 dim bits go to _dimLevel.
+ */
+#define BITS_SWITCH 27
+#define BITS_CODE 32
+#define BITS_DIM 36
+
+bool RfDecoder::feed(uint16_t duration, RfCode &code)
+{
+  stats.edges++;
+
+  switch (_state)
+  {
+  case STATE_IDLE:
+    if (_isSync(duration))
+    {
+      _start(duration);
+    }
+    return false;
+  case STATE_HIGH:
+    // Nominally one period, receivers tend to stretch it
+    if (duration < _period / 3 || duration > _period * 3)
+    {
+      return _fail(duration);
+    }
+    _state = STATE_LOW;
+    return false;
+  case STATE_LOW:
+    break;
+  }
+
+  Low low = _classify(duration);
+  _state = STATE_HIGH;
+
+  if (low == LOW_STOP && _pulse == 0 && _bits == (_dim ? BITS_DIM : BITS_CODE))
+  {
+    code.address = _value >> 6;
+    code.group = (_value >> 5) & 1;
+    code.switchType = _dim ? 2 : (_value >> 4) & 1;
+    code.unit = _value & 0xF;
+    code.dimLevel = _dim ? _dimLevel : 0;
+    code.period = _period;
+
+    stats.codes++;
+    _state = STATE_IDLE;
+    return true;
+  }
+
+  if (low == LOW_STOP || low == LOW_INVALID)
+  {
+    return _fail(duration);
+  }
+
+  if (_pulse == 0)
+  {
+    _first = low;
+    _pulse = 1;
+    return false;
+  }
+
+  _pulse = 0;
+  if (!_bit((Low)_first, low))
+  {
+    return _fail(duration);
+  }
+  return false;
+}
+
+bool RfDecoder::_isSync(uint16_t duration) const
+{
+  return duration >= DECODER_SYNC_MIN && duration <= DECODER_SYNC_MAX;
+}
+
+RfDecoder::Low RfDecoder::_classify(uint16_t duration) const
+{
+  uint32_t period = _period;
+  if (duration < period / 3)
+  {
+    return LOW_INVALID;
+  }
+  if (duration < period * 3)
+  {
+    return LOW_SHORT; // 1 period
+  }
+  if (duration < period * 8)
+  {
+    return LOW_LONG; // 5 periods
+  }
+  if (duration > period * 20)
+  {
+    return LOW_STOP; // 40 periods
+  }
+  return LOW_INVALID;
+}
+
+void RfDecoder::_start(uint16_t duration)
+{
+  stats.syncs++;
+  _state = STATE_HIGH;
+  _period = (uint32_t)duration * 2 / 21;
+  _bits = 0;
+  _pulse = 0;
+  _dim = false;
+  _value = 0;
+  _dimLevel = 0;
+}
+
+bool RfDecoder::_fail(uint16_t duration)
+{
+  stats.errors++;
+  _state = STATE_IDLE;
+
+  // The duration that broke this telegram may start the next one
+  if (_isSync(duration))
+  {
+    _start(duration);
+  }
+  return false;
+}
+
+bool RfDecoder::_bit(Low first, Low second)
+{
+  if (first == LOW_SHORT && second == LOW_SHORT)
+  {
+    // Two short lows replace the switch bit in a dim telegram
+    if (_bits != BITS_SWITCH)
+    {
+      return false;
+    }
+    _dim = true;
+    _value <<= 1;
+    _bits++;
+    return true;
+  }
+
+  if (first == second)
+  {
+    return false;
+  }
+
+  // A '0' is short-long, a '1' is long-short
+  bool one = first == LOW_LONG;
+  if (_bits < BITS_CODE)
+  {
+    _value = _value << 1 | one;
+  }
+  else if (_dim && _bits < BITS_DIM)
+  {
+    _dimLevel = _dimLevel << 1 | one;
+  }
+  else
+  {
+    return false;
+  }
+  _bits++;
+  return true;
+}
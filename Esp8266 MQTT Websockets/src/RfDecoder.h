@@ -0,0 +1,83 @@
+#ifndef RFDECODER_h
+#define RFDECODER_h
+
+#include <stdint.h>
+
+// Accepted length of the gap after the start pulse, 10.5 periods of 170..380 us
+#define DECODER_SYNC_MIN 1800
+#define DECODER_SYNC_MAX 4000
+
+struct RfCode
+{
+  uint32_t address;
+  uint8_t unit;
+  uint8_t switchType; // NewRemoteTransmitter::SwitchType
+  uint8_t dimLevel;   // Only valid for SWITCH_DIM
+  bool group;
+  uint16_t period;    // Measured period in microseconds
+};
+
+struct RfDecoderStats
+{
+  uint32_t edges;  // Durations fed
+  uint32_t syncs;  // Start gaps seen
+  uint32_t codes;  // Complete telegrams
+  uint32_t errors; // Telegrams abandoned after the start gap
+};
+
+/**
+ * Decodes KaKu automatic code telegrams from the time between successive
+ * edges of a 433MHz receiver, in microseconds. Levels are not needed: the
+ * decoder locks onto the long gap after the start pulse and from there every
+ * other duration is a high pulse. The period is taken from that gap, so
+ * remotes that run a bit fast or slow are still understood.
+ *
+ * The decoder has no Arduino dependencies, so recorded edge traces can be
+ * replayed on any machine.
+ */
+class RfDecoder
+{
+public:
+  /**
+   * Feed the duration of one level. Returns true and fills code when it
+   * completes a telegram.
+   */
+  bool feed(uint16_t duration, RfCode &code);
+
+  void reset() { _state = STATE_IDLE; }
+
+  RfDecoderStats stats = {};
+
+private:
+  enum State
+  {
+    STATE_IDLE,
+    STATE_HIGH, // Expecting the high part of a pulse
+    STATE_LOW,  // Expecting the low part of a pulse
+  };
+
+  enum Low
+  {
+    LOW_SHORT,
+    LOW_LONG,
+    LOW_STOP,
+    LOW_INVALID,
+  };
+
+  State _state = STATE_IDLE;
+  uint16_t _period;
+  uint8_t _bits;     // Bits received after the start gap
+  uint8_t _pulse;    // 0 or 1, the half of the current bit
+  uint8_t _first;    // Low of the first half
+  bool _dim;         // The switch bit was the dim marker
+  uint32_t _value;   // Address, group, switch and unit bits
+  uint8_t _dimLevel;
+
+  bool _isSync(uint16_t duration) const;
+  Low _classify(uint16_t duration) const;
+  void _start(uint16_t duration);
+  bool _fail(uint16_t duration);
+  bool _bit(Low first, Low second);
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "RfReceiver.h"
+
+#ifdef ESP8266
+#define RECEIVE_ATTR ICACHE_RAM_ATTR
+#else
+#define RECEIVE_ATTR
+#endif
+
+/*
+ * The interrupt only writes rxEdges and rxHead, loop() only writes rxTail.
+ * rxHead is updated after the slot has been written, so the reader never
+ * sees a slot that is still being filled.
+ */
+static volatile uint16_t rxEdges[RF_RX_BUFFER];
+static volatile uint16_t rxHead = 0;
+static volatile uint16_t rxTail = 0;
+static volatile uint32_t rxMissed = 0;
+static volatile uint32_t rxLastEdge = 0;
+static volatile bool rxEnabled = false;
+
+static void RECEIVE_ATTR handleEdge()
+{
+  uint32_t now = micros();
+  uint32_t duration = now - rxLastEdge;
+  rxLastEdge = now;
+
+  if (!rxEnabled)
+  {
+    return;
+  }
+
+  uint16_t head = rxHead;
+  uint16_t next = (head + 1) & (RF_RX_BUFFER - 1);
+  if (next == rxTail)
+  {
+    rxMissed++;
+    return;
+  }
+
+  rxEdges[head] = duration > 0xFFFF ? 0xFFFF : duration;
+  rxHead = next;
+}
+
+void RfReceiver::begin(uint8_t pin)
+{
+  pinMode(pin, INPUT);
+  rxEnabled = true;
+  attachInterrupt(digitalPinToInterrupt(pin), handleEdge, CHANGE);
+}
+
+void RfReceiver::disable()
+{
+  rxEnabled = false;
+}
+
+void RfReceiver::enable()
+{
+  if (rxEnabled)
+  {
+    return;
+  }
+
+  // Drop what arrived before, the telegram in progress is incomplete
+  rxTail = rxHead;
+  decoder.reset();
+  rxEnabled = true;
+}
+
+bool RfReceiver::read(RfCode &code)
+{
+  stats.missed = rxMissed;
+
+  uint32_t start = micros();
+  bool found = false;
+  while (!found && rxTail != rxHead)
+  {
+    uint16_t tail = rxTail;
+    uint16_t duration = rxEdges[tail];
+    rxTail = (tail + 1) & (RF_RX_BUFFER - 1);
+
+    if (!decoder.feed(duration, code))
+    {
+      continue;
+    }
+
+    // Remotes send every telegram several times and repeat while held
+    bool same = code.address == _last.address && code.unit == _last.unit && code.group == _last.group &&
+                code.switchType == _last.switchType && code.dimLevel == _last.dimLevel;
+    bool repeat = same && millis() - _lastAt < RF_RX_REPEAT_MS;
+    _last = code;
+    _lastAt = millis();
+
+    if (repeat)
+    {
+      stats.repeats++;
+    }
+    else
+    {
+      found = true;
+    }
+  }
+  stats.decodeMicros += micros() - start;
+  return found;
+}
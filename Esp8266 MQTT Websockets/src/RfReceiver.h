@@ -0,0 +1,49 @@
+#ifndef RFRECEIVER_h
+#define RFRECEIVER_h
+
+#include <Arduino.h>
+#include "RfDecoder.h"
+
+#define RF_RX_BUFFER 256    // Edges buffered between two loops, must be a power of two
+#define RF_RX_REPEAT_MS 500 // The same code within this time is a repeat of the same press
+
+struct RfReceiverStats
+{
+  uint32_t missed;      // Edges lost because the buffer was full
+  uint32_t repeats;     // Codes suppressed as repeats
+  uint32_t decodeMicros; // Time spent in the decoder
+};
+
+/**
+ * Receives KaKu telegrams from a 433MHz receiver module. The pin interrupt
+ * only stores the time since the previous edge in a single producer, single
+ * consumer ring buffer; read() decodes from loop().
+ *
+ * There is one receiver per sketch, the interrupt cannot be given an object.
+ */
+class RfReceiver
+{
+public:
+  void begin(uint8_t pin);
+
+  /**
+   * Ignore edges, e.g. while the bridge is transmitting itself.
+   */
+  void disable();
+  void enable();
+
+  /**
+   * Decode buffered edges. Returns true with the next new code, false when
+   * the buffer has been drained.
+   */
+  bool read(RfCode &code);
+
+  RfDecoder decoder;
+  RfReceiverStats stats = {};
+
+private:
+  RfCode _last = {};
+  uint32_t _lastAt = 0;
+};
+
+#endif
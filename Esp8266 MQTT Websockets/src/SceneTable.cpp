@@ -0,0 +1,353 @@
+#include "SceneTable.h"
+#include <LittleFS.h>
+
+bool ScenePlan::add(const SceneFrame &frame)
+{
+  if (_count == MAX_CHANNELS && _position > 0)
+  {
+    // Move the frames that are still waiting to the front
+    memmove(_frames, _frames + _position, (_count - _position) * sizeof(SceneFrame));
+    _count -= _position;
+    _position = 0;
+  }
+  if (_count == MAX_CHANNELS)
+  {
+    return false;
+  }
+
+  _frames[_count++] = frame;
+  return true;
+}
+
+bool ScenePlan::pop(SceneFrame &frame)
+{
+  if (_position == _count)
+  {
+    _count = _position = 0;
+    return false;
+  }
+
+  frame = _frames[_position++];
+  return true;
+}
+
+void SceneTable::load()
+{
+  File file = LittleFS.open("scenes", "r");
+  if (!file)
+  {
+    return;
+  }
+
+  char line[640]; // 64 channels at dim15
+  while (file.available())
+  {
+    size_t length = file.readBytesUntil('\n', line, sizeof(line) - 1);
+    line[length] = '\0';
+    define(line);
+  }
+  file.close();
+}
+
+void SceneTable::save()
+{
+  File file = LittleFS.open("scenes", "w");
+  if (!file)
+  {
+    Serial.println("Failed to open file for writing");
+    return;
+  }
+
+  for (byte i = 0; i < MAX_SCENES; i++)
+  {
+    if (_scenes[i].name[0] != '\0')
+    {
+      file.println(describe(i));
+    }
+  }
+  file.close();
+}
+
+int SceneTable::define(const char *text, byte channelBase)
+{
+  Scene scene = {};
+  int consumed = 0;
+  if (sscanf(text, " %15s%n", scene.name, &consumed) != 1)
+  {
+    return -1;
+  }
+  text += consumed;
+
+  // Names end up in keyboards and JSON, keep them to a plain word
+  for (const char *c = scene.name; *c != '\0'; c++)
+  {
+    if (!isalnum(*c) && *c != '-' && *c != '_')
+    {
+      return -1;
+    }
+  }
+
+  // Parse "<channel>=<level>" pairs
+  bool empty = true;
+  while (true)
+  {
+    unsigned int channel;
+    char level[8];
+    consumed = 0;
+    if (sscanf(text, " %u=%7s%n", &channel, level, &consumed) != 2)
+    {
+      break;
+    }
+    text += consumed;
+
+    if (channel < channelBase || channel - channelBase >= MAX_CHANNELS)
+    {
+      return -1;
+    }
+
+    unsigned int dimLevel;
+    byte &target = scene.levels[channel - channelBase];
+    if (strcasecmp(level, "on") == 0)
+    {
+      target = SCENE_ON;
+    }
+    else if (strcasecmp(level, "off") == 0)
+    {
+      target = SCENE_OFF;
+    }
+    else if (sscanf(level, "dim%u", &dimLevel) == 1 && dimLevel <= 15)
+    {
+      target = SCENE_DIM + dimLevel;
+    }
+    else
+    {
+      return -1;
+    }
+    empty = false;
+  }
+
+  while (*text == ' ' || *text == '\r')
+  {
+    text++;
+  }
+  if (empty || *text != '\0')
+  {
+    return -1;
+  }
+
+  int index = find(scene.name);
+  for (byte i = 0; index < 0 && i < MAX_SCENES; i++)
+  {
+    if (_scenes[i].name[0] == '\0')
+    {
+      index = i;
+    }
+  }
+
+  if (index >= 0)
+  {
+    _scenes[index] = scene;
+  }
+  return index;
+}
+
+bool SceneTable::remove(const char *name)
+{
+  int index = find(name);
+  if (index < 0)
+  {
+    return false;
+  }
+
+  _scenes[index].name[0] = '\0';
+  return true;
+}
+
+int SceneTable::find(const char *name) const
+{
+  for (byte i = 0; i < MAX_SCENES; i++)
+  {
+    if (_scenes[i].name[0] != '\0' && strcasecmp(_scenes[i].name, name) == 0)
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+String SceneTable::describe(byte index, byte channelBase) const
+{
+  const Scene &scene = _scenes[index];
+  String result = scene.name;
+  for (byte i = 0; i < MAX_CHANNELS; i++)
+  {
+    byte level = scene.levels[i];
+    if (level == SCENE_NONE)
+    {
+      continue;
+    }
+
+    result += ' ';
+    result += i + channelBase;
+    if (level == SCENE_ON)
+    {
+      result += "=on";
+    }
+    else if (level == SCENE_OFF)
+    {
+      result += "=off";
+    }
+    else
+    {
+      result += "=dim";
+      result += level - SCENE_DIM;
+    }
+  }
+  return result;
+}
+
+static bool addFrame(ScenePlan &plan, const ChannelTarget &target, bool group, byte level, byte source)
+{
+  SceneFrame frame = {};
+  frame.source = source;
+  frame.protocol = target.protocol;
+  frame.group = group;
+  frame.unit = target.unit;
+  frame.address = target.address;
+  if (level >= SCENE_DIM)
+  {
+    frame.switchType = NewRemoteTransmitter::SWITCH_DIM;
+    frame.dimLevel = level - SCENE_DIM;
+  }
+  else
+  {
+    frame.switchType = level == SCENE_ON ? NewRemoteTransmitter::SWITCH_ON : NewRemoteTransmitter::SWITCH_OFF;
+  }
+  return plan.add(frame);
+}
+
+#define KAKU_ALL_UNITS 0xFFFF // Units 0..15, all receivers a group frame reaches
+
+bool SceneTable::plan(const Scene &scene, const ChannelTable &channels, byte activeChannels, uint64_t known, uint64_t state, ScenePlan &plan, byte source)
+{
+  bool fits = true;
+  byte waiting = plan.size();
+  uint64_t done = 0;
+  for (byte channel = 0; channel < activeChannels; channel++)
+  {
+    byte level = scene.levels[channel];
+    uint64_t mask = 1ULL << channel;
+    if (level == SCENE_NONE || (done & mask))
+    {
+      continue;
+    }
+
+    // The channels sharing an address, the unit of a group command
+    uint64_t members = mask;
+    const ChannelTarget &target = channels[channel];
+    if (target.protocol == PROTOCOL_KAKU)
+    {
+      for (byte i = channel + 1; i < activeChannels; i++)
+      {
+        if (channels[i].protocol == PROTOCOL_KAKU && channels[i].address == target.address)
+        {
+          members |= 1ULL << i;
+        }
+      }
+    }
+    done |= members;
+
+    // Count the frames needed per unit, and the most common level for a group frame
+    byte counts[SCENE_DIM + 16] = {};
+    byte common = SCENE_NONE;
+    byte unitFrames = 0;
+    byte memberCount = 0;
+    uint16_t units = 0; // Units of the address that are set by the scene
+    for (byte i = channel; i < activeChannels; i++)
+    {
+      uint64_t bit = 1ULL << i;
+      byte memberLevel = scene.levels[i];
+      if (!(members & bit) || memberLevel == SCENE_NONE)
+      {
+        continue;
+      }
+      memberCount++;
+      units |= 1 << channels[i].unit;
+
+      // A dim level is never known, on and off are skipped when already set
+      bool on = memberLevel != SCENE_OFF;
+      if (memberLevel >= SCENE_DIM || !(known & bit) || ((state & bit) != 0) != on)
+      {
+        unitFrames++;
+      }
+
+      counts[memberLevel]++;
+      if (common == SCENE_NONE || counts[memberLevel] > counts[common])
+      {
+        common = memberLevel;
+      }
+    }
+
+    // A group frame reaches every receiver on the address, so all 16 units
+    // must be in the scene. Corrections after it must not flash a receiver
+    // on or off: either all units get the same level or none is switched off.
+    byte groupFrames = 0xFF;
+    bool sameLevel = counts[common] == memberCount;
+    if (units == KAKU_ALL_UNITS && (sameLevel || counts[SCENE_OFF] == 0))
+    {
+      groupFrames = 1;
+      for (byte i = channel; i < activeChannels; i++)
+      {
+        if ((members & (1ULL << i)) && scene.levels[i] != common)
+        {
+          groupFrames++;
+        }
+      }
+    }
+
+    if (groupFrames < unitFrames)
+    {
+      // Group first, then correct the channels that differ
+      fits &= addFrame(plan, target, true, common, source);
+      for (byte i = channel; i < activeChannels; i++)
+      {
+        if ((members & (1ULL << i)) && scene.levels[i] != common)
+        {
+          fits &= addFrame(plan, channels[i], false, scene.levels[i], source);
+        }
+      }
+      continue;
+    }
+
+    for (byte i = channel; i < activeChannels; i++)
+    {
+      uint64_t bit = 1ULL << i;
+      byte memberLevel = scene.levels[i];
+      bool on = memberLevel != SCENE_OFF;
+      if ((members & bit) && memberLevel != SCENE_NONE &&
+          (memberLevel >= SCENE_DIM || !(known & bit) || ((state & bit) != 0) != on))
+      {
+        fits &= addFrame(plan, channels[i], false, memberLevel, source);
+      }
+    }
+  }
+
+  // All or nothing, the caller only updates the state of a planned scene
+  if (!fits)
+  {
+    plan.truncate(waiting);
+  }
+  return fits;
+}
+
+void sendSceneFrame(NewRemoteTransmitter &transmitter, const SceneFrame &frame)
+{
+  if (frame.group)
+  {
+    sendProtocol<KakuGroupProtocol>(transmitter, frame.address, 0, frame.switchType, frame.dimLevel);
+  }
+  else
+  {
+    sendRemote(transmitter, frame.protocol, frame.address, frame.unit, frame.switchType, frame.dimLevel);
+  }
+}
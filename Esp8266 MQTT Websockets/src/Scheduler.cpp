@@ -0,0 +1,347 @@
+#include "Scheduler.h"
+#include "ChannelTable.h"
+#include <LittleFS.h>
+#include <math.h>
+
+static const char dayLetters[] = "mtwtfss";
+
+// Days since 1970-01-01 of a date in the proleptic Gregorian calendar
+static long daysFromCivil(int year, int month, int day)
+{
+  year -= month <= 2;
+  long era = (year >= 0 ? year : year - 399) / 400;
+  long yearOfEra = year - era * 400;
+  long dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  long dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + dayOfEra - 719468;
+}
+
+void Scheduler::begin(ScheduleAction action)
+{
+  _action = action;
+  _planned = false;
+  _caughtUp = false;
+  _next = 0;
+  _latitude = 52.37; // Amsterdam
+  _longitude = 4.90;
+  memset(_entries, 0, sizeof(_entries));
+}
+
+void Scheduler::load()
+{
+  File file = LittleFS.open("schedules", "r");
+  if (!file)
+  {
+    return;
+  }
+
+  char line[48];
+  while (file.available())
+  {
+    size_t length = file.readBytesUntil('\n', line, sizeof(line) - 1);
+    line[length] = '\0';
+
+    float latitude, longitude;
+    if (sscanf(line, "location %f %f", &latitude, &longitude) == 2)
+    {
+      setLocation(latitude, longitude);
+    }
+    else if (length > 0)
+    {
+      add(line);
+    }
+  }
+  file.close();
+}
+
+void Scheduler::save()
+{
+  File file = LittleFS.open("schedules", "w");
+  if (!file)
+  {
+    Serial.println("Failed to open file for writing");
+    return;
+  }
+
+  file.print("location ");
+  file.print(_latitude, 4);
+  file.print(' ');
+  file.println(_longitude, 4);
+
+  for (byte i = 0; i < MAX_SCHEDULES; i++)
+  {
+    if (_entries[i].days != 0)
+    {
+      file.println(describe(i));
+    }
+  }
+  file.close();
+}
+
+void Scheduler::setLocation(float latitude, float longitude)
+{
+  _latitude = latitude;
+  _longitude = longitude;
+  _planned = false;
+}
+
+int Scheduler::add(const char *text, byte channelBase)
+{
+  char days[8];
+  char when[16];
+  unsigned int channel;
+  char action[4];
+
+  if (sscanf(text, " %7s %15s %u %3s", days, when, &channel, action) != 4)
+  {
+    return -1;
+  }
+
+  ScheduleEntry entry = {};
+  if (strcasecmp(days, "daily") == 0)
+  {
+    entry.days = 0x7F;
+  }
+  else if (strlen(days) == 7)
+  {
+    for (byte i = 0; i < 7; i++)
+    {
+      if (days[i] != '-')
+      {
+        entry.days |= 1 << i;
+      }
+    }
+  }
+
+  unsigned int hours, minutes;
+  int offset = 0;
+  char extra;
+  if (sscanf(when, "%u:%u%c", &hours, &minutes, &extra) == 2 && hours < 24 && minutes < 60)
+  {
+    entry.base = SCHEDULE_TIME;
+    entry.minutes = hours * 60 + minutes;
+  }
+  else if (strncasecmp(when, "sunrise", 7) == 0 && (when[7] == '\0' || sscanf(when + 7, "%d%c", &offset, &extra) == 1))
+  {
+    entry.base = SCHEDULE_SUNRISE;
+  }
+  else if (strncasecmp(when, "sunset", 6) == 0 && (when[6] == '\0' || sscanf(when + 6, "%d%c", &offset, &extra) == 1))
+  {
+    entry.base = SCHEDULE_SUNSET;
+  }
+  else
+  {
+    return -1;
+  }
+
+  if (entry.base != SCHEDULE_TIME)
+  {
+    if (offset < -720 || offset > 720)
+    {
+      return -1;
+    }
+    entry.minutes = offset;
+  }
+
+  if (strcasecmp(action, "on") == 0)
+  {
+    entry.switchOn = true;
+  }
+  else if (strcasecmp(action, "off") != 0)
+  {
+    return -1;
+  }
+
+  if (entry.days == 0 || channel < channelBase || channel - channelBase >= MAX_CHANNELS)
+  {
+    return -1;
+  }
+  entry.channel = channel - channelBase;
+
+  for (byte i = 0; i < MAX_SCHEDULES; i++)
+  {
+    if (_entries[i].days == 0)
+    {
+      _entries[i] = entry;
+      _planned = false;
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool Scheduler::remove(byte index)
+{
+  if (index >= MAX_SCHEDULES || _entries[index].days == 0)
+  {
+    return false;
+  }
+
+  _entries[index].days = 0;
+  _planned = false;
+  return true;
+}
+
+String Scheduler::describe(byte index, byte channelBase) const
+{
+  String result;
+  if (index >= MAX_SCHEDULES || _entries[index].days == 0)
+  {
+    return result;
+  }
+
+  const ScheduleEntry &entry = _entries[index];
+  char text[40];
+  char days[8];
+  for (byte i = 0; i < 7; i++)
+  {
+    days[i] = entry.days & (1 << i) ? dayLetters[i] : '-';
+  }
+  days[7] = '\0';
+
+  const char *action = entry.switchOn ? "on" : "off";
+  unsigned int channel = entry.channel + channelBase;
+  if (entry.base == SCHEDULE_TIME)
+  {
+    snprintf(text, sizeof(text), "%s %02d:%02d %u %s", days, entry.minutes / 60, entry.minutes % 60, channel, action);
+  }
+  else if (entry.minutes != 0)
+  {
+    const char *base = entry.base == SCHEDULE_SUNRISE ? "sunrise" : "sunset";
+    snprintf(text, sizeof(text), "%s %s%+d %u %s", days, base, entry.minutes, channel, action);
+  }
+  else
+  {
+    const char *base = entry.base == SCHEDULE_SUNRISE ? "sunrise" : "sunset";
+    snprintf(text, sizeof(text), "%s %s %u %s", days, base, channel, action);
+  }
+  result = text;
+  return result;
+}
+
+void Scheduler::poll(time_t now)
+{
+  if (now < SCHEDULE_VALID_TIME)
+  {
+    return;
+  }
+
+  if (!_planned || now < _plannedAt)
+  {
+    // Only the first plan after boot fires deadlines missed during the
+    // restart, a changed table is planned from now
+    _plan(_caughtUp ? now : now - SCHEDULE_CATCHUP);
+    _caughtUp = true;
+  }
+
+  if (_next == 0 || now < _next)
+  {
+    return;
+  }
+
+  for (byte i = 0; i < MAX_SCHEDULES; i++)
+  {
+    if (_entries[i].days != 0 && _due[i] != 0 && _due[i] <= now)
+    {
+      _action(_entries[i].channel, _entries[i].switchOn);
+      _due[i] = deadline(_entries[i], now);
+    }
+  }
+  _plannedAt = now;
+  _updateNext();
+}
+
+int Scheduler::sunEvent(int dayOfYear, float latitude, float longitude, bool sunrise)
+{
+  // NOAA approximation, see https://gml.noaa.gov/grad/solcalc/solareqns.PDF
+  float gamma = 2 * M_PI / 365 * (dayOfYear - 1);
+  float equationOfTime = 229.18 * (0.000075 + 0.001868 * cos(gamma) - 0.032077 * sin(gamma) -
+                                   0.014615 * cos(2 * gamma) - 0.040849 * sin(2 * gamma));
+  float declination = 0.006918 - 0.399912 * cos(gamma) + 0.070257 * sin(gamma) - 0.006758 * cos(2 * gamma) +
+                      0.000907 * sin(2 * gamma) - 0.002697 * cos(3 * gamma) + 0.00148 * sin(3 * gamma);
+
+  // 90.833 degrees allows for refraction and the size of the sun
+  float phi = latitude * M_PI / 180;
+  float cosHourAngle = cos(90.833 * M_PI / 180) / (cos(phi) * cos(declination)) - tan(phi) * tan(declination);
+  if (cosHourAngle < -1 || cosHourAngle > 1)
+  {
+    return -1;
+  }
+
+  float hourAngle = acos(cosHourAngle) * 180 / M_PI;
+  float minutes = 720 - 4 * (longitude + (sunrise ? hourAngle : -hourAngle)) - equationOfTime;
+  return (int)lroundf(minutes);
+}
+
+time_t Scheduler::deadline(const ScheduleEntry &entry, time_t after) const
+{
+  struct tm today;
+  localtime_r(&after, &today);
+
+  // A week ahead is enough for any day mask; sun events may be missing near the poles
+  for (int offset = 0; offset <= 7; offset++)
+  {
+    struct tm day = {};
+    day.tm_year = today.tm_year;
+    day.tm_mon = today.tm_mon;
+    day.tm_mday = today.tm_mday + offset;
+    day.tm_hour = 12;
+    day.tm_isdst = -1;
+    mktime(&day); // Normalizes the date and fills in the weekday
+
+    int weekday = (day.tm_wday + 6) % 7; // Monday is 0
+    if (!(entry.days & (1 << weekday)))
+    {
+      continue;
+    }
+
+    time_t at;
+    if (entry.base == SCHEDULE_TIME)
+    {
+      // Through mktime, so daylight saving changes are honoured
+      day.tm_hour = entry.minutes / 60;
+      day.tm_min = entry.minutes % 60;
+      day.tm_sec = 0;
+      day.tm_isdst = -1;
+      at = mktime(&day);
+    }
+    else
+    {
+      int sun = sunEvent(day.tm_yday + 1, _latitude, _longitude, entry.base == SCHEDULE_SUNRISE);
+      if (sun < 0)
+      {
+        continue;
+      }
+      at = (time_t)daysFromCivil(day.tm_year + 1900, day.tm_mon + 1, day.tm_mday) * 86400 + (sun + entry.minutes) * 60;
+    }
+
+    if (at > after)
+    {
+      return at;
+    }
+  }
+  return 0;
+}
+
+void Scheduler::_plan(time_t after)
+{
+  for (byte i = 0; i < MAX_SCHEDULES; i++)
+  {
+    _due[i] = _entries[i].days != 0 ? deadline(_entries[i], after) : 0;
+  }
+  _planned = true;
+  _plannedAt = after;
+  _updateNext();
+}
+
+void Scheduler::_updateNext()
+{
+  _next = 0;
+  for (byte i = 0; i < MAX_SCHEDULES; i++)
+  {
+    if (_entries[i].days != 0 && _due[i] != 0 && (_next == 0 || _due[i] < _next))
+    {
+      _next = _due[i];
+    }
+  }
+}
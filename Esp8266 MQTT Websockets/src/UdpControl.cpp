@@ -0,0 +1,258 @@
+#include "UdpControl.h"
+#include <LittleFS.h>
+
+static uint32_t readSequence(const uint8_t *packet)
+{
+  return (uint32_t)packet[8] | (uint32_t)packet[9] << 8 | (uint32_t)packet[10] << 16 | (uint32_t)packet[11] << 24;
+}
+
+void UdpControl::begin(uint16_t port, uint32_t deviceId, byte channels, UdpCommandHandler handler)
+{
+  _port = port;
+  _deviceId = deviceId;
+  _channels = channels;
+  _handler = handler;
+  _loadPanels();
+
+  _udp.begin(port);
+  _announcedAt = millis() - UDP_ANNOUNCE_INTERVAL; // Announce right away
+}
+
+void UdpControl::setKey(const char *key, size_t length)
+{
+  // The key schedule is done once, not for every datagram
+  br_hmac_key_init(&_key, &br_sha256_vtable, key, length);
+  _hasKey = length > 0;
+}
+
+void UdpControl::forgetPanels()
+{
+  // Sequence numbers signed with the old key cannot be replayed any more
+  _panelCount = 0;
+  LittleFS.remove("udpPanels");
+}
+
+void UdpControl::loop()
+{
+  if (millis() - _announcedAt >= UDP_ANNOUNCE_INTERVAL)
+  {
+    _announcedAt = millis();
+    announce(IPAddress(255, 255, 255, 255), _port);
+  }
+
+  int size = _udp.parsePacket();
+  if (size == 0)
+  {
+    return;
+  }
+
+  uint8_t packet[UDP_PACKET_SIZE];
+  if (size != UDP_PACKET_SIZE || _udp.read(packet, sizeof(packet)) != UDP_PACKET_SIZE || packet[0] != UDP_MAGIC)
+  {
+    stats.rejected++;
+    return;
+  }
+
+  switch (packet[1])
+  {
+  case UDP_COMMAND:
+    _handleCommand(packet);
+    break;
+  case UDP_DISCOVER:
+    announce(_udp.remoteIP(), _udp.remotePort());
+    break;
+  case UDP_ANNOUNCE:
+    break; // Another bridge, or our own broadcast
+  default:
+    stats.rejected++;
+  }
+}
+
+void UdpControl::announce(IPAddress address, uint16_t port)
+{
+  uint8_t packet[UDP_PACKET_SIZE] = {UDP_MAGIC, UDP_ANNOUNCE, _channels};
+  packet[8] = _deviceId;
+  packet[9] = _deviceId >> 8;
+  packet[10] = _deviceId >> 16;
+  packet[11] = _deviceId >> 24;
+
+  // Signed, so panels that have the key can tell a real bridge
+  if (_hasKey)
+  {
+    _sign(packet);
+  }
+  _send(packet, address, port);
+}
+
+void UdpControl::_handleCommand(uint8_t *packet)
+{
+  uint32_t start = micros();
+  if (!_hasKey || !_verify(packet))
+  {
+    stats.rejected++;
+    return;
+  }
+
+  byte channel = packet[2];
+  byte action = packet[3];
+  byte level = packet[4];
+  if (channel >= _channels || action > UDP_DIM || level > 15)
+  {
+    stats.rejected++;
+    return;
+  }
+
+  bool known;
+  uint32_t sequence = readSequence(packet);
+  Panel *panel = _panel((uint16_t)packet[6] | (uint16_t)packet[7] << 8, known);
+  if (panel == nullptr)
+  {
+    stats.rejected++;
+    return;
+  }
+  if (known && sequence < panel->sequence)
+  {
+    stats.replayed++;
+    return;
+  }
+
+  bool accepted = !known || sequence != panel->sequence;
+  bool save = false;
+  if (accepted)
+  {
+    panel->sequence = sequence;
+    if (!known || sequence >= panel->reserved)
+    {
+      panel->reserved = sequence > UINT32_MAX - UDP_SEQUENCE_RESERVE ? UINT32_MAX : sequence + UDP_SEQUENCE_RESERVE;
+      save = true;
+    }
+    _handler(channel, action, level);
+
+    stats.received++;
+    uint32_t elapsed = micros() - start;
+    stats.queueMicrosTotal += elapsed;
+    if (elapsed > stats.queueMicrosMax)
+    {
+      stats.queueMicrosMax = elapsed;
+    }
+  }
+  else
+  {
+    // Resent because the acknowledgement was lost, do not transmit again
+    stats.replayed++;
+  }
+
+  if (packet[5] & UDP_FLAG_ACK)
+  {
+    packet[1] = UDP_ACK;
+    _sign(packet);
+    _send(packet, _udp.remoteIP(), _udp.remotePort());
+  }
+
+  // After the acknowledgement, writing the flash takes a few milliseconds
+  if (save)
+  {
+    _savePanels();
+  }
+}
+
+UdpControl::Panel *UdpControl::_panel(uint16_t id, bool &known)
+{
+  for (byte i = 0; i < _panelCount; i++)
+  {
+    if (_panels[i].id == id)
+    {
+      known = true;
+      return &_panels[i];
+    }
+  }
+
+  // No eviction, a forgotten panel could be replayed
+  known = false;
+  if (_panelCount == UDP_PANELS)
+  {
+    return nullptr;
+  }
+  Panel &panel = _panels[_panelCount++];
+  panel.id = id;
+  panel.sequence = 0;
+  panel.reserved = 0;
+  return &panel;
+}
+
+void UdpControl::_loadPanels()
+{
+  _panelCount = 0;
+  File file = LittleFS.open("udpPanels", "r");
+  if (!file)
+  {
+    return;
+  }
+
+  char line[24];
+  while (file.available() && _panelCount < UDP_PANELS)
+  {
+    size_t length = file.readBytesUntil('\n', line, sizeof(line) - 1);
+    line[length] = '\0';
+
+    unsigned int id;
+    unsigned long reserved;
+    if (sscanf(line, "%u %lu", &id, &reserved) == 2)
+    {
+      // Commands up to the mark may have been carried out before the restart
+      _panels[_panelCount].id = id;
+      _panels[_panelCount].sequence = reserved;
+      _panels[_panelCount].reserved = reserved;
+      _panelCount++;
+    }
+  }
+  file.close();
+}
+
+void UdpControl::_savePanels()
+{
+  File file = LittleFS.open("udpPanels", "w");
+  if (!file)
+  {
+    Serial.println("Failed to open file for writing");
+    return;
+  }
+
+  for (byte i = 0; i < _panelCount; i++)
+  {
+    file.printf("%u %lu\n", _panels[i].id, (unsigned long)_panels[i].reserved);
+  }
+  file.close();
+}
+
+void UdpControl::_sign(uint8_t *packet)
+{
+  br_hmac_context hmac;
+  br_hmac_init(&hmac, &_key, UDP_TAG_SIZE);
+  br_hmac_update(&hmac, packet, UDP_SIGNED_SIZE);
+  br_hmac_out(&hmac, packet + UDP_SIGNED_SIZE);
+}
+
+bool UdpControl::_verify(const uint8_t *packet)
+{
+  uint8_t tag[UDP_TAG_SIZE];
+  br_hmac_context hmac;
+  br_hmac_init(&hmac, &_key, UDP_TAG_SIZE);
+  br_hmac_update(&hmac, packet, UDP_SIGNED_SIZE);
+  br_hmac_out(&hmac, tag);
+
+  // Compare in constant time
+  uint8_t difference = 0;
+  for (byte i = 0; i < UDP_TAG_SIZE; i++)
+  {
+    difference |= tag[i] ^ packet[UDP_SIGNED_SIZE + i];
+  }
+  return difference == 0;
+}
+
+void UdpControl::_send(const uint8_t *packet, IPAddress address, uint16_t port)
+{
+  _udp.beginPacket(address, port);
+  _udp.write(packet, UDP_PACKET_SIZE);
+  _udp.endPacket();
+}
@@ -0,0 +1,116 @@
+#ifndef UDPCONTROL_h
+#define UDPCONTROL_h
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+#include <WiFiUdp.h>
+#include <bearssl/bearssl_hmac.h>
+
+#define UDP_MAGIC 'K'
+#define UDP_PACKET_SIZE 20
+#define UDP_SIGNED_SIZE 12 // Bytes covered by the HMAC
+#define UDP_TAG_SIZE 8
+#define UDP_PANELS 16              // Panels whose last sequence number is remembered
+#define UDP_SEQUENCE_RESERVE 1024 // Sequence numbers a panel may use before its mark is written again
+#define UDP_ANNOUNCE_INTERVAL 60000
+
+#define UDP_FLAG_ACK 0x01 // The sender wants an acknowledgement
+
+enum UdpPacketType
+{
+  UDP_COMMAND = 1,
+  UDP_ACK = 2,
+  UDP_DISCOVER = 3,
+  UDP_ANNOUNCE = 4,
+};
+
+enum UdpAction
+{
+  UDP_OFF = 0,
+  UDP_ON = 1,
+  UDP_DIM = 2,
+};
+
+struct UdpStats
+{
+  uint32_t received;         // Valid commands
+  uint32_t rejected;         // Wrong size, format or HMAC, or a new panel when the table is full
+  uint32_t replayed;         // Sequence number not newer than the last one of the panel
+  uint32_t queueMicrosTotal; // Datagram read to command queued
+  uint32_t queueMicrosMax;
+};
+
+typedef void (*UdpCommandHandler)(byte channel, byte action, byte level);
+
+/**
+ * Authenticated binary commands for panels on the local network, without
+ * the overhead of the broker or HTTP. Every datagram is 20 bytes:
+ *
+ *   0      magic 'K'
+ *   1      type, UdpPacketType
+ *   2      channel, the number of channels in an announcement
+ *   3      action, UdpAction
+ *   4      dim level 0..15
+ *   5      flags
+ *   6..7   panel id, little endian, 0 in an announcement
+ *   8..11  sequence number, little endian. The device id in an announcement.
+ *   12..19 HMAC-SHA256 of bytes 0..11 with the shared key, truncated
+ *
+ * A command is only carried out when its sequence number is newer than the
+ * last one of the same panel id. The id is signed, so unlike the source
+ * address it cannot be changed to start over. A repeat of the last command
+ * is acknowledged again but not transmitted, so a panel can resend until it
+ * sees the acknowledgement.
+ *
+ * So a restart does not open a replay window, the "udpPanels" file keeps a
+ * mark UDP_SEQUENCE_RESERVE above the last sequence number of every panel.
+ * It is only rewritten when a panel passes its mark, not for every command.
+ * After a restart the bridge starts from the mark, so a panel has to jump
+ * ahead by UDP_SEQUENCE_RESERVE when a command is not acknowledged, or take
+ * its sequence numbers from a clock. Once UDP_PANELS panels are known,
+ * commands of new ones are rejected; forgetPanels() clears the table, for
+ * when the key changes.
+ *
+ * The bridge broadcasts an announcement every minute and answers discovery
+ * requests, so panels find it without configuration.
+ */
+class UdpControl
+{
+public:
+  void begin(uint16_t port, uint32_t deviceId, byte channels, UdpCommandHandler handler);
+  void setKey(const char *key, size_t length);
+  void forgetPanels();
+  void loop();
+  void announce(IPAddress address, uint16_t port);
+
+  UdpStats stats = {};
+
+private:
+  struct Panel
+  {
+    uint16_t id;
+    uint32_t sequence;
+    uint32_t reserved; // Mark stored in udpPanels, no sequence number up to it is accepted after a restart
+  };
+
+  WiFiUDP _udp;
+  uint16_t _port;
+  uint32_t _deviceId;
+  byte _channels;
+  UdpCommandHandler _handler;
+  br_hmac_key_context _key;
+  bool _hasKey = false;
+  unsigned long _announcedAt;
+  Panel _panels[UDP_PANELS];
+  byte _panelCount = 0;
+
+  void _handleCommand(uint8_t *packet);
+  Panel *_panel(uint16_t id, bool &known);
+  void _loadPanels();
+  void _savePanels();
+  void _sign(uint8_t *packet);
+  bool _verify(const uint8_t *packet);
+  void _send(const uint8_t *packet, IPAddress address, uint16_t port);
+};
+
+#endif
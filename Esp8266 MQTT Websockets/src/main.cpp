@@ -1,5 +1,6 @@
 #include <Arduino.h>
 #include <WiFiManager.h>
+#include <inttypes.h>
 #include <time.h>
 #include <FS.h>
 #include <LittleFS.h>
@@ -9,12 +10,58 @@
 #include <ESP8266HTTPClient.h>
 #include <WiFiClientSecure.h>
 #include <PubSubClient.h>
+#include <Ticker.h>
 #include "StringStream.h"
+#include "RfQueue.h"
+#include "CommandCache.h"
+#include "ChannelTable.h"
+#include "Scheduler.h"
+#include "SceneTable.h"
+#include "FlightRecorder.h"
+#ifdef RF_I2S
+#include "I2sTransmitter.h"
+#endif
+#ifdef RF_RX_PIN
+#include "RfReceiver.h"
+#endif
+#ifdef LAN_PORT
+#include "LanServer.h"
+#endif
+#ifdef UDP_PORT
+#include "UdpControl.h"
+#endif
 
 // Constants
 #define RF_PIN D5
-#define NUM_OF_UNITS 16
+#define NUM_OF_UNITS MAX_CHANNELS
 #define URL "https://bobsoft.nl/koppelingen/kaku/device.php";
+#define URL_HOST "bobsoft.nl"
+#define URL_PORT 443
+#define PING_INTERVAL 10000
+#define STATS_INTERVAL 60000
+#define STATE_INTERVAL 1000 // Minimum time between two <base>/state snapshots
+#define RECONNECT_INTERVAL 30000
+#define MAX_BROKERS 4
+#define BROKER_BACKOFF 300000 // A broker that failed is skipped for 5 minutes
+#define BROKER_RECHECK 900000 // Move to a faster broker at most every 15 minutes
+#define PING_TIMEOUT 30000    // Without an echo of <base>/ping for this long the broker is considered dead
+#define MQTT_LOOP_PACKETS 32  // Most packets read per loop()
+#ifndef MQTT_QOS
+#define MQTT_QOS 0 // Build with -D MQTT_QOS=1 to have the broker keep commands while the bridge is offline
+#endif
+#define TLS_FRAGMENT_CONFIG 1024 // Largest TLS record asked from the configuration server
+#define TLS_FRAGMENT_MQTT 512    // MQTT packets are at most 256 bytes
+#define TLS_RECORD_MAX 16384     // Record size a server without MFLN may send
+#define TLS_TX_BUFFER 512        // Outgoing data is split, so this only limits the record size
+#define HEAP_SAMPLE_MS 1         // Free heap sampling interval while a handshake yields
+#ifndef HA_CHANNELS
+#define HA_CHANNELS 16 // Channels announced to Home Assistant, 0 to not announce any
+#endif
+#define HA_PREFIX "homeassistant"
+#define DISCOVERY_INTERVAL 100 // Time in ms between two discovery configs after connecting
+#define BATCH_ACK_SIZE 128     // Longest <base>/batch/state message, a longer acknowledgement is split
+#define CHANNEL_PUBLISHES 4    // Most retained <base>/channelN states published per loop()
+#define TIMEZONE "CET-1CEST,M3.5.0,M10.5.0/3" // Schedules run on Amsterdam time
 
 // General variables
 bool hasSetup = false;
@@ -27,9 +74,88 @@ WiFiManager wm;
 BearSSL::CertStore certStore;
 BearSSL::WiFiClientSecure mqttWiFiClient;
 PubSubClient mqttClient;
+RfQueue rfQueue;
+CommandCache commandCache;
+ChannelTable channels;
+Scheduler scheduler;
+SceneTable scenes;
+ScenePlan scenePlan;
+FlightRecorder recorder;
+
+uint64_t channelState = 0; // Last state sent or received, per channel
+uint64_t channelKnown = 0; // Channels with a known state
+byte channelDim[MAX_CHANNELS]; // Dim level + 1, 0 when the channel was not dimmed
+uint32_t stateSequence = 0; // Counts state changes since boot
+bool stateDirty = false;    // The <base>/state snapshot is behind
+uint64_t channelDirty = 0;  // Channels whose retained <base>/channelN is behind
+
+#ifdef RF_I2S
+// Build with -D RF_I2S and wire the transmitter to GPIO3 (RX) to send through I2S DMA
+I2sTransmitter i2sTransmitter(transmitter);
+#endif
+
+#ifdef RF_RX_PIN
+// Build with e.g. -D RF_RX_PIN=D6 to follow physical remotes and wall switches
+RfReceiver receiver;
+#endif
+
+#ifdef LAN_PORT
+// Build with e.g. -D LAN_PORT=80 for the local HTTP and WebSocket API
+LanServer lanServer(LAN_PORT);
+#endif
+
+#ifdef UDP_PORT
+// Build with e.g. -D UDP_PORT=4210 for the binary UDP protocol, the key is set on <base>/udp/key
+UdpControl udpControl;
+#endif
+
+struct CommandStats
+{
+  uint32_t received;     // Commands accepted from MQTT
+  uint32_t dropped;      // Commands lost because the RF queue was full
+  uint32_t transmitted;  // Commands sent over RF
+  uint32_t latencyTotal; // Sum of arrival-to-transmit latencies in ms
+  uint32_t latencyMax;   // Worst arrival-to-transmit latency in ms
+  uint32_t pingJitterMax; // Worst deviation from PING_INTERVAL in ms
+  uint32_t duplicates;   // Redelivered commands that were not transmitted again
+} commandStats;
+
+struct TlsStats
+{
+  bool probed;
+  uint16_t fragment; // Negotiated maximum fragment length, 0 without MFLN
+  uint32_t heap;     // Heap taken by the connection after the handshake
+  uint32_t peak;     // Most heap taken while connecting, handshake included
+  uint32_t blockMin; // Smallest largest free block while connecting
+} configTls;
+
+struct Broker
+{
+  String host;
+  uint16_t port;
+  uint32_t connectRtt;    // TCP, TLS and CONNECT to CONNACK in ms, 0 before the first connection
+  uint32_t pingRtt;       // <base>/ping publish to echo in ms, smoothed
+  bool failed;
+  unsigned long failedAt;
+  TlsStats tls;
+} brokers[MAX_BROKERS];
+byte brokerCount = 0;
+byte currentBroker = 0;
+bool brokerConnected = false;   // Connected to brokers[currentBroker], to notice a lost connection
+uint32_t brokerFailovers = 0;   // Moves away from a broker that failed
+uint32_t brokerSwitches = 0;    // Moves to a faster broker
+unsigned long pingSentAt = 0;
+unsigned long pingEchoedAt = 0; // 0 until the first echo on this connection
+byte discoveryNext = HA_CHANNELS; // Next channel to announce to Home Assistant
+
+// Home Assistant MQTT discovery, one switch per channel. "~" is replaced
+// by Home Assistant with the base topic.
+static const char discoveryTopic[] PROGMEM = HA_PREFIX "/switch/kaku_%s/channel%u/config";
+static const char discoveryConfig[] PROGMEM =
+    "{\"~\":\"%s\",\"name\":\"Channel %u\",\"uniq_id\":\"kaku_%s_%u\","
+    "\"cmd_t\":\"~/channel%u/set\",\"stat_t\":\"~/channel%u\",\"qos\":%u,"
+    "\"dev\":{\"ids\":\"kaku_%s\",\"name\":\"KaKu Bridge %s\",\"mf\":\"KaKu\",\"mdl\":\"rf433v1\"}}";
 
-String mqttHost = "";
-String mqttPort = "";
 String mqttUser = "";
 String mqttPass = "";
 String mqttClientId = "";
@@ -38,6 +164,8 @@ String mqttBaseTopic = "";
 String readFile(const char *path);
 void writeFile(const char *path, String data);
 void saveParamCallback();
+void queueCommand(int channel, bool switchOn, byte source);
+bool startLevels(const Scene &levels, uint64_t known, byte source);
 
 void setupStorage()
 {
@@ -48,6 +176,9 @@ void setupStorage()
   }
 
   hasSetup = LittleFS.exists("hasSetup");
+  channels.load();
+  scenes.load();
+  recorder.begin();
 
   if (LittleFS.exists("username"))
   {
@@ -133,6 +264,64 @@ void setupWifi()
 
 String urlencode(String str);
 String getUniqueID();
+void useCachedMQTTConfig();
+void parseMQTTConfig(String &payload);
+void addBroker(const String &host, uint16_t port);
+
+Ticker heapTicker;
+uint32_t heapFreeMin;
+uint32_t heapBlockMin;
+
+void sampleHeap()
+{
+  heapFreeMin = min(heapFreeMin, ESP.getFreeHeap());
+  heapBlockMin = min(heapBlockMin, (uint32_t)ESP.getMaxFreeBlockSize());
+}
+
+/**
+ * Follow the heap during a blocking connect. The ticker only runs when
+ * the handshake yields to wait for the network, which is also when its
+ * buffers are all allocated.
+ */
+void startHeapWatch()
+{
+  heapFreeMin = UINT32_MAX;
+  heapBlockMin = UINT32_MAX;
+  sampleHeap();
+  heapTicker.attach_ms(HEAP_SAMPLE_MS, sampleHeap);
+}
+
+void stopHeapWatch(uint32_t freeHeap, TlsStats &stats)
+{
+  heapTicker.detach();
+  sampleHeap();
+  stats.peak = freeHeap > heapFreeMin ? freeHeap - heapFreeMin : 0;
+  stats.blockMin = heapBlockMin;
+}
+
+/**
+ * Size the TLS buffers of a client before it connects. A server that
+ * supports Maximum Fragment Length negotiation sends records of at most
+ * the fragment size, otherwise a full record has to fit.
+ */
+void setupTlsBuffers(BearSSL::WiFiClientSecure &client, const char *host, uint16_t port, uint16_t fragment, TlsStats &stats)
+{
+  if (!stats.probed)
+  {
+    stats.probed = true;
+    stats.fragment = client.probeMaxFragmentLength(host, port, fragment) ? fragment : 0;
+    Serial.printf("MFLN %u for %s: %s\n", fragment, host, stats.fragment > 0 ? "yes" : "no");
+  }
+
+  if (stats.fragment > 0)
+  {
+    client.setBufferSizes(stats.fragment, min(stats.fragment, (uint16_t)TLS_TX_BUFFER));
+  }
+  else
+  {
+    client.setBufferSizes(TLS_RECORD_MAX, TLS_TX_BUFFER);
+  }
+}
 
 void setupMQTTConfig()
 {
@@ -140,6 +329,8 @@ void setupMQTTConfig()
   BearSSL::WiFiClientSecure wifiClient;
   HTTPClient httpClient;
   wifiClient.setCertStore(&certStore);
+  setupTlsBuffers(wifiClient, URL_HOST, URL_PORT, TLS_FRAGMENT_CONFIG, configTls);
+  uint32_t freeHeap = ESP.getFreeHeap();
 
   String url = URL;
   url += "?user=" + urlencode(username);
@@ -151,65 +342,224 @@ void setupMQTTConfig()
   if (!httpClient.begin(wifiClient, url)) // Initiate connection
   {
     Serial.printf("[HTTP} Unable to connect\n");
-    LittleFS.remove("hasSetup");
-    delay(1000);
-    ESP.restart();
+    useCachedMQTTConfig();
+    return;
   }
 
+  startHeapWatch();
   int httpCode = httpClient.GET(); // Make request
+  stopHeapWatch(freeHeap, configTls);
 
-  if (httpCode <= 0 || httpCode >= 400)
+  if (httpCode != 200)
   {
     Serial.print("[HTTP] GET... failed, error: ");
     Serial.println(httpCode);
 
     httpClient.end();
 
+    // Only rejected credentials need a new setup, not an unreachable or failing server
+    if (httpCode == 401 || httpCode == 403)
+    {
+      LittleFS.remove("hasSetup");
+      delay(1000);
+      ESP.restart();
+    }
+
+    useCachedMQTTConfig();
+    return;
+  }
+
+  String payload = httpClient.getString(); // Get response
+  configTls.heap = freeHeap - ESP.getFreeHeap() - payload.length();
+  httpClient.end();
+
+  writeFile("mqttConfig", payload);
+  parseMQTTConfig(payload);
+}
+
+void useCachedMQTTConfig()
+{
+  if (!LittleFS.exists("mqttConfig"))
+  {
     LittleFS.remove("hasSetup");
     delay(1000);
     ESP.restart();
   }
 
-  String payload = httpClient.getString(); // Get response
-  StringStream stream(&payload);
-  httpClient.end();
+  Serial.println("Using the cached MQTT config");
+  String payload = readFile("mqttConfig");
+  parseMQTTConfig(payload);
+}
 
-  mqttHost = stream.readStringUntil('\n');
-  mqttPort = stream.readStringUntil('\n');
+/**
+ * Six lines: host, port, username, password, client id and base topic.
+ * They may be followed by further brokers, one "host:port" per line, that
+ * share the credentials and topics.
+ */
+void parseMQTTConfig(String &payload)
+{
+  StringStream stream(&payload);
+  String host = stream.readStringUntil('\n');
+  String port = stream.readStringUntil('\n');
   mqttUser = stream.readStringUntil('\n');
   mqttPass = stream.readStringUntil('\n');
   mqttClientId = stream.readStringUntil('\n');
   mqttBaseTopic = stream.readStringUntil('\n');
 
-  Serial.println("Host: " + mqttHost);
-  Serial.println("Port: " + mqttPort);
+  brokerCount = 0;
+  addBroker(host, port.toInt());
+  while (stream.available() > 0 && brokerCount < MAX_BROKERS)
+  {
+    String line = stream.readStringUntil('\n');
+    int colon = line.lastIndexOf(':');
+    if (colon > 0)
+    {
+      addBroker(line.substring(0, colon), line.substring(colon + 1).toInt());
+    }
+  }
+
   Serial.println("Username: " + mqttUser);
   Serial.println("Password: " + mqttPass);
   Serial.println("ClientId: " + mqttClientId);
   Serial.println("Topic: " + mqttBaseTopic);
-  
 }
 
-void handleMessage(char* topic, uint8_t * payload, size_t length);
-void setupMQTT()
+void addBroker(const String &host, uint16_t port)
 {
+  Broker &broker = brokers[brokerCount++];
+  broker.host = host;
+  broker.port = port;
+  Serial.printf("Broker %u: %s:%u\n", brokerCount, host.c_str(), port);
+}
+
+/**
+ * The broker that connected fastest, among those that did not fail
+ * recently. Brokers that were never connected to come first, so each of
+ * them gets measured. Returns -1 when every broker failed recently.
+ */
+int selectBroker()
+{
+  int best = -1;
+  for (byte i = 0; i < brokerCount; i++)
+  {
+    const Broker &broker = brokers[i];
+    if (broker.failed && millis() - broker.failedAt < BROKER_BACKOFF)
+    {
+      continue;
+    }
+    if (best < 0 || broker.connectRtt < brokers[best].connectRtt)
+    {
+      best = i;
+    }
+  }
+  return best;
+}
+
+void failBroker()
+{
+  brokers[currentBroker].failed = true;
+  brokers[currentBroker].failedAt = millis();
+  brokerConnected = false;
+  if (brokerCount > 1)
+  {
+    brokerFailovers++;
+  }
+}
+
+void handleMessage(char* topic, uint8_t * payload, unsigned int length);
+void handleCommand(const char *suffix, uint8_t *payload, size_t length, byte source);
+size_t formatState(char *payload, size_t size);
+void handleLanCommand(const char *path, uint8_t *body, size_t length);
+void publishSchedules();
+void publishScenes();
+void publishBroker();
+
+/**
+ * Connect to a broker, or when index is -1 to the one that failed longest
+ * ago.
+ */
+void setupMQTT(int index)
+{
+  if (index < 0)
+  {
+    index = 0;
+    for (byte i = 1; i < brokerCount; i++)
+    {
+      if ((long)(brokers[i].failedAt - brokers[index].failedAt) < 0)
+      {
+        index = i;
+      }
+    }
+  }
+
+  currentBroker = index;
+  Broker &broker = brokers[currentBroker];
   mqttWiFiClient.setCertStore(&certStore);
+  setupTlsBuffers(mqttWiFiClient, broker.host.c_str(), broker.port, TLS_FRAGMENT_MQTT, broker.tls);
   mqttClient.setClient(mqttWiFiClient);
-  mqttClient.setServer(mqttHost.c_str(), mqttPort.toInt());
+  mqttClient.setServer(broker.host.c_str(), broker.port);
   mqttClient.setCallback(handleMessage);
 
-  if (mqttClient.connect(mqttClientId.c_str(), mqttUser.c_str(), mqttPass.c_str()))
+  // With QoS 1 the session is kept, so commands sent while offline are delivered after reconnecting
+  uint32_t freeHeap = ESP.getFreeHeap();
+  unsigned long start = millis();
+  startHeapWatch();
+  bool connected = mqttClient.connect(mqttClientId.c_str(), mqttUser.c_str(), mqttPass.c_str(), NULL, 0, false, NULL, MQTT_QOS == 0);
+  stopHeapWatch(freeHeap, broker.tls);
+  if (!connected)
+  {
+    Serial.printf("Unable to connect to MQTT broker %s:%u\n", broker.host.c_str(), broker.port);
+    failBroker();
+  }
+  else
   {
-    Serial.println("Connected to MQTT");
+    broker.connectRtt = max(millis() - start, 1UL);
+    broker.failed = false;
+    broker.tls.heap = freeHeap - ESP.getFreeHeap();
+    brokerConnected = true;
+    pingEchoedAt = 0;
+    Serial.printf("Connected to MQTT broker %s:%u in %u ms, TLS uses %u bytes, %u at its peak\n", broker.host.c_str(), broker.port,
+                  broker.connectRtt, broker.tls.heap, broker.tls.peak);
 
-    for (int i = 0; i < NUM_OF_UNITS; i++)
-    {
-      String topic = mqttBaseTopic + "/channel" + i + "/set";
-      mqttClient.subscribe(topic.c_str());
-    }
+    // One wildcard per action instead of a subscription per channel
+    String topic = mqttBaseTopic + "/+/set";
+    mqttClient.subscribe(topic.c_str(), MQTT_QOS);
+
+    topic = mqttBaseTopic + "/+/protocol";
+    mqttClient.subscribe(topic.c_str(), MQTT_QOS);
+
+    topic = mqttBaseTopic + "/schedule/+";
+    mqttClient.subscribe(topic.c_str(), MQTT_QOS);
+
+    topic = mqttBaseTopic + "/scene/+";
+    mqttClient.subscribe(topic.c_str(), MQTT_QOS);
+
+    topic = mqttBaseTopic + "/batch";
+    mqttClient.subscribe(topic.c_str(), MQTT_QOS);
+
+    // QoS 0, a dump is only useful right away
+    topic = mqttBaseTopic + "/rflog/dump";
+    mqttClient.subscribe(topic.c_str());
+
+#ifdef UDP_PORT
+    topic = mqttBaseTopic + "/udp/key";
+    mqttClient.subscribe(topic.c_str(), MQTT_QOS);
+#endif
+
+    // QoS 0, a reset is never acknowledged and would be delivered again after restarting
+    topic = mqttBaseTopic + "/reset";
+    mqttClient.subscribe(topic.c_str());
 
-    String topic = mqttBaseTopic + "/reset";
+    // Our own pings come back, which measures the round trip to the broker
+    topic = mqttBaseTopic + "/ping";
     mqttClient.subscribe(topic.c_str());
+
+    publishSchedules();
+    publishScenes();
+    publishBroker();
+
+    // The discovery configs follow one by one from loopMQTT
+    discoveryNext = 0;
   }
 }
 
@@ -220,6 +570,43 @@ void setupTransmitter()
 
   // Make each transmitter unique
   transmitter._address = (uint32_t)(mac[3] << 16 | mac[4] << 8 | mac[5]);
+  channels.begin(transmitter._address);
+
+  if (!transmitter.calibrate())
+  {
+    Serial.println("Cycle counted transmit not available, using digitalWrite");
+  }
+
+#ifdef RF_I2S
+  if (!i2sTransmitter.begin())
+  {
+    Serial.println("Unable to start I2S transmitter");
+  }
+#endif
+
+#ifdef RF_RX_PIN
+  receiver.begin(RF_RX_PIN);
+#endif
+}
+
+#ifdef UDP_PORT
+void handleUdpCommand(byte channel, byte action, byte level);
+void setupUdp()
+{
+  String key = readFile("udpKey");
+  udpControl.setKey(key.c_str(), key.length());
+  udpControl.begin(UDP_PORT, transmitter._address, NUM_OF_UNITS, handleUdpCommand);
+}
+#endif
+
+void runSchedule(byte channel, bool switchOn);
+void setupScheduler()
+{
+  setenv("TZ", TIMEZONE, 1);
+  tzset();
+
+  scheduler.begin(runSchedule);
+  scheduler.load();
 }
 
 void setup()
@@ -230,8 +617,15 @@ void setup()
   setupStorage();
   setupWifi();
   setupNTP();
+  setupScheduler();
   setupMQTTConfig();
-  setupMQTT();
+  setupMQTT(selectBroker());
+#ifdef LAN_PORT
+  lanServer.begin(handleLanCommand, formatState);
+#endif
+#ifdef UDP_PORT
+  setupUdp();
+#endif
 }
 
 void loopRestartTimer()
@@ -247,41 +641,284 @@ void loopRestartTimer()
     {
       // Is it 3 o clock GMT at night? (4 or 5 amsterdam time)
       // If yes to both, please reset.
+      recorder.flush();
       ESP.restart();
     }
   }
 }
 
+void publishStats();
+void publishLog();
+void publishDiscovery(byte channel);
+void publishTlsStats();
+void publishReceiverStats();
+void publishUdpStats();
+void publishState();
+void publishChannelState(int channel);
 void loopMQTT()
 {
-  if (!mqttClient.connected())
+  if (brokerConnected && !mqttClient.connected())
   {
     Serial.println("MQTT disconnected");
+    failBroker();
+  }
+
+  // The connection can be dead without TCP noticing, the pings stopped coming back
+  if (brokerConnected && pingEchoedAt != 0 && (millis() - pingEchoedAt) >= PING_TIMEOUT)
+  {
+    Serial.println("MQTT broker stopped answering");
+    failBroker();
+    mqttClient.disconnect();
   }
 
+  // One packet per call, so read everything that waited during a transmission.
+  // The commands then coalesce in the RF queue instead of backing up.
   mqttClient.loop();
+  for (byte i = 1; i < MQTT_LOOP_PACKETS && mqttWiFiClient.available() > 0; i++)
+  {
+    mqttClient.loop();
+  }
+
+  // A few channel states per call, so a batch does not hold up the transmitter
+  for (byte i = 0; i < CHANNEL_PUBLISHES && channelDirty != 0 && mqttClient.connected(); i++)
+  {
+    int channel = __builtin_ctzll(channelDirty);
+    channelDirty &= channelDirty - 1;
+    publishChannelState(channel);
+  }
 
   // Sendping
   static unsigned long mLastTime = 0;
-  if ((millis() - mLastTime) >= 10000)
+  if ((millis() - mLastTime) >= PING_INTERVAL)
   {
+    if (mLastTime != 0)
+    {
+      uint32_t jitter = millis() - mLastTime - PING_INTERVAL;
+      if (jitter > commandStats.pingJitterMax)
+      {
+        commandStats.pingJitterMax = jitter;
+      }
+    }
+
     mLastTime = millis();
+    pingSentAt = millis();
     String path = mqttBaseTopic + "/ping";
     mqttClient.publish(path.c_str(), getUniqueID().c_str());
   }
 
-  if (!mqttClient.connected())
+  // Announce one channel at a time, so a connect does not stall incoming commands
+  static unsigned long dLastTime = 0;
+  if (discoveryNext < HA_CHANNELS && mqttClient.connected() && (millis() - dLastTime) >= DISCOVERY_INTERVAL)
   {
-    if (millis() > 30000)
+    dLastTime = millis();
+    publishDiscovery(discoveryNext++);
+  }
+
+  // Move back to a faster broker once it is available again
+  static unsigned long bLastTime = 0;
+  if (brokerConnected && (millis() - bLastTime) >= BROKER_RECHECK)
+  {
+    bLastTime = millis();
+    int best = selectBroker();
+    if (best >= 0 && best != currentBroker && brokers[best].connectRtt < brokers[currentBroker].connectRtt)
     {
+      brokerSwitches++;
+      brokerConnected = false;
+      mqttClient.disconnect();
+      setupMQTT(best);
+    }
+  }
+
+  // Send the state snapshot, a burst of commands results in one
+  static unsigned long stLastTime = 0;
+  if (stateDirty && (millis() - stLastTime) >= STATE_INTERVAL)
+  {
+    stLastTime = millis();
+    publishState();
+  }
+
+  // Send statistics
+  static unsigned long sLastTime = 0;
+  if ((millis() - sLastTime) >= STATS_INTERVAL)
+  {
+    sLastTime = millis();
+    publishStats();
+    publishTlsStats();
+    publishBroker();
+#ifdef RF_RX_PIN
+    publishReceiverStats();
+#endif
+#ifdef UDP_PORT
+    publishUdpStats();
+#endif
+  }
+
+  // Fail over right away while another broker is available, otherwise retry
+  // the one that failed longest ago
+  static unsigned long rLastTime = 0;
+  static unsigned long cLastTime = 0;
+  if (mqttClient.connected())
+  {
+    cLastTime = millis();
+  }
+  else
+  {
+    int next = selectBroker();
+    if (next >= 0 || (millis() - rLastTime) >= RECONNECT_INTERVAL)
+    {
+      rLastTime = millis();
+      setupMQTT(next);
+    }
+
+#ifndef LAN_PORT
+    // Without the LAN API there is nothing to serve, a restart may help
+    if ((millis() - cLastTime) >= BROKER_BACKOFF)
+    {
+      recorder.flush();
       ESP.restart();
     }
+#endif
+  }
+}
+
+void logTransmission(const SceneFrame &frame, uint32_t latency)
+{
+  RfRecord record = {};
+  record.time = time(nullptr);
+  record.address = frame.address;
+  record.unit = frame.unit;
+  record.protocol = frame.protocol;
+  record.action = frame.switchType | (frame.group ? RF_LOG_GROUP : 0) | frame.dimLevel << 4;
+  record.source = frame.source;
+  record.repeats = protocolTelegrams(frame.protocol, frame.group);
+  record.latency = min(latency, (uint32_t)RF_LOG_LATENCY_UNKNOWN);
+  recorder.record(record);
+}
+
+void loopTransmitter()
+{
+#ifdef RF_I2S
+  // The previous command is still being clocked out
+  i2sTransmitter.loop();
+  if (i2sTransmitter.busy())
+  {
+    return;
+  }
+#endif
+
+#ifdef RF_RX_PIN
+  // Our own transmission has ended
+  receiver.enable();
+#endif
+
+  // A scene goes first, so commands that arrived after it win
+  SceneFrame frame;
+  if (scenePlan.pop(frame))
+  {
+#ifdef RF_RX_PIN
+    receiver.disable();
+#endif
+
+    logTransmission(frame, RF_LOG_LATENCY_UNKNOWN);
+
+#ifdef RF_I2S
+    i2sTransmitter.send(frame.protocol, frame.address, frame.group, frame.switchType, frame.unit, frame.dimLevel);
+#else
+    sendSceneFrame(transmitter, frame);
+#endif
+    return;
+  }
+
+  RfCommand command;
+  if (rfQueue.pop(command))
+  {
+    uint32_t latency = millis() - command.receivedAt;
+    commandStats.transmitted++;
+    commandStats.latencyTotal += latency;
+    if (latency > commandStats.latencyMax)
+    {
+      commandStats.latencyMax = latency;
+    }
+
+#ifdef RF_RX_PIN
+    receiver.disable();
+#endif
+
+    const ChannelTarget &target = channels[command.channel];
+    byte switchType = command.switchOn ? NewRemoteTransmitter::SWITCH_ON : NewRemoteTransmitter::SWITCH_OFF;
+    SceneFrame sent = {};
+    sent.protocol = target.protocol;
+    sent.group = false;
+    sent.switchType = switchType;
+    sent.unit = target.unit;
+    sent.dimLevel = 0;
+    sent.address = target.address;
+    sent.source = command.source;
+    logTransmission(sent, latency);
+
+#ifdef RF_I2S
+    // The radio is on GPIO3, RF_PIN has nothing attached
+    i2sTransmitter.send(target.protocol, target.address, false, switchType, target.unit, 0);
+#else
+    channels.send(transmitter, command.channel, switchType);
+#endif
+  }
+}
+
+#ifdef RF_RX_PIN
+void handleReceived(const RfCode &code);
+void loopReceiver()
+{
+  RfCode code;
+  while (receiver.read(code))
+  {
+    handleReceived(code);
   }
 }
+#endif
+
+#ifdef LAN_PORT
+void handleLanCommand(const char *path, uint8_t *body, size_t length)
+{
+  Serial.print("LAN request, ");
+  handleCommand(path, body, length, RF_SOURCE_LAN);
+}
+
+void loopLan()
+{
+  lanServer.loop();
+
+  // Unlike the broker, LAN clients get every change right away
+  static uint32_t pushedSequence = 0;
+  if (pushedSequence != stateSequence)
+  {
+    pushedSequence = stateSequence;
+    lanServer.pushState();
+  }
+}
+#endif
+
+void loopScheduler()
+{
+  // Only compares the clock with the earliest deadline
+  scheduler.poll(time(nullptr));
+}
 
 void loop()
 {
   loopMQTT();
+  loopScheduler();
+#ifdef RF_RX_PIN
+  loopReceiver();
+#endif
+#ifdef LAN_PORT
+  loopLan();
+#endif
+#ifdef UDP_PORT
+  udpControl.loop();
+#endif
+  loopTransmitter();
+  recorder.loop();
   loopRestartTimer();
 }
 
@@ -315,6 +952,9 @@ void saveParamCallback()
   writeFile("username", username);
   writeFile("password", password);
   writeFile("klantcode", klantcode);
+
+  // Fetched again with the new credentials
+  LittleFS.remove("mqttConfig");
 }
 
 /*
@@ -340,9 +980,17 @@ String readFile(const char *path)
     return result;
   }
 
+  // Read in blocks instead of growing the String one character at a time
+  char buffer[64];
+  result.reserve(file.size());
   while (file.available())
   {
-    result += (char)file.read();
+    size_t length = file.read((uint8_t *)buffer, sizeof(buffer));
+    if (length == 0)
+    {
+      break;
+    }
+    result.concat(buffer, length);
   }
   file.close();
   return result;
@@ -371,6 +1019,7 @@ void writeFile(const char *path, String data)
 String urlencode(String str)
 {
   String encodedString = "";
+  encodedString.reserve(str.length() * 3);
   char c;
   char code0;
   char code1;
@@ -405,7 +1054,6 @@ String urlencode(String str)
       encodedString += code1;
       // encodedString+=code2;
     }
-    yield();
   }
   return encodedString;
 }
@@ -419,49 +1067,627 @@ String getUniqueID()
   return result;
 }
 
-void handleMessage(char* topic, uint8_t * payload, size_t length) {
-  String _topic = String(topic);
-  
+void publishStats()
+{
+  // Edge timing of the last RF command, converted from cycles to ns
+  const NewRemoteTransmitter::TimingStats &timing = transmitter.timing;
+  uint32_t cyclesPerMicro = ESP.getCpuFreqMHz();
+  int32_t edgeMin = timing.edges > 0 ? timing.errorMin * 1000 / (int32_t)cyclesPerMicro : 0;
+  int32_t edgeMax = timing.edges > 0 ? timing.errorMax * 1000 / (int32_t)cyclesPerMicro : 0;
+  uint32_t edgeAvg = timing.edges > 0 ? timing.errorTotal / timing.edges * 1000 / cyclesPerMicro : 0;
+
+  char payload[200];
+  snprintf_P(payload, sizeof(payload), PSTR("received=%u,dropped=%u,duplicates=%u,transmitted=%u,latency_avg=%u,latency_max=%u,ping_jitter_max=%u,edge_err_min_ns=%d,edge_err_max_ns=%d,edge_err_avg_ns=%u"),
+             commandStats.received, commandStats.dropped, commandStats.duplicates, commandStats.transmitted,
+             commandStats.transmitted > 0 ? commandStats.latencyTotal / commandStats.transmitted : 0,
+             commandStats.latencyMax, commandStats.pingJitterMax,
+             edgeMin, edgeMax, edgeAvg);
+
+  String path = mqttBaseTopic + "/stats";
+  mqttClient.publish(path.c_str(), payload);
+}
+
+void publishLog()
+{
+  // Several kB, streamed past the client buffer. Staged records are included.
+  String path = mqttBaseTopic + "/rflog";
+  mqttClient.beginPublish(path.c_str(), recorder.dumpSize(), false);
+  recorder.dump(mqttClient);
+  mqttClient.endPublish();
+}
+
+void publishTlsStats()
+{
+  const TlsStats &mqttTls = brokers[currentBroker].tls;
+  char payload[256];
+  snprintf_P(payload, sizeof(payload),
+             PSTR("mqtt_mfln=%u,mqtt_heap=%u,mqtt_heap_peak=%u,mqtt_block_min=%u,"
+                  "config_mfln=%u,config_heap=%u,config_heap_peak=%u,config_block_min=%u,free_heap=%u,max_block=%u"),
+             mqttTls.fragment, mqttTls.heap, mqttTls.peak, mqttTls.blockMin,
+             configTls.fragment, configTls.heap, configTls.peak, configTls.blockMin,
+             ESP.getFreeHeap(), ESP.getMaxFreeBlockSize());
+
+  String path = mqttBaseTopic + "/tls/stats";
+  mqttClient.publish(path.c_str(), payload);
+}
+
+void publishBroker()
+{
+  const Broker &broker = brokers[currentBroker];
+  char payload[160];
+  snprintf_P(payload, sizeof(payload), PSTR("host=%s,port=%u,index=%u,brokers=%u,connect_ms=%u,ping_ms=%u,failovers=%u,switches=%u"),
+             broker.host.c_str(), broker.port, currentBroker, brokerCount, broker.connectRtt, broker.pingRtt,
+             brokerFailovers, brokerSwitches);
+
+  String path = mqttBaseTopic + "/broker";
+  mqttClient.publish(path.c_str(), payload);
+}
+
+void publishDiscovery(byte channel)
+{
+  String id = getUniqueID();
+  char topic[128];
+  snprintf_P(topic, sizeof(topic), discoveryTopic, id.c_str(), channel);
+
+  // Larger than the client buffer, so it is streamed instead of published at once
+  char payload[384];
+  size_t length = snprintf_P(payload, sizeof(payload), discoveryConfig, mqttBaseTopic.c_str(), channel, id.c_str(), channel,
+                             channel, channel, MQTT_QOS, id.c_str(), id.c_str());
+  if (length >= sizeof(payload))
+  {
+    return;
+  }
+
+  mqttClient.beginPublish(topic, length, true);
+  mqttClient.write((const uint8_t *)payload, length);
+  mqttClient.endPublish();
+}
+
+// Retained <base>/channelN, the state topic of the channel in Home Assistant
+void publishChannelState(int channel)
+{
+  char topic[128];
+  snprintf_P(topic, sizeof(topic), PSTR("%s/channel%d"), mqttBaseTopic.c_str(), channel);
+  mqttClient.publish(topic, channelState & (1ULL << channel) ? "ON" : "OFF", true);
+}
+
+/*
+ * Every command, scene, batch and received code ends up here. The retained
+ * state of the channel is published later by loopMQTT(), not from inside
+ * the callback that handles the command.
+ */
+void setChannelState(int channel, bool switchOn, int dimLevel = -1)
+{
+  uint64_t mask = 1ULL << channel;
+  byte dim = switchOn ? dimLevel + 1 : 0;
+  if (!(channelKnown & mask) || ((channelState & mask) != 0) != switchOn || channelDim[channel] != dim)
+  {
+    stateSequence++;
+    stateDirty = true;
+  }
+
+  channelDim[channel] = dim;
+  channelKnown |= mask;
+  if (switchOn)
+  {
+    channelState |= mask;
+  }
+  else
+  {
+    channelState &= ~mask;
+  }
+  channelDirty |= mask;
+}
+
+/*
+ * Retained snapshot of all channels, so a controller resyncs from one
+ * message: "seq=17,known=<hex>,on=<hex>,dim=<levels>". known and on are
+ * 64 bit maps with channel 0 in the lowest bit, dim has one hex digit per
+ * channel with '-' for channels that were not dimmed.
+ */
+size_t formatState(char *payload, size_t size)
+{
+  char dim[MAX_CHANNELS + 1];
+  for (int i = 0; i < MAX_CHANNELS; i++)
+  {
+    dim[i] = channelDim[i] == 0 ? '-' : "0123456789abcdef"[channelDim[i] - 1];
+  }
+  dim[MAX_CHANNELS] = '\0';
+
+  int length = snprintf_P(payload, size, PSTR("seq=%" PRIu32 ",known=%08" PRIx32 "%08" PRIx32 ",on=%08" PRIx32 "%08" PRIx32 ",dim=%s"),
+                          stateSequence, (uint32_t)(channelKnown >> 32), (uint32_t)channelKnown,
+                          (uint32_t)(channelState >> 32), (uint32_t)channelState, dim);
+  return min((size_t)length, size - 1);
+}
+
+void publishState()
+{
+  char payload[160];
+  formatState(payload, sizeof(payload));
+
+  char topic[128];
+  snprintf_P(topic, sizeof(topic), PSTR("%s/state"), mqttBaseTopic.c_str());
+  if (mqttClient.publish(topic, payload, true))
+  {
+    stateDirty = false;
+  }
+}
+
+#ifdef RF_RX_PIN
+void publishReceiverStats()
+{
+  const RfDecoderStats &decoded = receiver.decoder.stats;
+  char payload[160];
+  snprintf_P(payload, sizeof(payload), PSTR("edges=%u,missed=%u,syncs=%u,codes=%u,errors=%u,repeats=%u,ns_per_edge=%u"),
+             decoded.edges, receiver.stats.missed, decoded.syncs, decoded.codes, decoded.errors, receiver.stats.repeats,
+             decoded.edges > 0 ? (uint32_t)((uint64_t)receiver.stats.decodeMicros * 1000 / decoded.edges) : 0);
+
+  String path = mqttBaseTopic + "/receiver/stats";
+  mqttClient.publish(path.c_str(), payload);
+}
+
+void handleReceived(const RfCode &code)
+{
+  const char *state = code.switchType == NewRemoteTransmitter::SWITCH_DIM ? (code.dimLevel > 0 ? "ON" : "OFF")
+                      : code.switchType == NewRemoteTransmitter::SWITCH_ON ? "ON" : "OFF";
+  Serial.printf("Received %lu unit %u %s\n", (unsigned long)code.address, code.unit, state);
+
+  // Update the retained state of every channel the remote controls
+  bool known = false;
+  for (int i = 0; i < NUM_OF_UNITS; i++)
+  {
+    const ChannelTarget &target = channels[i];
+    if (target.protocol != PROTOCOL_KAKU || target.address != code.address || (!code.group && target.unit != code.unit))
+    {
+      continue;
+    }
+
+    known = true;
+    setChannelState(i, strcmp(state, "ON") == 0, code.switchType == NewRemoteTransmitter::SWITCH_DIM ? code.dimLevel : -1);
+  }
+
+  if (!known)
+  {
+    // Learn mode: the payload can be sent to <base>/channelN/protocol as is
+    char payload[48];
+    snprintf_P(payload, sizeof(payload), PSTR("kaku %lu %u %s"), (unsigned long)code.address, code.unit, state);
+    char topic[128];
+    snprintf_P(topic, sizeof(topic), PSTR("%s/received"), mqttBaseTopic.c_str());
+    mqttClient.publish(topic, payload);
+  }
+}
+#endif
+
+#ifdef UDP_PORT
+void publishUdpStats()
+{
+  const UdpStats &stats = udpControl.stats;
+  char payload[160];
+  snprintf_P(payload, sizeof(payload), PSTR("received=%u,rejected=%u,replayed=%u,queue_us_avg=%u,queue_us_max=%u"),
+             stats.received, stats.rejected, stats.replayed,
+             stats.received > 0 ? stats.queueMicrosTotal / stats.received : 0, stats.queueMicrosMax);
+
+  String path = mqttBaseTopic + "/udp/stats";
+  mqttClient.publish(path.c_str(), payload);
+}
+
+void handleUdpCommand(byte channel, byte action, byte level)
+{
+  if (action != UDP_DIM)
+  {
+    queueCommand(channel, action == UDP_ON, RF_SOURCE_UDP);
+    return;
+  }
+
+  // Dimming goes through the planner like a batch of one
+  Scene levels = {};
+  levels.levels[channel] = SCENE_DIM + level;
+  commandStats.received++;
+  startLevels(levels, 0, RF_SOURCE_UDP);
+}
+#endif
+
+void publishSchedules()
+{
+  // One retained topic per entry, empty for unused entries so old ones are cleared
+  char topic[128];
+  for (byte i = 0; i < MAX_SCHEDULES; i++)
+  {
+    snprintf_P(topic, sizeof(topic), PSTR("%s/schedules/%u"), mqttBaseTopic.c_str(), i);
+    mqttClient.publish(topic, scheduler.describe(i).c_str(), true);
+  }
+}
+
+void runSchedule(byte channel, bool switchOn)
+{
+  Serial.printf("Schedule: channel %u %s\n", channel, switchOn ? "on" : "off");
+  queueCommand(channel, switchOn, RF_SOURCE_SCHEDULE);
+}
+
+void handleSchedule(const char *action, const char *text)
+{
+  bool changed = false;
+  if (strcmp(action, "add") == 0)
+  {
+    changed = scheduler.add(text) >= 0;
+  }
+  else if (strcmp(action, "remove") == 0)
+  {
+    changed = scheduler.remove(atoi(text));
+  }
+  else if (strcmp(action, "location") == 0)
+  {
+    float latitude, longitude;
+    changed = sscanf(text, "%f %f", &latitude, &longitude) == 2;
+    if (changed)
+    {
+      scheduler.setLocation(latitude, longitude);
+    }
+  }
+
+  Serial.println(changed ? ", Schedules changed" : ", Invalid schedule");
+  if (changed)
+  {
+    scheduler.save();
+    publishSchedules();
+  }
+}
+
+void publishScenes()
+{
+  // One retained topic per scene, empty for unused scenes so old ones are cleared
+  char topic[128];
+  for (byte i = 0; i < MAX_SCENES; i++)
+  {
+    snprintf_P(topic, sizeof(topic), PSTR("%s/scenes/%u"), mqttBaseTopic.c_str(), i);
+    mqttClient.publish(topic, scenes.name(i)[0] != '\0' ? scenes.describe(i).c_str() : "", true);
+  }
+}
+
+/*
+ * Plan the frames for a scene or batch, they replace what was still queued
+ * for its channels. Returns false, changing nothing, when the plan is full.
+ */
+bool startLevels(const Scene &levels, uint64_t known, byte source)
+{
+  if (!SceneTable::plan(levels, channels, NUM_OF_UNITS, known, channelState, scenePlan, source))
+  {
+    Serial.println(", Plan full, nothing was switched");
+    commandStats.dropped++;
+    return false;
+  }
+
+  for (int i = 0; i < NUM_OF_UNITS; i++)
+  {
+    byte level = levels.levels[i];
+    if (level != SCENE_NONE)
+    {
+      rfQueue.cancel(i);
+      setChannelState(i, level != SCENE_OFF, level >= SCENE_DIM ? level - SCENE_DIM : -1);
+    }
+  }
+  return true;
+}
+
+void runScene(int index)
+{
+  const Scene &scene = scenes[index];
+  if (!startLevels(scene, channelKnown, RF_SOURCE_SCENE))
+  {
+    return;
+  }
+  Serial.printf(", Scene %s, %u frames waiting\n", scene.name, scenePlan.size());
+}
+
+/*
+ * Parse a batch like "0:ON,3:OFF,7:DIM8" straight from the payload. Returns
+ * the number of channels, -1 when any part is invalid.
+ */
+int parseBatch(const uint8_t *payload, size_t length, Scene &batch)
+{
+  memset(&batch, 0, sizeof(batch));
+  int count = 0;
+  size_t i = 0;
+  while (i < length)
+  {
+    // Channel of at most two digits, then a colon
+    int channel = 0;
+    size_t digits = 0;
+    while (i < length && digits < 2 && isdigit(payload[i]))
+    {
+      channel = channel * 10 + (payload[i++] - '0');
+      digits++;
+    }
+    if (digits == 0 || channel >= NUM_OF_UNITS || i == length || payload[i++] != ':')
+    {
+      return -1;
+    }
+
+    // Level up to the next comma
+    const char *level = (const char *)payload + i;
+    size_t levelLength = 0;
+    while (i < length && payload[i] != ',')
+    {
+      i++;
+      levelLength++;
+    }
+    i++;
+
+    byte target;
+    if (levelLength == 2 && strncasecmp(level, "ON", 2) == 0)
+    {
+      target = SCENE_ON;
+    }
+    else if (levelLength == 3 && strncasecmp(level, "OFF", 3) == 0)
+    {
+      target = SCENE_OFF;
+    }
+    else if ((levelLength == 4 || levelLength == 5) && strncasecmp(level, "DIM", 3) == 0 &&
+             isdigit(level[3]) && (levelLength == 4 || isdigit(level[4])))
+    {
+      int dimLevel = levelLength == 4 ? level[3] - '0' : (level[3] - '0') * 10 + (level[4] - '0');
+      if (dimLevel > 15)
+      {
+        return -1;
+      }
+      target = SCENE_DIM + dimLevel;
+    }
+    else
+    {
+      return -1;
+    }
+
+    if (batch.levels[channel] == SCENE_NONE)
+    {
+      count++;
+    }
+    batch.levels[channel] = target;
+  }
+  return count;
+}
+
+void handleBatch(const uint8_t *payload, size_t length, byte source)
+{
+  Scene batch;
+  int count = parseBatch(payload, length, batch);
+  if (count <= 0)
+  {
+    Serial.println(", Invalid batch");
+    return;
+  }
+
+  // Like /set every command is sent, also when the state seems to match
+  commandStats.received += count;
+  if (!startLevels(batch, 0, source))
+  {
+    return;
+  }
+  Serial.printf(", Batch of %d channels, %u frames waiting\n", count, scenePlan.size());
+
+  // One acknowledgement for the whole batch instead of a state per channel,
+  // split over several messages when it does not fit the client buffer
+  char topic[128];
+  snprintf_P(topic, sizeof(topic), PSTR("%s/batch/state"), mqttBaseTopic.c_str());
+  char ack[BATCH_ACK_SIZE];
+  size_t ackLength = 0;
+  for (int i = 0; i < NUM_OF_UNITS; i++)
+  {
+    byte level = batch.levels[i];
+    if (level == SCENE_NONE)
+    {
+      continue;
+    }
+
+    char entry[16];
+    if (level >= SCENE_DIM)
+    {
+      snprintf_P(entry, sizeof(entry), PSTR("%d:DIM%d"), i, level - SCENE_DIM);
+    }
+    else
+    {
+      snprintf_P(entry, sizeof(entry), PSTR("%d:%s"), i, level == SCENE_ON ? "ON" : "OFF");
+    }
+
+    if (ackLength > 0 && ackLength + 1 + strlen(entry) >= sizeof(ack))
+    {
+      mqttClient.publish(topic, ack);
+      ackLength = 0;
+    }
+    ackLength += snprintf_P(ack + ackLength, sizeof(ack) - ackLength, PSTR("%s%s"), ackLength > 0 ? "," : "", entry);
+  }
+  mqttClient.publish(topic, ack);
+}
+
+void handleScene(const char *action, const char *text)
+{
+  if (strcmp(action, "run") == 0)
+  {
+    int index = scenes.find(text);
+    if (index >= 0)
+    {
+      runScene(index);
+    }
+    else
+    {
+      Serial.println(", Unknown scene");
+    }
+    return;
+  }
+
+  bool changed = false;
+  if (strcmp(action, "define") == 0)
+  {
+    changed = scenes.define(text) >= 0;
+  }
+  else if (strcmp(action, "remove") == 0)
+  {
+    changed = scenes.remove(text);
+  }
+
+  Serial.println(changed ? ", Scenes changed" : ", Invalid scene");
+  if (changed)
+  {
+    scenes.save();
+    publishScenes();
+  }
+}
+
+void queueCommand(int channel, bool switchOn, byte source)
+{
+  commandStats.received++;
+  if (!rfQueue.push({(byte)channel, switchOn, millis(), source}))
+  {
+    Serial.println("RF queue full, command dropped");
+    commandStats.dropped++;
+    return;
+  }
+  setChannelState(channel, switchOn);
+}
+
+void handleMessage(char* topic, uint8_t * payload, unsigned int length) {
+  // Compare against the base topic in place, without building Strings
+  size_t baseLength = mqttBaseTopic.length();
+  if(strncmp(topic, mqttBaseTopic.c_str(), baseLength) != 0) {
+    return;
+  }
+  const char *suffix = topic + baseLength;
+
+  // Echo of our own ping, not a command
+  if(strcmp(suffix, "/ping") == 0) {
+    String id = getUniqueID();
+    if(pingSentAt != 0 && length == id.length() && memcmp(payload, id.c_str(), length) == 0) {
+      Broker &broker = brokers[currentBroker];
+      uint32_t rtt = millis() - pingSentAt;
+      broker.pingRtt = broker.pingRtt > 0 ? (broker.pingRtt * 3 + rtt) / 4 : max(rtt, 1u);
+      pingEchoedAt = millis();
+    }
+    return;
+  }
+
   Serial.print("Message arrived, ");
 
-  if(_topic == mqttBaseTopic + "/reset") {
+  if(strcmp(suffix, "/reset") == 0) {
     Serial.println("Reset requested.");
     LittleFS.remove("hasSetup");
+    recorder.flush();
     delay(1000);
     ESP.restart();
   }
 
-  int channel = -1;
-  char c1 = _topic.charAt(mqttBaseTopic.length()+8);
-  char c2 = _topic.charAt(mqttBaseTopic.length()+9);
-  char c3 = _topic.charAt(mqttBaseTopic.length()+10);
+  handleCommand(suffix, payload, length, RF_SOURCE_MQTT);
+}
 
-  if(c2 == '/' && c1 >= '0' && c1 <= '9') {
-    // Single digit
-    channel = c1 - '0';
-  } else if(c3 == '/' && c1 == '1' && c2 >= '0' && c2 <= '5') {
-    // Single digit
-    channel = 10 + (c2 - '0');
+// Commands by topic below the base topic, from MQTT or the LAN
+void handleCommand(const char *suffix, uint8_t *payload, size_t length, byte source) {
+  // A command ending in "#<sequence>" is only carried out once
+  size_t mark = length;
+  while(mark > 0 && isdigit(payload[mark - 1])) {
+    mark--;
+  }
+  if(mark > 0 && mark < length && payload[mark - 1] == '#') {
+    uint32_t sequence = 0;
+    for(size_t i = mark; i < length; i++) {
+      sequence = sequence * 10 + (payload[i] - '0');
+    }
+    length = mark - 1;
+
+    if(!commandCache.remember(suffix, sequence)) {
+      // Acknowledged by the next state snapshot instead of sending it again
+      Serial.println("Duplicate command");
+      commandStats.duplicates++;
+      stateDirty = true;
+      return;
+    }
+  }
+
+  if(strcmp(suffix, "/batch") == 0) {
+    handleBatch(payload, length, source);
+    return;
+  }
+
+  if(strcmp(suffix, "/rflog/dump") == 0) {
+    Serial.println("RF log dump");
+    publishLog();
+    return;
+  }
+
+#ifdef UDP_PORT
+  if(strcmp(suffix, "/udp/key") == 0) {
+    if(source != RF_SOURCE_MQTT) {
+      // Anyone on the network could take over the panels
+      Serial.println("UDP key can only be set over MQTT");
+      return;
+    }
+    Serial.println("UDP key changed");
+    File file = LittleFS.open("udpKey", "w");
+    if(file) {
+      file.write(payload, length);
+      file.close();
+    }
+    udpControl.setKey((const char *)payload, length);
+    udpControl.forgetPanels();
+    return;
+  }
+#endif
+
+  // Payload as a string, for the commands that take text. Scene
+  // definitions are the longest, the client buffer limits them anyway.
+  char text[256];
+  size_t textLength = min(length, sizeof(text) - 1);
+  memcpy(text, payload, textLength);
+  text[textLength] = '\0';
+
+  if(strncmp(suffix, "/schedule/", 10) == 0) {
+    handleSchedule(suffix + 10, text);
+    return;
+  }
+
+  if(strncmp(suffix, "/scene/", 7) == 0) {
+    handleScene(suffix + 7, text);
+    return;
+  }
+
+  if(strncmp(suffix, "/channel", 8) != 0) {
+    return;
+  }
+
+  // At most two digits without a leading zero, followed by the action
+  int channel = -1;
+  const char *action = suffix + 8;
+  if(action[0] >= '0' && action[0] <= '9') {
+    channel = *action++ - '0';
+    if(channel > 0 && action[0] >= '0' && action[0] <= '9') {
+      channel = channel * 10 + (*action++ - '0');
+    }
   }
 
   Serial.print("Channel: ");
   Serial.print(channel, DEC);
 
-  if(channel < 0 || channel >= 16) {
+  if(channel < 0 || channel >= NUM_OF_UNITS || action[0] != '/') {
     return;
   }
 
-  String answerTopic = mqttBaseTopic + "/channel" + String(channel);
-  
-  if(length >= 2 && payload[0] == 'O' && payload[1] == 'N') {
-    Serial.println(", Turn on");
-    mqttClient.publish(answerTopic.c_str(), "ON",true);
-    transmitter.sendUnit(channel,true);
+  if(strcmp(action, "/protocol") == 0) {
+    // Payload like "elro 21 2"
+    if(channels.configure(channel, text)) {
+      Serial.println(", Protocol: " + channels.describe(channel));
+      channels.save();
+    } else {
+      Serial.println(", Invalid protocol");
+    }
+    return;
+  }
+
+  if(strcmp(action, "/set") != 0) {
+    return;
   }
 
-  if(length >= 3 && payload[0] == 'O' && payload[1] == 'F' && payload[2] == 'F') {
+  if(length >= 2 && payload[0] == 'O' && payload[1] == 'N') {
+    Serial.println(", Turn on");
+    queueCommand(channel, true, source);
+  } else if(length >= 3 && payload[0] == 'O' && payload[1] == 'F' && payload[2] == 'F') {
     Serial.println(", Turn off");
-    mqttClient.publish(answerTopic.c_str(), "OFF", true);
-    transmitter.sendUnit(channel,false);
+    queueCommand(channel, false, source);
   }
 }
\ No newline at end of file
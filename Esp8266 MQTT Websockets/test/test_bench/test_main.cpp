@@ -0,0 +1,191 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <unity.h>
+#include "ChannelTable.h"
+#include "NewRemoteTransmitter.h"
+#include "RfQueue.h"
+#include "SceneTable.h"
+
+/*
+ * Benchmarks of the hot paths on the host, run with
+ *
+ *   pio test -e native -f test_bench -v
+ *
+ * Each benchmark prints one line like
+ *
+ *   bench=urlencode,iterations=262144,ns_per_op=183.2
+ *
+ * for scripts that compare runs. A name only changes when what it measures
+ * changes, so results stay comparable across commits.
+ */
+
+#define BENCH_MIN_NANOS 200000000ULL // Time at least 200 ms per benchmark
+#define BENCH_MAX_ITERATIONS (1UL << 30)
+
+// From main.cpp
+void handleMessage(char *topic, uint8_t *payload, unsigned int length);
+String readFile(const char *path);
+void writeFile(const char *path, String data);
+void parseMQTTConfig(String &payload);
+String urlencode(String str);
+extern String mqttBaseTopic;
+extern ChannelTable channels;
+extern RfQueue rfQueue;
+extern ScenePlan scenePlan;
+
+static volatile uint32_t sink; // Keeps results from being optimised away
+
+static uint64_t nanos()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * Run body often enough to time it, doubling the iterations until one run
+ * takes BENCH_MIN_NANOS, and print the result.
+ */
+template <typename Body>
+static void bench(const char *name, Body body)
+{
+  body(); // Warm up caches and lazy allocations
+
+  unsigned long iterations = 1;
+  uint64_t elapsed;
+  for (;;)
+  {
+    uint64_t start = nanos();
+    for (unsigned long i = 0; i < iterations; i++)
+    {
+      body();
+    }
+    elapsed = nanos() - start;
+    if (elapsed >= BENCH_MIN_NANOS || iterations >= BENCH_MAX_ITERATIONS)
+    {
+      break;
+    }
+    iterations *= 2;
+  }
+
+  printf("bench=%s,iterations=%lu,ns_per_op=%.1f\n", name, iterations, (double)elapsed / iterations);
+}
+
+static void message(const char *topic, const char *payload)
+{
+  char buffer[128];
+  strncpy(buffer, topic, sizeof(buffer) - 1);
+  buffer[sizeof(buffer) - 1] = '\0';
+  handleMessage(buffer, (uint8_t *)payload, strlen(payload));
+}
+
+void setUp()
+{
+  RfCommand command;
+  while (rfQueue.pop(command))
+  {
+  }
+  scenePlan.clear();
+}
+
+void tearDown()
+{
+}
+
+void test_handle_message_set()
+{
+  message("kaku/bench/channel3/set", "ON");
+  RfCommand command;
+  TEST_ASSERT_TRUE(rfQueue.pop(command));
+  TEST_ASSERT_EQUAL(3, command.channel);
+  TEST_ASSERT_TRUE(command.switchOn);
+
+  bool on = false;
+  bench("handle_message_set", [&]()
+        {
+          on = !on;
+          message("kaku/bench/channel3/set", on ? "ON" : "OFF");
+          rfQueue.pop(command);
+          sink += command.switchOn;
+        });
+}
+
+void test_handle_message_foreign()
+{
+  bench("handle_message_foreign", []()
+        { message("other/bridge/channel3/set", "ON"); });
+  TEST_ASSERT_EQUAL(0, rfQueue.size());
+}
+
+void test_handle_message_batch()
+{
+  message("kaku/bench/batch", "0:ON,3:OFF,7:DIM8,12:ON");
+  TEST_ASSERT_TRUE(scenePlan.size() > 0);
+
+  bench("handle_message_batch", []()
+        {
+          message("kaku/bench/batch", "0:ON,3:OFF,7:DIM8,12:ON");
+          SceneFrame frame;
+          while (scenePlan.pop(frame))
+          {
+            sink += frame.unit;
+          }
+        });
+}
+
+void test_encode_telegram()
+{
+  byte pulses[NewRemoteTransmitter::maxPulses];
+  TEST_ASSERT_TRUE(NewRemoteTransmitter::encodeTelegram(0x123456, false, NewRemoteTransmitter::SWITCH_ON, 3, 0, pulses) > 0);
+
+  bench("encode_telegram", [&]()
+        { sink += NewRemoteTransmitter::encodeTelegram(0x123456, false, NewRemoteTransmitter::SWITCH_ON, 3, 0, pulses); });
+  bench("encode_telegram_dim", [&]()
+        { sink += NewRemoteTransmitter::encodeTelegram(0x123456, false, NewRemoteTransmitter::SWITCH_DIM, 3, 9, pulses); });
+}
+
+void test_config_load()
+{
+  writeFile("mqttConfig", "broker.example.com\n8883\nbridge\nsecret\nbridge-123456\nkaku/123456\n");
+  String payload = readFile("mqttConfig");
+  TEST_ASSERT_TRUE(payload.startsWith("broker.example.com"));
+
+  bench("config_read_file", []()
+        { sink += readFile("mqttConfig").length(); });
+  bench("config_parse", [&]()
+        {
+          String copy = payload;
+          parseMQTTConfig(copy);
+          sink += copy.length();
+        });
+
+  // parseMQTTConfig() replaced it
+  mqttBaseTopic = "kaku/bench";
+}
+
+void test_urlencode()
+{
+  TEST_ASSERT_EQUAL_STRING("a+b%2Bc", urlencode("a b+c").c_str());
+
+  bench("urlencode", []()
+        { sink += urlencode("Jan de Vries+bridge@example.com, pa$$ word").length(); });
+}
+
+int main(int argc, char **argv)
+{
+  LittleFS.begin();
+  channels.begin(0x123456);
+  mqttBaseTopic = "kaku/bench";
+
+  // The firmware logs every command, which is not what is measured
+  setSerialOutput(nullptr);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_handle_message_set);
+  RUN_TEST(test_handle_message_foreign);
+  RUN_TEST(test_handle_message_batch);
+  RUN_TEST(test_encode_telegram);
+  RUN_TEST(test_config_load);
+  RUN_TEST(test_urlencode);
+  return UNITY_END();
+}
@@ -0,0 +1,128 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <vector>
+#include "I2sTransmitter.h"
+#include "RemoteProtocols.h"
+
+/*
+ * Bitstreams of the I2S transmitter, run with
+ * "pio test -e native -f test_i2s". The rendered words are decoded back into
+ * edges and compared with the symbol timing of every protocol.
+ */
+
+static uint32_t words[I2S_MAX_WORDS];
+
+/**
+ * Times in us of every change of the output, most significant bit first.
+ * The line starts low, so the first edge is the rise of the first pulse.
+ */
+static std::vector<unsigned long> decodeEdges(const uint32_t *samples, size_t count, unsigned int sampleusec)
+{
+  std::vector<unsigned long> edges;
+  bool level = false;
+  for (size_t bit = 0; bit < count * 32; bit++)
+  {
+    bool value = samples[bit / 32] & (0x80000000UL >> (bit % 32));
+    if (value != level)
+    {
+      edges.push_back(bit * sampleusec);
+      level = value;
+    }
+  }
+  return edges;
+}
+
+/**
+ * Render a telegram and check that every edge is on the sample nearest to
+ * its nominal time, so pulse errors never add up over the telegram.
+ */
+template <class Protocol>
+static void assertRendered(byte switchType, byte dimLevel)
+{
+  byte symbols[Protocol::maxSymbols];
+  byte count = Protocol::encode(0x123456, 3, switchType, dimLevel, symbols);
+  NewRemoteTransmitter::SymbolTiming timing = protocolTiming<Protocol>();
+
+  size_t rendered = I2sTransmitter::renderTelegram(symbols, count, timing, I2S_SAMPLE_USEC, words, I2S_MAX_WORDS);
+  TEST_ASSERT_TRUE(rendered > 0);
+
+  std::vector<unsigned long> edges = decodeEdges(words, rendered, I2S_SAMPLE_USEC);
+  TEST_ASSERT_EQUAL(2 * count, edges.size());
+
+  unsigned long elapsed = 0;
+  for (byte i = 0; i < count; i++)
+  {
+    byte symbol = symbols[i] & 3;
+    unsigned long expected[] = {elapsed, elapsed + timing.high[symbol]};
+    for (byte j = 0; j < 2; j++)
+    {
+      unsigned long actual = edges[2 * i + j];
+      unsigned long error = actual > expected[j] ? actual - expected[j] : expected[j] - actual;
+      TEST_ASSERT_TRUE(error <= I2S_SAMPLE_USEC / 2);
+    }
+    elapsed += timing.high[symbol] + timing.low[symbol];
+  }
+
+  // The stop gap is rendered in full, only the rest of the last word is padding
+  TEST_ASSERT_TRUE(rendered * 32 * I2S_SAMPLE_USEC + I2S_SAMPLE_USEC / 2 >= elapsed);
+  TEST_ASSERT_TRUE((rendered - 1) * 32 * I2S_SAMPLE_USEC < elapsed);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_render_kaku()
+{
+  assertRendered<KakuProtocol>(NewRemoteTransmitter::SWITCH_ON, 0);
+  assertRendered<KakuProtocol>(NewRemoteTransmitter::SWITCH_OFF, 0);
+  assertRendered<KakuGroupProtocol>(NewRemoteTransmitter::SWITCH_ON, 0);
+}
+
+void test_render_kaku_dim_fits()
+{
+  // The longest telegram has to fit in the buffer
+  assertRendered<KakuProtocol>(NewRemoteTransmitter::SWITCH_DIM, 15);
+  assertRendered<KakuGroupProtocol>(NewRemoteTransmitter::SWITCH_DIM, 15);
+}
+
+void test_render_trit()
+{
+  assertRendered<KakuOldProtocol>(NewRemoteTransmitter::SWITCH_ON, 0);
+  assertRendered<ActionProtocol>(NewRemoteTransmitter::SWITCH_OFF, 0);
+  assertRendered<ElroProtocol>(NewRemoteTransmitter::SWITCH_ON, 0);
+}
+
+void test_render_too_small()
+{
+  byte symbols[KakuProtocol::maxSymbols];
+  byte count = KakuProtocol::encode(0x123456, 3, NewRemoteTransmitter::SWITCH_ON, 0, symbols);
+  TEST_ASSERT_EQUAL(0, I2sTransmitter::renderTelegram(symbols, count, protocolTiming<KakuProtocol>(), I2S_SAMPLE_USEC, words, 8));
+}
+
+void test_find_dividers()
+{
+  uint8_t div1, div2;
+  TEST_ASSERT_TRUE(I2sTransmitter::findDividers(160UL * I2S_SAMPLE_USEC, div1, div2));
+  TEST_ASSERT_EQUAL(160UL * I2S_SAMPLE_USEC, div1 * div2);
+  TEST_ASSERT_TRUE(div1 >= 2 && div1 <= 63 && div2 >= 2 && div2 <= 63);
+
+  // A prime, and a product above 63 * 63
+  TEST_ASSERT_FALSE(I2sTransmitter::findDividers(1601, div1, div2));
+  TEST_ASSERT_FALSE(I2sTransmitter::findDividers(64 * 64, div1, div2));
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_render_kaku);
+  RUN_TEST(test_render_kaku_dim_fits);
+  RUN_TEST(test_render_trit);
+  RUN_TEST(test_render_too_small);
+  RUN_TEST(test_find_dividers);
+  return UNITY_END();
+}
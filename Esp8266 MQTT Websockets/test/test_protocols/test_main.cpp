@@ -0,0 +1,102 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "RemoteProtocols.h"
+
+/*
+ * Symbol lists of the protocol descriptions in RemoteProtocols.h, run with
+ * "pio test -e native -f test_protocols".
+ */
+
+static byte symbols[NewRemoteTransmitter::maxPulses];
+
+// Frames of the same channel, with the dim level ignored where it does not apply
+template <class Protocol>
+static void assertSameFrame(byte switchType, byte otherType)
+{
+  byte other[NewRemoteTransmitter::maxPulses];
+  byte count = Protocol::encode(9, 2, switchType, 7, symbols);
+  byte otherCount = Protocol::encode(9, 2, otherType, 0, other);
+  TEST_ASSERT_EQUAL(Protocol::maxSymbols, count);
+  TEST_ASSERT_EQUAL(count, otherCount);
+  TEST_ASSERT_EQUAL(0, memcmp(symbols, other, count));
+}
+
+template <class Protocol>
+static void assertOnDiffersFromOff()
+{
+  byte off[NewRemoteTransmitter::maxPulses];
+  byte count = Protocol::encode(9, 2, NewRemoteTransmitter::SWITCH_ON, 0, symbols);
+  Protocol::encode(9, 2, NewRemoteTransmitter::SWITCH_OFF, 0, off);
+  TEST_ASSERT_TRUE(memcmp(symbols, off, count) != 0);
+  TEST_ASSERT_EQUAL(2, symbols[count - 1]);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_trit_dim_switches_on()
+{
+  // Only KaKu can dim, the others switch on instead of off
+  assertSameFrame<KakuOldProtocol>(NewRemoteTransmitter::SWITCH_DIM, NewRemoteTransmitter::SWITCH_ON);
+  assertSameFrame<ActionProtocol>(NewRemoteTransmitter::SWITCH_DIM, NewRemoteTransmitter::SWITCH_ON);
+  assertSameFrame<ElroProtocol>(NewRemoteTransmitter::SWITCH_DIM, NewRemoteTransmitter::SWITCH_ON);
+}
+
+void test_trit_on_and_off()
+{
+  assertOnDiffersFromOff<KakuOldProtocol>();
+  assertOnDiffersFromOff<ActionProtocol>();
+  assertOnDiffersFromOff<ElroProtocol>();
+}
+
+void test_kaku_old_frame()
+{
+  // Address C (2) unit 3, on: trits 0 2 0 0 | 2 2 0 0 | 0 2 2 | 2
+  static const byte expected[] = {
+      0, 0, 0, 1, 0, 0, 0, 0,
+      0, 1, 0, 1, 0, 0, 0, 0,
+      0, 0, 0, 1, 0, 1,
+      0, 1,
+      2};
+  byte count = KakuOldProtocol::encode(2, 3, NewRemoteTransmitter::SWITCH_ON, 0, symbols);
+  TEST_ASSERT_EQUAL(sizeof(expected), count);
+  TEST_ASSERT_EQUAL(0, memcmp(expected, symbols, count));
+
+  // Dimming to any level is the same command
+  KakuOldProtocol::encode(2, 3, NewRemoteTransmitter::SWITCH_DIM, 15, symbols);
+  TEST_ASSERT_EQUAL(0, memcmp(expected, symbols, count));
+}
+
+void test_kaku_dim_differs_from_on()
+{
+  byte on[NewRemoteTransmitter::maxPulses];
+  byte onCount = KakuProtocol::encode(0x123456, 3, NewRemoteTransmitter::SWITCH_ON, 0, on);
+  byte count = KakuProtocol::encode(0x123456, 3, NewRemoteTransmitter::SWITCH_DIM, 9, symbols);
+  TEST_ASSERT_TRUE(count > onCount);
+}
+
+void test_protocol_telegrams()
+{
+  // What the RF log records as repeats
+  TEST_ASSERT_EQUAL(16, protocolTelegrams(PROTOCOL_KAKU, false));
+  TEST_ASSERT_EQUAL(16, protocolTelegrams(PROTOCOL_KAKU_OLD, true));
+  TEST_ASSERT_EQUAL(8, protocolTelegrams(PROTOCOL_KAKU_OLD, false));
+  TEST_ASSERT_EQUAL(8, protocolTelegrams(PROTOCOL_ACTION, false));
+  TEST_ASSERT_EQUAL(8, protocolTelegrams(PROTOCOL_ELRO, false));
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_trit_dim_switches_on);
+  RUN_TEST(test_trit_on_and_off);
+  RUN_TEST(test_kaku_old_frame);
+  RUN_TEST(test_kaku_dim_differs_from_on);
+  RUN_TEST(test_protocol_telegrams);
+  return UNITY_END();
+}
@@ -0,0 +1,176 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <vector>
+#include "NewRemoteTransmitter.h"
+#include "RfDecoder.h"
+
+/*
+ * Edge traces replayed through RfDecoder, run with
+ * "pio test -e native -f test_rfdecoder". Traces are the durations between
+ * edges as a receiver reports them, built from the transmitter's encoder.
+ */
+
+#define TRACE_ADDRESS 0x2ABCDEF
+#define TRACE_IDLE 20000 // Quiet time before a transmission, in us
+
+static RfDecoder decoder;
+
+/**
+ * Durations of one telegram, from the rise of the start pulse to the end
+ * of the stop gap, with every high stretched by stretch us.
+ */
+static std::vector<uint16_t> telegram(unsigned int period, boolean group, byte switchType, byte unit, byte dimLevel,
+                                      int stretch = 0)
+{
+  NewRemoteTransmitter transmitter(TRACE_ADDRESS, 4, period);
+  byte pulses[NewRemoteTransmitter::maxPulses];
+  byte count = NewRemoteTransmitter::encodeTelegram(TRACE_ADDRESS, group, switchType, unit, dimLevel, pulses);
+
+  std::vector<uint16_t> durations;
+  for (byte i = 0; i < count; i++)
+  {
+    durations.push_back(period + stretch);
+    durations.push_back(transmitter.pulseLowTime(pulses[i]) - stretch);
+  }
+  return durations;
+}
+
+/**
+ * Feed durations and return the number of codes decoded, the last one in
+ * code.
+ */
+static int feed(const std::vector<uint16_t> &durations, RfCode &code)
+{
+  int codes = 0;
+  RfCode decoded;
+  for (uint16_t duration : durations)
+  {
+    if (decoder.feed(duration, decoded))
+    {
+      code = decoded;
+      codes++;
+    }
+  }
+  return codes;
+}
+
+static void assertCode(const RfCode &code, boolean group, byte switchType, byte unit, byte dimLevel)
+{
+  TEST_ASSERT_EQUAL(TRACE_ADDRESS, code.address);
+  TEST_ASSERT_EQUAL(group, code.group);
+  TEST_ASSERT_EQUAL(switchType, code.switchType);
+  TEST_ASSERT_EQUAL(unit, code.unit);
+  TEST_ASSERT_EQUAL(dimLevel, code.dimLevel);
+}
+
+void setUp()
+{
+  decoder = RfDecoder();
+  RfCode code;
+  decoder.feed(TRACE_IDLE, code);
+}
+
+void tearDown()
+{
+}
+
+void test_decode_on_off()
+{
+  RfCode code;
+  TEST_ASSERT_EQUAL(1, feed(telegram(260, false, NewRemoteTransmitter::SWITCH_ON, 11, 0), code));
+  assertCode(code, false, NewRemoteTransmitter::SWITCH_ON, 11, 0);
+  TEST_ASSERT_EQUAL(1, feed(telegram(260, false, NewRemoteTransmitter::SWITCH_OFF, 11, 0), code));
+  assertCode(code, false, NewRemoteTransmitter::SWITCH_OFF, 11, 0);
+  TEST_ASSERT_EQUAL(0, decoder.stats.errors);
+}
+
+void test_decode_dim()
+{
+  RfCode code;
+  TEST_ASSERT_EQUAL(1, feed(telegram(260, false, NewRemoteTransmitter::SWITCH_DIM, 11, 9), code));
+  assertCode(code, false, NewRemoteTransmitter::SWITCH_DIM, 11, 9);
+}
+
+void test_decode_group()
+{
+  RfCode code;
+  TEST_ASSERT_EQUAL(1, feed(telegram(260, true, NewRemoteTransmitter::SWITCH_ON, 0, 0), code));
+  assertCode(code, true, NewRemoteTransmitter::SWITCH_ON, 0, 0);
+  TEST_ASSERT_EQUAL(1, feed(telegram(260, true, NewRemoteTransmitter::SWITCH_DIM, 0, 15), code));
+  assertCode(code, true, NewRemoteTransmitter::SWITCH_DIM, 0, 15);
+}
+
+void test_decode_drifted_period()
+{
+  // Remotes that run slow or fast, and a receiver that stretches highs
+  static const unsigned int periods[] = {200, 330, 360};
+  for (unsigned int period : periods)
+  {
+    RfCode code;
+    unsigned int stretch = period / 4;
+    TEST_ASSERT_EQUAL(1, feed(telegram(period, false, NewRemoteTransmitter::SWITCH_ON, 5, 0, stretch), code));
+    assertCode(code, false, NewRemoteTransmitter::SWITCH_ON, 5, 0);
+
+    // The period is measured from the start gap, which loses what the high gained
+    unsigned int measured = (period * 21 / 2 - stretch) * 2 / 21;
+    TEST_ASSERT_TRUE(code.period >= measured - 1 && code.period <= measured + 1);
+  }
+}
+
+void test_decode_truncated()
+{
+  // The transmission stops halfway, the next telegram still decodes
+  std::vector<uint16_t> trace = telegram(260, false, NewRemoteTransmitter::SWITCH_ON, 3, 0);
+  trace.resize(trace.size() / 2);
+  trace.push_back(TRACE_IDLE);
+
+  RfCode code;
+  TEST_ASSERT_EQUAL(0, feed(trace, code));
+  TEST_ASSERT_EQUAL(1, decoder.stats.errors);
+
+  TEST_ASSERT_EQUAL(1, feed(telegram(260, false, NewRemoteTransmitter::SWITCH_OFF, 3, 0), code));
+  assertCode(code, false, NewRemoteTransmitter::SWITCH_OFF, 3, 0);
+}
+
+void test_decode_joined_mid_telegram()
+{
+  // Listening starts in the middle of a repeat, the one after it counts
+  std::vector<uint16_t> first = telegram(260, false, NewRemoteTransmitter::SWITCH_ON, 7, 0);
+  std::vector<uint16_t> trace(first.begin() + 31, first.end());
+  std::vector<uint16_t> second = telegram(260, false, NewRemoteTransmitter::SWITCH_ON, 7, 0);
+  trace.insert(trace.end(), second.begin(), second.end());
+
+  RfCode code;
+  TEST_ASSERT_EQUAL(1, feed(trace, code));
+  assertCode(code, false, NewRemoteTransmitter::SWITCH_ON, 7, 0);
+  TEST_ASSERT_EQUAL(1, decoder.stats.syncs);
+}
+
+void test_decode_sync_mid_telegram()
+{
+  // Another remote starts while a telegram is half done: its start gap
+  // ends the broken telegram and starts the new one
+  std::vector<uint16_t> trace = telegram(260, false, NewRemoteTransmitter::SWITCH_ON, 1, 0);
+  trace.resize(40);
+  std::vector<uint16_t> other = telegram(260, false, NewRemoteTransmitter::SWITCH_OFF, 2, 0);
+  trace.insert(trace.end(), other.begin() + 1, other.end());
+
+  RfCode code;
+  TEST_ASSERT_EQUAL(1, feed(trace, code));
+  assertCode(code, false, NewRemoteTransmitter::SWITCH_OFF, 2, 0);
+  TEST_ASSERT_EQUAL(1, decoder.stats.errors);
+  TEST_ASSERT_EQUAL(2, decoder.stats.syncs);
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_decode_on_off);
+  RUN_TEST(test_decode_dim);
+  RUN_TEST(test_decode_group);
+  RUN_TEST(test_decode_drifted_period);
+  RUN_TEST(test_decode_truncated);
+  RUN_TEST(test_decode_joined_mid_telegram);
+  RUN_TEST(test_decode_sync_mid_telegram);
+  return UNITY_END();
+}
@@ -0,0 +1,178 @@
+#include <Arduino.h>
+#include <Native.h>
+#include <unity.h>
+#include <algorithm>
+#include <vector>
+#include "NewRemoteTransmitter.h"
+
+/*
+ * Golden waveforms of the KaKu transmitter, run with
+ *
+ *   pio test -e native -f test_transmitter -v
+ *
+ * Every pin write is captured through the pin-write hook and the pulses are
+ * compared with reference frames written out by hand from the protocol,
+ * so a change to the encoder cannot move its own reference. Each command
+ * prints one line like
+ *
+ *   waveform=send_unit,pulses=264,error_p50=0,error_p99=6,error_max=207,air_time=321350,nominal_air_time=320840
+ *
+ * with the distribution of the per-pulse error against the nominal
+ * duration and the air time of all telegrams, in us. Host timing is only
+ * as good as the scheduler, so the shape is checked exactly and the
+ * errors only loosely: a pulse has to match in at least one telegram.
+ */
+
+#define WAVEFORM_PIN 4
+#define WAVEFORM_PERIOD 260
+#define WAVEFORM_REPEATS 2 // 4 telegrams per command
+#define WAVEFORM_ADDRESS 0x1234567
+#define WAVEFORM_MAX_ERROR_P50 50 // us
+
+/*
+ * Reference frames: S start, then one character per bit of the address
+ * (26), group, switch, unit (4) and dim level (4, dim only), P stop. D is
+ * the dim switch bit. Spaces are for reading only.
+ */
+#define GOLDEN_ADDRESS "01 0010 0011 0100 0101 0110 0111"
+
+struct Edge
+{
+  unsigned long at; // micros()
+  uint8_t value;
+};
+
+static NewRemoteTransmitter transmitter(WAVEFORM_ADDRESS, WAVEFORM_PIN, WAVEFORM_PERIOD, WAVEFORM_REPEATS);
+static std::vector<Edge> edges;
+
+static void capture(uint8_t pin, uint8_t value)
+{
+  if (pin == WAVEFORM_PIN)
+  {
+    edges.push_back({micros(), value});
+  }
+}
+
+/**
+ * High and low time in us of every pulse of a reference frame, in order.
+ */
+static std::vector<unsigned long> goldenDurations(const char *frame)
+{
+  const unsigned long T = WAVEFORM_PERIOD;
+  std::vector<unsigned long> durations;
+  for (const char *c = frame; *c != '\0'; c++)
+  {
+    switch (*c)
+    {
+    case 'S':
+      durations.insert(durations.end(), {T, T * 10 + T / 2});
+      break;
+    case '0':
+      durations.insert(durations.end(), {T, T, T, T * 5});
+      break;
+    case '1':
+      durations.insert(durations.end(), {T, T * 5, T, T});
+      break;
+    case 'D':
+      durations.insert(durations.end(), {T, T, T, T});
+      break;
+    case 'P':
+      durations.insert(durations.end(), {T, T * 40});
+      break;
+    }
+  }
+  return durations;
+}
+
+/**
+ * Run a command, compare what reached the pin with the reference frame
+ * repeated for every telegram and print the error distribution.
+ */
+template <typename Command>
+static void assertWaveform(const char *name, const char *frame, Command command)
+{
+  edges.clear();
+  setPinWriteHook(capture);
+  command();
+  unsigned long end = micros();
+  setPinWriteHook(nullptr);
+
+  std::vector<unsigned long> golden = goldenDurations(frame);
+  std::vector<unsigned long> expected;
+  for (int i = 0; i < 1 << WAVEFORM_REPEATS; i++)
+  {
+    expected.insert(expected.end(), golden.begin(), golden.end());
+  }
+  TEST_ASSERT_EQUAL(expected.size(), edges.size());
+
+  unsigned long nominal = 0;
+  std::vector<unsigned long> errors;
+  std::vector<unsigned long> shortest(golden.size(), ULONG_MAX);
+  for (size_t i = 0; i < edges.size(); i++)
+  {
+    // The pin alternates, starting high, and the last low lasts until the command returns
+    TEST_ASSERT_EQUAL(i % 2 == 0 ? HIGH : LOW, edges[i].value);
+    unsigned long duration = (i + 1 < edges.size() ? edges[i + 1].at : end) - edges[i].at;
+
+    unsigned long error = duration > expected[i] ? duration - expected[i] : expected[i] - duration;
+    errors.push_back(error);
+    nominal += expected[i];
+    shortest[i % golden.size()] = min(shortest[i % golden.size()], duration);
+  }
+
+  // A preempted host thread stretches a pulse, but never the same one in every telegram
+  for (size_t i = 0; i < golden.size(); i++)
+  {
+    unsigned long error = shortest[i] > golden[i] ? shortest[i] - golden[i] : golden[i] - shortest[i];
+    TEST_ASSERT_TRUE_MESSAGE(error < WAVEFORM_PERIOD / 2, "pulse does not match the reference frame");
+  }
+
+  std::sort(errors.begin(), errors.end());
+  unsigned long p50 = errors[errors.size() / 2];
+  printf("waveform=%s,pulses=%u,error_p50=%lu,error_p99=%lu,error_max=%lu,air_time=%lu,nominal_air_time=%lu\n",
+         name, (unsigned)errors.size() / 2, p50, errors[errors.size() * 99 / 100], errors.back(), end - edges[0].at, nominal);
+  TEST_ASSERT_TRUE(p50 <= WAVEFORM_MAX_ERROR_P50);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+  setPinWriteHook(nullptr);
+}
+
+void test_send_unit()
+{
+  assertWaveform("send_unit", "S " GOLDEN_ADDRESS " 0 1 0101 P", []()
+                 { transmitter.sendUnit(5, true); });
+}
+
+void test_send_group()
+{
+  assertWaveform("send_group", "S " GOLDEN_ADDRESS " 1 0 0000 P", []()
+                 { transmitter.sendGroup(false); });
+}
+
+void test_send_dim()
+{
+  assertWaveform("send_dim", "S " GOLDEN_ADDRESS " 0 D 1001 0111 P", []()
+                 { transmitter.sendDim(9, 7); });
+}
+
+void test_send_group_dim()
+{
+  assertWaveform("send_group_dim", "S " GOLDEN_ADDRESS " 1 D 0000 1111 P", []()
+                 { transmitter.sendGroupDim(15); });
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_send_unit);
+  RUN_TEST(test_send_group);
+  RUN_TEST(test_send_dim);
+  RUN_TEST(test_send_group_dim);
+  return UNITY_END();
+}
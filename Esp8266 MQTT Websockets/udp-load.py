@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+
+# Load generator for the binary UDP protocol of the bridge (build with
+# -D UDP_PORT=4210). Sends signed commands with the acknowledgement flag
+# and reports the round trip times, which bound the time from datagram to
+# queued command. The bridge publishes its own measurement of that time
+# on <base>/udp/stats.
+#
+#   ./udp-load.py --discover
+#   ./udp-load.py --host 192.168.1.20 --key secret --count 1000 --rate 50
+import argparse
+import hashlib
+import hmac
+import socket
+import struct
+import sys
+import time
+
+MAGIC = ord('K')
+COMMAND, ACK, DISCOVER, ANNOUNCE = 1, 2, 3, 4
+FLAG_ACK = 0x01
+SIGNED_SIZE = 12
+TAG_SIZE = 8
+
+
+def sign(key, head):
+    return head + hmac.new(key, head, hashlib.sha256).digest()[:TAG_SIZE]
+
+
+def packet(key, type, channel, action, level, flags, panel, sequence):
+    head = struct.pack('<BBBBBBHI', MAGIC, type, channel, action, level, flags, panel, sequence)
+    return sign(key, head) if key else head + bytes(TAG_SIZE)
+
+
+def discover(port, timeout):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_BROADCAST, 1)
+    sock.settimeout(timeout)
+    sock.sendto(packet(None, DISCOVER, 0, 0, 0, 0, 0, 0), ('255.255.255.255', port))
+
+    end = time.time() + timeout
+    while time.time() < end:
+        try:
+            data, address = sock.recvfrom(64)
+        except socket.timeout:
+            break
+        if len(data) == 20 and data[0] == MAGIC and data[1] == ANNOUNCE:
+            device, = struct.unpack_from('<I', data, 8)
+            print("%s  device %07x  %d channels" % (address[0], device, data[2]))
+
+
+def load(args):
+    key = args.key.encode()
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(args.timeout)
+
+    # The bridge drops sequence numbers that are not newer than the last
+    # one of the panel, also after it restarts, so continue from the clock
+    # instead of from zero
+    sequence = int(time.time() * 1000) & 0xFFFFFFFF
+    times = []
+    lost = 0
+    for i in range(args.count):
+        sequence = (sequence + 1) & 0xFFFFFFFF
+        action = i % 2 if args.level is None else 2
+        request = packet(key, COMMAND, args.channel, action, args.level or 0, FLAG_ACK, args.panel, sequence)
+
+        start = time.perf_counter()
+        sock.sendto(request, (args.host, args.port))
+        while True:
+            try:
+                data, _ = sock.recvfrom(64)
+            except socket.timeout:
+                lost += 1
+                break
+            if len(data) == 20 and data[1] == ACK and data[8:SIGNED_SIZE] == request[8:SIGNED_SIZE]:
+                if not hmac.compare_digest(sign(key, data[:SIGNED_SIZE]), data):
+                    sys.exit("Acknowledgement with a wrong HMAC, check the key")
+                times.append(time.perf_counter() - start)
+                break
+
+        time.sleep(max(0, 1.0 / args.rate - (time.perf_counter() - start)))
+
+    print("%d sent, %d acknowledged, %d lost" % (args.count, len(times), lost))
+    if times:
+        times.sort()
+        for name, fraction in (('p50', 0.50), ('p95', 0.95), ('p99', 0.99)):
+            print("%s %7.2f ms" % (name, times[min(len(times) - 1, int(fraction * len(times)))] * 1000))
+        print("max %7.2f ms" % (times[-1] * 1000))
+
+
+parser = argparse.ArgumentParser(description="Send signed UDP commands to the bridge and measure the round trip")
+parser.add_argument('--discover', action='store_true', help="list the bridges on the network")
+parser.add_argument('--host', help="address of the bridge")
+parser.add_argument('--port', type=int, default=4210)
+parser.add_argument('--key', help="shared key, as published on <base>/udp/key")
+parser.add_argument('--panel', type=int, default=0, help="panel id, the bridge tracks sequence numbers per panel")
+parser.add_argument('--channel', type=int, default=0)
+parser.add_argument('--level', type=int, help="dim to this level instead of toggling")
+parser.add_argument('--count', type=int, default=100)
+parser.add_argument('--rate', type=float, default=20, help="commands per second")
+parser.add_argument('--timeout', type=float, default=1.0)
+args = parser.parse_args()
+
+if args.discover:
+    discover(args.port, 2.0)
+elif args.host and args.key:
+    load(args)
+else:
+    parser.error("use --discover, or --host and --key")
@@ -0,0 +1,163 @@
+#include "Arduino.h"
+#include <chrono>
+#include <random>
+#include <thread>
+
+#define NUM_PINS 17
+
+HardwareSerial Serial;
+EspClass ESP;
+
+static const std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+static uint8_t pinLevels[NUM_PINS];
+static PinWriteHook pinWriteHook = nullptr;
+static FILE *serialOutput = stdout;
+static std::minstd_rand randomGenerator;
+
+static uint64_t elapsedNanos()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count();
+}
+
+unsigned long millis()
+{
+  return elapsedNanos() / 1000000;
+}
+
+unsigned long micros()
+{
+  return elapsedNanos() / 1000;
+}
+
+void delay(unsigned long ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  // Busy wait like the core, sleeping is far too coarse for RF pulses
+  uint64_t end = elapsedNanos() + us * 1000ULL;
+  while (elapsedNanos() < end)
+  {
+  }
+}
+
+void yield()
+{
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  if (pin < NUM_PINS)
+  {
+    pinLevels[pin] = value ? HIGH : LOW;
+  }
+  if (pinWriteHook != nullptr)
+  {
+    pinWriteHook(pin, value ? HIGH : LOW);
+  }
+}
+
+int digitalRead(uint8_t pin)
+{
+  return pin < NUM_PINS ? pinLevels[pin] : LOW;
+}
+
+void setPinWriteHook(PinWriteHook hook)
+{
+  pinWriteHook = hook;
+}
+
+long random(long max)
+{
+  return max > 0 ? random(0, max) : 0;
+}
+
+long random(long min, long max)
+{
+  if (min >= max)
+  {
+    return min;
+  }
+  return min + (long)(randomGenerator() % (unsigned long)(max - min));
+}
+
+void randomSeed(unsigned long seed)
+{
+  randomGenerator.seed(seed);
+}
+
+void configTime(int timezone, int daylightOffset, const char *server1, const char *server2, const char *server3)
+{
+  // The host clock is already synchronised
+}
+
+bool wifi_get_macaddr(uint8_t interface, uint8_t *mac)
+{
+  // Espressif prefix, the bridge derives its address from the last three bytes
+  static const uint8_t address[6] = {0x5C, 0xCF, 0x7F, 0x12, 0x34, 0x56};
+  memcpy(mac, address, sizeof(address));
+  return true;
+}
+
+void HardwareSerial::begin(unsigned long baud)
+{
+  // Whole lines, also when the output is a pipe
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+  if (serialOutput != nullptr)
+  {
+    fwrite(buffer, 1, size, serialOutput);
+  }
+  return size;
+}
+
+void HardwareSerial::flush()
+{
+  if (serialOutput != nullptr)
+  {
+    fflush(serialOutput);
+  }
+}
+
+void setSerialOutput(FILE *out)
+{
+  Serial.flush();
+  serialOutput = out;
+}
+
+uint32_t EspClass::getCycleCount()
+{
+  return (uint32_t)(elapsedNanos() * getCpuFreqMHz() / 1000);
+}
+
+void EspClass::restart()
+{
+  Serial.println("Restart requested, exiting");
+  Serial.flush();
+  exit(0);
+}
+
+#if !defined(PIO_UNIT_TESTING) && !defined(NATIVE_NO_MAIN)
+int main()
+{
+  setup();
+  for (;;)
+  {
+    loop();
+  }
+}
+#endif
@@ -0,0 +1,53 @@
+#ifndef ESP8266WIFI_h
+#define ESP8266WIFI_h
+
+#include <memory>
+#include "Arduino.h"
+#include "Client.h"
+
+#define WL_CONNECTED 3
+
+/**
+ * TCP client over a POSIX socket. Reads never block, like lwIP on the
+ * ESP8266; connected() stays true while received data is left. Copies
+ * share the connection.
+ */
+class WiFiClient : public Client
+{
+public:
+  WiFiClient();
+
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char *host, uint16_t port) override;
+  int connect(const String &host, uint16_t port) { return connect(host.c_str(), port); }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t *buffer, size_t size) override;
+  int peek() override;
+  void flush() override {}
+  void stop() override;
+  uint8_t connected() override;
+  operator bool() override { return connected(); }
+  void setNoDelay(bool noDelay);
+  using Print::write;
+
+private:
+  struct Socket;
+  std::shared_ptr<Socket> _socket;
+
+  bool _fill();
+};
+
+class WiFiClass
+{
+public:
+  String macAddress();
+  IPAddress localIP() { return IPAddress(127, 0, 0, 1); }
+  int status() { return WL_CONNECTED; }
+};
+
+extern WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef FS_h
+#define FS_h
+
+#include <memory>
+#include <stdio.h>
+#include "Arduino.h"
+
+namespace fs
+{
+  enum SeekMode
+  {
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2
+  };
+
+  /**
+   * A file in the directory that backs the file system. Copies share the
+   * open file, like on the ESP8266.
+   */
+  class File : public Stream
+  {
+  public:
+    File() {}
+    File(FILE *file, bool directory);
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t *buffer, size_t size) override;
+    int available() override;
+    int read() override;
+    size_t read(uint8_t *buffer, size_t size);
+    int peek() override;
+    void flush() override;
+    bool seek(uint32_t position, SeekMode mode);
+    bool seek(uint32_t position) { return seek(position, SeekSet); }
+    size_t position() const;
+    size_t size() const;
+    void close();
+    explicit operator bool() const { return _file != nullptr || _directory; }
+    bool isDirectory() const { return _directory; }
+    bool isFile() const { return _file != nullptr; }
+    using Print::write;
+
+  private:
+    std::shared_ptr<FILE> _file;
+    bool _directory = false;
+    bool _writing = false; // stdio needs a seek between writing and reading
+
+    void _switchTo(bool writing);
+  };
+
+  class FS
+  {
+  public:
+    bool begin();
+    void end() {}
+    bool format();
+    File open(const char *path, const char *mode);
+    File open(const String &path, const char *mode) { return open(path.c_str(), mode); }
+    bool exists(const char *path);
+    bool exists(const String &path) { return exists(path.c_str()); }
+    bool remove(const char *path);
+    bool remove(const String &path) { return remove(path.c_str()); }
+    bool rename(const char *from, const char *to);
+    bool mkdir(const char *path);
+
+  private:
+    String _path(const char *path) const;
+  };
+}
+
+using fs::File;
+using fs::FS;
+using fs::SeekCur;
+using fs::SeekEnd;
+using fs::SeekMode;
+using fs::SeekSet;
+
+#endif
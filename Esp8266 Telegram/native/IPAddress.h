@@ -0,0 +1,46 @@
+#ifndef IPADDRESS_h
+#define IPADDRESS_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "WString.h"
+
+// IPv4 only, bytes in network order like the core
+class IPAddress
+{
+public:
+  IPAddress() { _address.dword = 0; }
+  IPAddress(uint8_t first, uint8_t second, uint8_t third, uint8_t fourth)
+  {
+    _address.bytes[0] = first;
+    _address.bytes[1] = second;
+    _address.bytes[2] = third;
+    _address.bytes[3] = fourth;
+  }
+  IPAddress(uint32_t address) { _address.dword = address; }
+  IPAddress(const uint8_t *address) { memcpy(_address.bytes, address, 4); }
+
+  operator uint32_t() const { return _address.dword; }
+  bool operator==(const IPAddress &other) const { return _address.dword == other._address.dword; }
+  bool operator!=(const IPAddress &other) const { return _address.dword != other._address.dword; }
+  uint8_t operator[](int index) const { return _address.bytes[index]; }
+  uint8_t &operator[](int index) { return _address.bytes[index]; }
+  bool isSet() const { return _address.dword != 0; }
+
+  String toString() const
+  {
+    char text[16];
+    snprintf(text, sizeof(text), "%u.%u.%u.%u", _address.bytes[0], _address.bytes[1], _address.bytes[2], _address.bytes[3]);
+    return String(text);
+  }
+
+private:
+  union
+  {
+    uint8_t bytes[4];
+    uint32_t dword;
+  } _address;
+};
+
+#endif
@@ -0,0 +1,312 @@
+#include "WString.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+static std::string formatNumber(unsigned long long value, bool negative, unsigned char base)
+{
+  if (base < 2 || base > 36)
+  {
+    base = 10;
+  }
+
+  char digits[66];
+  char *end = digits + sizeof(digits);
+  char *start = end;
+  do
+  {
+    *--start = "0123456789abcdefghijklmnopqrstuvwxyz"[value % base];
+    value /= base;
+  } while (value > 0);
+  if (negative)
+  {
+    *--start = '-';
+  }
+  return std::string(start, end - start);
+}
+
+static std::string formatSigned(long long value, unsigned char base)
+{
+  // Like the ESP8266 core, only base 10 shows a sign
+  if (base == 10 && value < 0)
+  {
+    return formatNumber(0ULL - (unsigned long long)value, true, base);
+  }
+  return formatNumber((unsigned long long)value, false, base);
+}
+
+String::String(unsigned char value, unsigned char base) : _text(formatNumber(value, false, base)) {}
+String::String(int value, unsigned char base) : _text(base == 10 ? formatSigned(value, base) : formatNumber((unsigned int)value, false, base)) {}
+String::String(unsigned int value, unsigned char base) : _text(formatNumber(value, false, base)) {}
+String::String(long value, unsigned char base) : _text(base == 10 ? formatSigned(value, base) : formatNumber((unsigned long)value, false, base)) {}
+String::String(unsigned long value, unsigned char base) : _text(formatNumber(value, false, base)) {}
+String::String(long long value, unsigned char base) : _text(formatSigned(value, base)) {}
+String::String(unsigned long long value, unsigned char base) : _text(formatNumber(value, false, base)) {}
+
+String::String(float value, unsigned char decimals) : String((double)value, decimals) {}
+
+String::String(double value, unsigned char decimals)
+{
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+  _text = buffer;
+}
+
+bool String::reserve(unsigned int size)
+{
+  _text.reserve(size);
+  return true;
+}
+
+bool String::concat(const String &text)
+{
+  _text += text._text;
+  return true;
+}
+
+bool String::concat(const char *text)
+{
+  if (text == nullptr)
+  {
+    return false;
+  }
+  _text += text;
+  return true;
+}
+
+bool String::concat(const char *text, unsigned int length)
+{
+  if (text == nullptr)
+  {
+    return false;
+  }
+  _text.append(text, length);
+  return true;
+}
+
+bool String::concat(char c)
+{
+  _text += c;
+  return true;
+}
+
+bool String::equalsIgnoreCase(const String &other) const
+{
+  return _text.size() == other._text.size() && strcasecmp(_text.c_str(), other._text.c_str()) == 0;
+}
+
+bool String::startsWith(const String &prefix) const
+{
+  return _text.compare(0, prefix._text.size(), prefix._text) == 0;
+}
+
+bool String::endsWith(const String &suffix) const
+{
+  return _text.size() >= suffix._text.size() &&
+         _text.compare(_text.size() - suffix._text.size(), suffix._text.size(), suffix._text) == 0;
+}
+
+char String::charAt(unsigned int index) const
+{
+  return index < _text.size() ? _text[index] : '\0';
+}
+
+void String::setCharAt(unsigned int index, char c)
+{
+  if (index < _text.size())
+  {
+    _text[index] = c;
+  }
+}
+
+char &String::operator[](unsigned int index)
+{
+  static char dummy;
+  if (index >= _text.size())
+  {
+    dummy = '\0';
+    return dummy;
+  }
+  return _text[index];
+}
+
+void String::getBytes(unsigned char *buffer, unsigned int size, unsigned int index) const
+{
+  if (size == 0)
+  {
+    return;
+  }
+  size_t length = index < _text.size() ? std::min((size_t)size - 1, _text.size() - index) : 0;
+  memcpy(buffer, _text.data() + index, length);
+  buffer[length] = '\0';
+}
+
+void String::toCharArray(char *buffer, unsigned int size, unsigned int index) const
+{
+  getBytes((unsigned char *)buffer, size, index);
+}
+
+int String::indexOf(char c, unsigned int from) const
+{
+  size_t position = _text.find(c, from);
+  return position == std::string::npos ? -1 : (int)position;
+}
+
+int String::indexOf(const String &text, unsigned int from) const
+{
+  size_t position = _text.find(text._text, from);
+  return position == std::string::npos ? -1 : (int)position;
+}
+
+int String::lastIndexOf(char c) const
+{
+  size_t position = _text.rfind(c);
+  return position == std::string::npos ? -1 : (int)position;
+}
+
+int String::lastIndexOf(const String &text) const
+{
+  size_t position = _text.rfind(text._text);
+  return position == std::string::npos ? -1 : (int)position;
+}
+
+String String::substring(unsigned int from) const
+{
+  return substring(from, _text.size());
+}
+
+String String::substring(unsigned int from, unsigned int to) const
+{
+  if (from > to)
+  {
+    std::swap(from, to);
+  }
+  if (from >= _text.size())
+  {
+    return String();
+  }
+  to = std::min((size_t)to, _text.size());
+  return String(_text.data() + from, to - from);
+}
+
+void String::replace(char find, char replacement)
+{
+  for (char &c : _text)
+  {
+    if (c == find)
+    {
+      c = replacement;
+    }
+  }
+}
+
+void String::replace(const String &find, const String &replacement)
+{
+  if (find._text.empty())
+  {
+    return;
+  }
+  size_t position = 0;
+  while ((position = _text.find(find._text, position)) != std::string::npos)
+  {
+    _text.replace(position, find._text.size(), replacement._text);
+    position += replacement._text.size();
+  }
+}
+
+void String::remove(unsigned int index)
+{
+  remove(index, (unsigned int)-1);
+}
+
+void String::remove(unsigned int index, unsigned int count)
+{
+  if (index < _text.size())
+  {
+    _text.erase(index, count);
+  }
+}
+
+void String::toLowerCase()
+{
+  for (char &c : _text)
+  {
+    c = tolower((unsigned char)c);
+  }
+}
+
+void String::toUpperCase()
+{
+  for (char &c : _text)
+  {
+    c = toupper((unsigned char)c);
+  }
+}
+
+void String::trim()
+{
+  size_t first = 0;
+  while (first < _text.size() && isspace((unsigned char)_text[first]))
+  {
+    first++;
+  }
+  size_t last = _text.size();
+  while (last > first && isspace((unsigned char)_text[last - 1]))
+  {
+    last--;
+  }
+  _text = _text.substr(first, last - first);
+}
+
+String operator+(const String &lhs, const String &rhs)
+{
+  String result(lhs);
+  result.concat(rhs);
+  return result;
+}
+
+String operator+(const String &lhs, const char *rhs)
+{
+  String result(lhs);
+  result.concat(rhs);
+  return result;
+}
+
+String operator+(const char *lhs, const String &rhs)
+{
+  String result(lhs);
+  result.concat(rhs);
+  return result;
+}
+
+String operator+(const String &lhs, const __FlashStringHelper *rhs)
+{
+  return lhs + reinterpret_cast<const char *>(rhs);
+}
+
+String operator+(const String &lhs, char rhs)
+{
+  String result(lhs);
+  result.concat(rhs);
+  return result;
+}
+
+String operator+(const String &lhs, int rhs)
+{
+  return lhs + String(rhs);
+}
+
+String operator+(const String &lhs, unsigned int rhs)
+{
+  return lhs + String(rhs);
+}
+
+String operator+(const String &lhs, long rhs)
+{
+  return lhs + String(rhs);
+}
+
+String operator+(const String &lhs, unsigned long rhs)
+{
+  return lhs + String(rhs);
+}
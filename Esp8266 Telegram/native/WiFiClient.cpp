@@ -0,0 +1,231 @@
+#include "ESP8266WiFi.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#define CLIENT_BUFFER 1460 // One TCP segment, like lwIP hands them out
+
+struct WiFiClient::Socket
+{
+  int fd = -1;
+  bool closed = false;       // The peer closed or the connection failed
+  std::vector<uint8_t> rx;   // Received, not yet read
+  size_t rxPosition = 0;
+
+  ~Socket()
+  {
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+  }
+};
+
+WiFiClass WiFi;
+
+String WiFiClass::macAddress()
+{
+  uint8_t mac[6];
+  wifi_get_macaddr(STATION_IF, mac);
+  char text[18];
+  snprintf(text, sizeof(text), "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+  return String(text);
+}
+
+WiFiClient::WiFiClient() {}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port)
+{
+  return connect(ip.toString().c_str(), port);
+}
+
+int WiFiClient::connect(const char *host, uint16_t port)
+{
+  stop();
+
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *addresses;
+  char service[6];
+  snprintf(service, sizeof(service), "%u", port);
+  if (getaddrinfo(host, service, &hints, &addresses) != 0)
+  {
+    return 0;
+  }
+
+  std::shared_ptr<Socket> socket = std::make_shared<Socket>();
+  for (addrinfo *address = addresses; address != nullptr && socket->fd < 0; address = address->ai_next)
+  {
+    int fd = ::socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+    if (fd < 0)
+    {
+      continue;
+    }
+
+    // Connect without blocking longer than the stream timeout
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    int result = ::connect(fd, address->ai_addr, address->ai_addrlen);
+    if (result < 0 && errno == EINPROGRESS)
+    {
+      pollfd request = {fd, POLLOUT, 0};
+      int error = 0;
+      socklen_t length = sizeof(error);
+      if (poll(&request, 1, _timeout) == 1 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) == 0 && error == 0)
+      {
+        result = 0;
+      }
+    }
+
+    if (result == 0)
+    {
+      socket->fd = fd;
+    }
+    else
+    {
+      close(fd);
+    }
+  }
+  freeaddrinfo(addresses);
+
+  if (socket->fd < 0)
+  {
+    return 0;
+  }
+  _socket = socket;
+  return 1;
+}
+
+bool WiFiClient::_fill()
+{
+  if (!_socket || _socket->fd < 0 || _socket->closed)
+  {
+    return false;
+  }
+
+  Socket &socket = *_socket;
+  if (socket.rxPosition == socket.rx.size())
+  {
+    socket.rx.clear();
+    socket.rxPosition = 0;
+  }
+  if (socket.rx.size() >= CLIENT_BUFFER)
+  {
+    return true;
+  }
+
+  uint8_t buffer[CLIENT_BUFFER];
+  ssize_t length = recv(socket.fd, buffer, CLIENT_BUFFER - socket.rx.size(), MSG_DONTWAIT);
+  if (length > 0)
+  {
+    socket.rx.insert(socket.rx.end(), buffer, buffer + length);
+  }
+  else if (length == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+  {
+    socket.closed = true;
+  }
+  return true;
+}
+
+size_t WiFiClient::write(const uint8_t *buffer, size_t size)
+{
+  if (!_socket || _socket->fd < 0 || _socket->closed)
+  {
+    return 0;
+  }
+
+  size_t written = 0;
+  while (written < size)
+  {
+    ssize_t length = send(_socket->fd, buffer + written, size - written, MSG_NOSIGNAL);
+    if (length > 0)
+    {
+      written += length;
+      continue;
+    }
+    if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+    {
+      pollfd request = {_socket->fd, POLLOUT, 0};
+      if (poll(&request, 1, _timeout) == 1)
+      {
+        continue;
+      }
+    }
+    _socket->closed = true;
+    break;
+  }
+  return written;
+}
+
+int WiFiClient::available()
+{
+  _fill();
+  return _socket ? _socket->rx.size() - _socket->rxPosition : 0;
+}
+
+int WiFiClient::read()
+{
+  if (available() == 0)
+  {
+    return -1;
+  }
+  return _socket->rx[_socket->rxPosition++];
+}
+
+int WiFiClient::read(uint8_t *buffer, size_t size)
+{
+  size_t length = min((size_t)available(), size);
+  if (length == 0)
+  {
+    return 0;
+  }
+  memcpy(buffer, _socket->rx.data() + _socket->rxPosition, length);
+  _socket->rxPosition += length;
+  return length;
+}
+
+int WiFiClient::peek()
+{
+  if (available() == 0)
+  {
+    return -1;
+  }
+  return _socket->rx[_socket->rxPosition];
+}
+
+void WiFiClient::stop()
+{
+  // Closes the connection for every copy
+  if (_socket && _socket->fd >= 0)
+  {
+    close(_socket->fd);
+    _socket->fd = -1;
+    _socket->closed = true;
+  }
+  _socket.reset();
+}
+
+uint8_t WiFiClient::connected()
+{
+  if (!_socket || _socket->fd < 0)
+  {
+    return 0;
+  }
+  _fill();
+  return !_socket->closed || _socket->rxPosition < _socket->rx.size();
+}
+
+void WiFiClient::setNoDelay(bool noDelay)
+{
+  if (_socket && _socket->fd >= 0)
+  {
+    int value = noDelay ? 1 : 0;
+    setsockopt(_socket->fd, IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value));
+  }
+}
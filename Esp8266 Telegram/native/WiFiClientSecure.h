@@ -0,0 +1,26 @@
+#ifndef WIFICLIENTSECURE_h
+#define WIFICLIENTSECURE_h
+
+#include "ESP8266WiFi.h"
+#include "CertStoreBearSSL.h"
+
+namespace BearSSL
+{
+  /**
+   * No TLS on the host: this is a plain TCP client, so point the firmware
+   * at a broker port without TLS. Buffer sizes are accepted and ignored,
+   * and no server supports fragment length negotiation.
+   */
+  class WiFiClientSecure : public WiFiClient
+  {
+  public:
+    void setCertStore(CertStore *certStore) {}
+    void setInsecure() {}
+    bool setBufferSizes(int receive, int transmit) { return true; }
+    static bool probeMaxFragmentLength(const char *host, uint16_t port, uint16_t length) { return false; }
+  };
+}
+
+using BearSSL::WiFiClientSecure;
+
+#endif
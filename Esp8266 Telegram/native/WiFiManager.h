@@ -0,0 +1,41 @@
+#ifndef WIFIMANAGER_h
+#define WIFIMANAGER_h
+
+#include <memory>
+#include <vector>
+#include "ESP8266WiFi.h"
+
+class WiFiManagerParameter
+{
+public:
+  WiFiManagerParameter(const char *id, const char *label, const char *defaultValue, int length, const char *custom = "")
+      : _value(defaultValue) {}
+  const char *getValue() const { return _value.c_str(); }
+
+private:
+  String _value;
+};
+
+// The configuration portal never runs, so no argument is ever posted
+class WiFiManagerServer
+{
+public:
+  bool hasArg(const String &name) { return false; }
+  String arg(const String &name) { return String(); }
+};
+
+// The host is always connected
+class WiFiManager
+{
+public:
+  std::unique_ptr<WiFiManagerServer> server{new WiFiManagerServer()};
+
+  void resetSettings() {}
+  void addParameter(WiFiManagerParameter *parameter) {}
+  void setSaveParamsCallback(void (*callback)()) {}
+  void setMenu(std::vector<const char *> &menu) {}
+  void setClass(const char *name) {}
+  bool autoConnect(const char *apName) { return true; }
+};
+
+#endif
@@ -0,0 +1,123 @@
+#include "WiFiUdp.h"
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define UDP_MAX_PACKET 1472 // Largest payload in one Ethernet frame
+
+bool WiFiUDP::_open()
+{
+  if (_fd < 0)
+  {
+    _fd = socket(AF_INET, SOCK_DGRAM, 0);
+  }
+  return _fd >= 0;
+}
+
+uint8_t WiFiUDP::begin(uint16_t port)
+{
+  stop();
+  if (!_open())
+  {
+    return 0;
+  }
+
+  int reuse = 1;
+  setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+  if (bind(_fd, (sockaddr *)&address, sizeof(address)) != 0)
+  {
+    stop();
+    return 0;
+  }
+  return 1;
+}
+
+void WiFiUDP::stop()
+{
+  if (_fd >= 0)
+  {
+    close(_fd);
+    _fd = -1;
+  }
+  _rx.clear();
+  _rxPosition = 0;
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port)
+{
+  _txIP = ip;
+  _txPort = port;
+  _tx.clear();
+  return _open() ? 1 : 0;
+}
+
+int WiFiUDP::beginPacket(const char *host, uint16_t port)
+{
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  addrinfo *addresses;
+  if (getaddrinfo(host, nullptr, &hints, &addresses) != 0)
+  {
+    return 0;
+  }
+  uint32_t ip = ((sockaddr_in *)addresses->ai_addr)->sin_addr.s_addr;
+  freeaddrinfo(addresses);
+  return beginPacket(IPAddress(ip), port);
+}
+
+size_t WiFiUDP::write(const uint8_t *buffer, size_t size)
+{
+  size = min(size, UDP_MAX_PACKET - _tx.size());
+  _tx.insert(_tx.end(), buffer, buffer + size);
+  return size;
+}
+
+int WiFiUDP::endPacket()
+{
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = (uint32_t)_txIP;
+  address.sin_port = htons(_txPort);
+  ssize_t sent = sendto(_fd, _tx.data(), _tx.size(), 0, (sockaddr *)&address, sizeof(address));
+  _tx.clear();
+  return sent >= 0 ? 1 : 0;
+}
+
+int WiFiUDP::parsePacket()
+{
+  _rx.clear();
+  _rxPosition = 0;
+  if (_fd < 0)
+  {
+    return 0;
+  }
+
+  uint8_t buffer[UDP_MAX_PACKET];
+  sockaddr_in address = {};
+  socklen_t length = sizeof(address);
+  ssize_t size = recvfrom(_fd, buffer, sizeof(buffer), MSG_DONTWAIT, (sockaddr *)&address, &length);
+  if (size <= 0)
+  {
+    return 0;
+  }
+
+  _rx.assign(buffer, buffer + size);
+  _remoteIP = IPAddress((uint32_t)address.sin_addr.s_addr);
+  _remotePort = ntohs(address.sin_port);
+  return size;
+}
+
+int WiFiUDP::read(uint8_t *buffer, size_t size)
+{
+  size = min(size, (size_t)available());
+  memcpy(buffer, _rx.data() + _rxPosition, size);
+  _rxPosition += size;
+  return size;
+}
@@ -0,0 +1,22 @@
+#include "base64.h"
+
+String base64::encode(const uint8_t *data, size_t length, bool doNewLines)
+{
+  static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+  String result;
+  result.reserve((length + 2) / 3 * 4 + length / 54 + 1);
+  for (size_t i = 0; i < length; i += 3)
+  {
+    uint32_t group = data[i] << 16 | (i + 1 < length ? data[i + 1] << 8 : 0) | (i + 2 < length ? data[i + 2] : 0);
+    result += digits[group >> 18 & 63];
+    result += digits[group >> 12 & 63];
+    result += i + 1 < length ? digits[group >> 6 & 63] : '=';
+    result += i + 2 < length ? digits[group & 63] : '=';
+    if (doNewLines && (i + 3) % 54 == 0 && i + 3 < length)
+    {
+      result += '\n';
+    }
+  }
+  return result;
+}
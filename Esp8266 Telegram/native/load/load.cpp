@@ -0,0 +1,772 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <arpa/inet.h>
+#include <getopt.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ChannelTable.h"
+#include "FlightRecorder.h"
+#include "poller.h"
+#include "ratelimit.h"
+#include "updateparser.h"
+
+/*
+ * Load harness for the Telegram firmware, built with "pio run -e load". The
+ * firmware runs unchanged in the main thread. A fake Bot API server on
+ * 127.0.0.1:TELEGRAM_PORT answers its long polls and calls, while a second
+ * thread queues updates for one of three scenarios:
+ *
+ *   taps       --users authorized users press channel buttons, --rate
+ *              presses per second in total
+ *   outage     the same, but the server refuses every connection during
+ *              the first --outage seconds, so the presses arrive as one
+ *              burst once the bridge is back
+ *   strangers  unknown senders send --rate wrong passwords per second from
+ *              --strangers different ids, while one authorized user presses
+ *              a button every second
+ *
+ *   .pio/build/load/program --scenario outage --rate 1 --seconds 60
+ *
+ * A press is followed from the moment it is queued on the server to the
+ * answerCallbackQuery that stops its spinner, and to the first edge of the
+ * telegram that carries it. The result is one line of key=value pairs,
+ * followed by the firmware's own counters:
+ *
+ *   scenario=taps,rate=1,updates=..,delivered=..,taps=..,answered=..,
+ *   transmitted=..,coalesced=..,dropped=..,answer_p50=..,answer_p90=..,
+ *   answer_p99=..,answer_max=..,rf_p50=..,rf_p90=..,rf_p99=..,rf_max=..,
+ *   get_updates=..,answer_callback_query=..,send_message=..,
+ *   edit_message_reply_markup=..,refused=..
+ *
+ * Latencies are in ms. Coalesced presses were replaced by a later press for
+ * the same channel before they were sent, which the RF queue does on
+ * purpose; dropped presses were not sent within --drain seconds after the
+ * last one. Request counts are per Bot API method as seen by the server,
+ * refused counts the connections closed during the outage. TLS is not
+ * emulated, so the firmware is built with TELEGRAM_HOST and TELEGRAM_PORT
+ * pointing at the harness.
+ */
+
+#define LOAD_FIRST_USER 1001 // Authorized users are 1001, 1002, ...
+#define LOAD_FIRST_STRANGER 900001
+#define LOAD_PASSWORD "load-password"
+#define RF_PIN D5 // As in main.cpp
+
+// From main.cpp
+void handleMessage(TelegramMessage &msg);
+extern ChannelTable channels;
+extern FlightRecorder recorder;
+extern TelegramPoller poller;
+extern RateLimiter limiter;
+extern String telegramToken;
+extern uint32_t rfDropped;
+
+enum Scenario
+{
+  SCENARIO_TAPS,
+  SCENARIO_OUTAGE,
+  SCENARIO_STRANGERS,
+};
+
+static const char *const scenarioNames[] = {"taps", "outage", "strangers"};
+
+struct Options
+{
+  byte scenario = SCENARIO_TAPS;
+  float rate = 1;            // Updates per second
+  unsigned long seconds = 60;
+  unsigned long outage = 20; // Seconds the server is down, outage only
+  unsigned long drain = 30;  // Seconds to wait for presses still in flight
+  byte users = 50;
+  uint32_t strangers = 200;
+  byte channelCount = 16;
+  bool verbose = false;
+};
+
+struct Update
+{
+  unsigned long at; // micros() when queued on the server
+  uint32_t userId;
+  bool tap;         // Button press of an authorized user, otherwise a stranger's text
+  byte channel;
+  bool switchOn;
+  unsigned long deliveredAt; // micros() of the getUpdates response, 0 before
+  unsigned long answeredAt;  // micros() of the answerCallbackQuery, 0 before
+  unsigned long transmittedAt;
+  bool coalesced;
+};
+
+enum Method
+{
+  METHOD_GET_UPDATES,
+  METHOD_ANSWER_CALLBACK_QUERY,
+  METHOD_SEND_MESSAGE,
+  METHOD_EDIT_MESSAGE_REPLY_MARKUP,
+  METHOD_OTHER,
+  METHOD_COUNT,
+};
+
+static const char *const methodNames[] = {"getUpdates", "answerCallbackQuery", "sendMessage", "editMessageReplyMarkup", "other"};
+static const char *const methodKeys[] = {"get_updates", "answer_callback_query", "send_message", "edit_message_reply_markup", "other"};
+
+static Options options;
+static std::mutex updatesLock;
+static std::condition_variable updateQueued;
+static std::vector<Update> updates; // Update n has update_id and callback query id n + 1
+static size_t confirmed = 0;        // Updates the firmware confirmed with its offset
+static uint32_t requests[METHOD_COUNT];
+static uint32_t refused = 0;
+static std::vector<size_t> arrived; // Presses handed to the firmware, in order
+static std::atomic<bool> generating(true);
+static std::atomic<bool> serverDown(false);
+static std::atomic<bool> finished(false);
+
+static unsigned long transmissionStart = 0; // First edge during the current loop()
+
+/*
+ * Fake Bot API server
+ */
+
+// Wait until fd has data, false when the run ended or the server went down
+static bool waitReadable(int fd)
+{
+  while (!finished && !serverDown)
+  {
+    pollfd readable = {fd, POLLIN, 0};
+    if (poll(&readable, 1, 10) > 0)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool receive(int fd, std::string &pending)
+{
+  if (!waitReadable(fd))
+  {
+    return false;
+  }
+
+  char buffer[1024];
+  ssize_t length = recv(fd, buffer, sizeof(buffer), 0);
+  if (length <= 0)
+  {
+    return false;
+  }
+  pending.append(buffer, length);
+  return true;
+}
+
+/**
+ * Read one request from a keep-alive connection. Bytes of the next request
+ * stay in pending.
+ */
+static bool readRequest(int fd, std::string &pending, std::string &head, std::string &body)
+{
+  size_t end;
+  while ((end = pending.find("\r\n\r\n")) == std::string::npos)
+  {
+    if (!receive(fd, pending))
+    {
+      return false;
+    }
+  }
+  head = pending.substr(0, end);
+  pending.erase(0, end + 4);
+
+  size_t length = 0;
+  const char *header = strcasestr(head.c_str(), "\r\ncontent-length:");
+  if (header != nullptr)
+  {
+    length = atol(header + 17);
+  }
+  while (pending.size() < length)
+  {
+    if (!receive(fd, pending))
+    {
+      return false;
+    }
+  }
+  body = pending.substr(0, length);
+  pending.erase(0, length);
+  return true;
+}
+
+static bool respond(int fd, const std::string &body)
+{
+  char head[160];
+  snprintf(head, sizeof(head),
+           "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %u\r\nConnection: keep-alive\r\n\r\n",
+           (unsigned)body.size());
+  std::string response = head + body;
+  return send(fd, response.data(), response.size(), MSG_NOSIGNAL) == (ssize_t)response.size();
+}
+
+static long queryParameter(const std::string &head, const char *name, long fallback)
+{
+  size_t found = head.find(name);
+  return found == std::string::npos ? fallback : atol(head.c_str() + found + strlen(name));
+}
+
+static void appendUpdate(std::string &json, size_t index)
+{
+  const Update &update = updates[index];
+  char buffer[400];
+  if (update.tap)
+  {
+    snprintf(buffer, sizeof(buffer),
+             "{\"update_id\":%u,\"callback_query\":{\"id\":\"%u\","
+             "\"from\":{\"id\":%u,\"is_bot\":false,\"first_name\":\"User\"},"
+             "\"message\":{\"message_id\":1,\"chat\":{\"id\":%u,\"type\":\"private\"},\"text\":\"What do you want to do?\"},"
+             "\"data\":\"%c%u\"}}",
+             (unsigned)index + 1, (unsigned)index + 1, update.userId, update.userId, update.switchOn ? 'n' : 'f', update.channel);
+  }
+  else
+  {
+    snprintf(buffer, sizeof(buffer),
+             "{\"update_id\":%u,\"message\":{\"message_id\":%u,"
+             "\"from\":{\"id\":%u,\"is_bot\":false,\"first_name\":\"Stranger\"},"
+             "\"chat\":{\"id\":%u,\"type\":\"private\"},\"text\":\"guess %u\"}}",
+             (unsigned)index + 1, (unsigned)index + 1, update.userId, update.userId, (unsigned)index);
+  }
+  json += buffer;
+}
+
+// Closed by the peer, without waiting
+static bool peerClosed(int fd)
+{
+  char byte;
+  return recv(fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == 0;
+}
+
+/**
+ * Answer getUpdates like Telegram: confirm everything before offset and
+ * hold the request until an update is waiting or the timeout expires.
+ */
+static bool getUpdates(int fd, const std::string &head)
+{
+  long offset = queryParameter(head, "offset=", 0);
+  long limit = queryParameter(head, "limit=", 100);
+  unsigned long timeout = queryParameter(head, "timeout=", 0) * 1000UL;
+
+  std::string json = "{\"ok\":true,\"result\":[";
+  {
+    std::unique_lock<std::mutex> guard(updatesLock);
+    if (offset > 0)
+    {
+      confirmed = max(confirmed, min((size_t)offset - 1, updates.size()));
+    }
+
+    unsigned long start = millis();
+    while (confirmed == updates.size() && millis() - start < timeout)
+    {
+      updateQueued.wait_for(guard, std::chrono::milliseconds(10));
+      if (finished || serverDown || peerClosed(fd))
+      {
+        return false;
+      }
+    }
+
+    unsigned long now = micros();
+    size_t end = min(updates.size(), confirmed + limit);
+    for (size_t i = confirmed; i < end; i++)
+    {
+      if (i > confirmed)
+      {
+        json += ',';
+      }
+      appendUpdate(json, i);
+      if (updates[i].deliveredAt == 0)
+      {
+        updates[i].deliveredAt = now;
+      }
+    }
+  }
+  json += "]}";
+  return respond(fd, json);
+}
+
+static bool handleRequest(int fd, const std::string &head, const std::string &body)
+{
+  // "GET /bot<token>/<method>?..." or "POST /bot<token>/<method>"
+  size_t start = head.find('/', head.find("/bot") + 1) + 1;
+  size_t end = head.find_first_of("? ", start);
+  std::string method = head.substr(start, end - start);
+
+  byte index = METHOD_OTHER;
+  for (byte i = 0; i < METHOD_OTHER; i++)
+  {
+    if (method == methodNames[i])
+    {
+      index = i;
+    }
+  }
+  {
+    std::lock_guard<std::mutex> guard(updatesLock);
+    requests[index]++;
+  }
+
+  if (index == METHOD_GET_UPDATES)
+  {
+    return getUpdates(fd, head);
+  }
+
+  if (index == METHOD_ANSWER_CALLBACK_QUERY)
+  {
+    const char *id = strstr(body.c_str(), "\"callback_query_id\":\"");
+    size_t update = id == nullptr ? 0 : atol(id + 21);
+
+    std::lock_guard<std::mutex> guard(updatesLock);
+    if (update > 0 && update <= updates.size() && updates[update - 1].answeredAt == 0)
+    {
+      updates[update - 1].answeredAt = micros();
+    }
+  }
+  return respond(fd, "{\"ok\":true,\"result\":true}");
+}
+
+static void serveConnection(int fd)
+{
+  std::string pending;
+  std::string head;
+  std::string body;
+  while (readRequest(fd, pending, head, body) && handleRequest(fd, head, body))
+  {
+  }
+  close(fd);
+}
+
+/**
+ * Serve one connection at a time, the firmware never opens a second one.
+ * While the server is down every connection is closed right away.
+ */
+static void serve(int listener)
+{
+  while (!finished)
+  {
+    pollfd incoming = {listener, POLLIN, 0};
+    if (poll(&incoming, 1, 10) <= 0)
+    {
+      continue;
+    }
+
+    int fd = accept(listener, nullptr, nullptr);
+    if (fd < 0)
+    {
+      continue;
+    }
+    if (serverDown)
+    {
+      std::lock_guard<std::mutex> guard(updatesLock);
+      refused++;
+      close(fd);
+      continue;
+    }
+    serveConnection(fd);
+  }
+  close(listener);
+}
+
+static int listenForFirmware()
+{
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  int reuse = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(TELEGRAM_PORT);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(listener, (sockaddr *)&address, sizeof(address)) != 0 || listen(listener, 4) != 0)
+  {
+    fprintf(stderr, "Unable to listen on 127.0.0.1:%u\n", TELEGRAM_PORT);
+    exit(1);
+  }
+  return listener;
+}
+
+/*
+ * Scenarios
+ */
+
+static void queue(uint32_t userId, bool tap, byte channel, bool switchOn)
+{
+  std::lock_guard<std::mutex> guard(updatesLock);
+  updates.push_back({micros(), userId, tap, channel, switchOn, 0, 0, 0, false});
+  updateQueued.notify_all();
+}
+
+static void queueTap()
+{
+  queue(LOAD_FIRST_USER + random(options.users), true, random(options.channelCount), random(2));
+}
+
+/**
+ * Queue updates at options.rate per second for the scenario, then stop.
+ */
+static void generate()
+{
+  unsigned long interval = 1000000 / options.rate;
+  unsigned long start = micros();
+  unsigned long next = start;
+  unsigned long nextTap = start; // Presses between the spam of the strangers
+  uint32_t count = 0;
+
+  if (options.scenario == SCENARIO_OUTAGE)
+  {
+    serverDown = true;
+  }
+
+  while (!finished)
+  {
+    unsigned long elapsed = micros() - start;
+    if (elapsed >= options.seconds * 1000000UL)
+    {
+      break;
+    }
+    if (serverDown && elapsed >= options.outage * 1000000UL)
+    {
+      serverDown = false;
+    }
+
+    if ((long)(micros() - next) >= 0)
+    {
+      if (options.scenario == SCENARIO_STRANGERS)
+      {
+        queue(LOAD_FIRST_STRANGER + count % options.strangers, false, 0, false);
+      }
+      else
+      {
+        queueTap();
+      }
+      count++;
+      next += interval;
+    }
+
+    if (options.scenario == SCENARIO_STRANGERS && (long)(micros() - nextTap) >= 0)
+    {
+      queueTap();
+      nextTap += 1000000;
+    }
+    delay(1);
+  }
+  serverDown = false;
+  generating = false;
+}
+
+/*
+ * Following the presses through the firmware
+ */
+
+/**
+ * Callback of the firmware's poller. Notes the arrival of every press
+ * before the firmware handles it.
+ */
+static void handleFirmwareMessage(TelegramMessage &msg)
+{
+  if (msg.query)
+  {
+    arrived.push_back(atol(msg.queryID) - 1);
+  }
+  handleMessage(msg);
+}
+
+static void handlePinWrite(uint8_t pin, uint8_t value)
+{
+  if (pin != RF_PIN)
+  {
+    return;
+  }
+  if (transmissionStart == 0)
+  {
+    transmissionStart = micros();
+  }
+}
+
+/**
+ * Mark the press that a transmission carried. The RF queue keeps the last
+ * command per channel, so that is the last press that reached the firmware
+ * before the transmission started. Earlier ones that are still waiting were
+ * replaced.
+ */
+static void matchTransmission(byte channel, bool switchOn)
+{
+  std::lock_guard<std::mutex> guard(updatesLock);
+
+  int match = -1;
+  for (size_t i = 0; i < arrived.size(); i++)
+  {
+    const Update &update = updates[arrived[i]];
+    if (update.channel == channel && update.transmittedAt == 0 && !update.coalesced)
+    {
+      match = i;
+    }
+  }
+  if (match < 0 || updates[arrived[match]].switchOn != switchOn)
+  {
+    return;
+  }
+
+  for (int i = 0; i < match; i++)
+  {
+    Update &update = updates[arrived[i]];
+    if (update.channel == channel && update.transmittedAt == 0)
+    {
+      update.coalesced = true;
+    }
+  }
+  updates[arrived[match]].transmittedAt = transmissionStart;
+}
+
+/**
+ * One pass of the firmware's loop(). It sends at most one frame, which it
+ * logs just before the first edge, so the newest record names the channel.
+ */
+static void runLoop()
+{
+  transmissionStart = 0;
+  loop();
+  if (transmissionStart == 0 || recorder.count() == 0)
+  {
+    return;
+  }
+
+  RfRecord record;
+  recorder.read(recorder.count() - 1, record);
+  for (byte i = 0; i < options.channelCount; i++)
+  {
+    const ChannelTarget &target = channels[i];
+    if (target.protocol == record.protocol && target.address == record.address && target.unit == record.unit)
+    {
+      matchTransmission(i, (record.action & 0x03) == NewRemoteTransmitter::SWITCH_ON);
+      break;
+    }
+  }
+}
+
+static bool pressesPending()
+{
+  std::lock_guard<std::mutex> guard(updatesLock);
+  for (const Update &update : updates)
+  {
+    if (update.tap && ((update.transmittedAt == 0 && !update.coalesced) || update.answeredAt == 0))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+static uint32_t percentile(const std::vector<uint32_t> &sorted, float fraction)
+{
+  if (sorted.empty())
+  {
+    return 0;
+  }
+  return sorted[min(sorted.size() - 1, (size_t)(fraction * sorted.size()))];
+}
+
+static void printLatencies(const char *name, std::vector<uint32_t> &latencies)
+{
+  std::sort(latencies.begin(), latencies.end());
+  printf(",%s_p50=%u,%s_p90=%u,%s_p99=%u,%s_max=%u", name, percentile(latencies, 0.5), name, percentile(latencies, 0.9),
+         name, percentile(latencies, 0.99), name, latencies.empty() ? 0 : latencies.back());
+}
+
+static void report()
+{
+  std::lock_guard<std::mutex> guard(updatesLock);
+
+  std::vector<uint32_t> answerLatencies;
+  std::vector<uint32_t> rfLatencies;
+  uint32_t delivered = 0;
+  uint32_t taps = 0;
+  uint32_t coalesced = 0;
+  for (const Update &update : updates)
+  {
+    delivered += update.deliveredAt != 0;
+    if (!update.tap)
+    {
+      continue;
+    }
+    taps++;
+    if (update.answeredAt != 0)
+    {
+      answerLatencies.push_back((update.answeredAt - update.at) / 1000);
+    }
+    if (update.transmittedAt != 0)
+    {
+      rfLatencies.push_back((update.transmittedAt - update.at) / 1000);
+    }
+    else if (update.coalesced)
+    {
+      coalesced++;
+    }
+  }
+  uint32_t dropped = taps - rfLatencies.size() - coalesced;
+
+  printf("scenario=%s,rate=%g,updates=%u,delivered=%u,taps=%u,answered=%u,transmitted=%u,coalesced=%u,dropped=%u",
+         scenarioNames[options.scenario], options.rate, (unsigned)updates.size(), delivered, taps,
+         (unsigned)answerLatencies.size(), (unsigned)rfLatencies.size(), coalesced, dropped);
+  printLatencies("answer", answerLatencies);
+  printLatencies("rf", rfLatencies);
+  for (byte i = 0; i < METHOD_COUNT; i++)
+  {
+    printf(",%s=%u", methodKeys[i], requests[i]);
+  }
+  printf(",refused=%u\n", refused);
+
+  const TelegramPollStats &stats = poller.stats;
+  printf("requests=%u,errors=%u,tap_to_transmit_avg=%u,tap_to_transmit_max=%u,"
+         "limited=%u,locked_out=%u,wrong_passwords=%u,evicted=%u,rf_queue_full=%u\n",
+         stats.requests, stats.errors, stats.latencyCount > 0 ? stats.latencyTotal / stats.latencyCount : 0,
+         stats.latencyMax, limiter.stats.limited, limiter.stats.lockedOut, limiter.stats.failures,
+         limiter.stats.evicted, rfDropped);
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "Usage: %s [--scenario taps|outage|strangers] [--rate 1] [--seconds 60] [--outage 20] [--users 50] "
+                  "[--strangers 200] [--channels 16] [--drain 30] [--verbose]\n",
+          name);
+  exit(2);
+}
+
+static void parseOptions(int argc, char **argv)
+{
+  static const option longOptions[] = {
+      {"scenario", required_argument, nullptr, 'S'},
+      {"rate", required_argument, nullptr, 'r'},
+      {"seconds", required_argument, nullptr, 's'},
+      {"outage", required_argument, nullptr, 'o'},
+      {"users", required_argument, nullptr, 'u'},
+      {"strangers", required_argument, nullptr, 't'},
+      {"channels", required_argument, nullptr, 'c'},
+      {"drain", required_argument, nullptr, 'd'},
+      {"verbose", no_argument, nullptr, 'v'},
+      {nullptr, 0, nullptr, 0},
+  };
+
+  int option;
+  while ((option = getopt_long(argc, argv, "S:r:s:o:u:t:c:d:v", longOptions, nullptr)) != -1)
+  {
+    switch (option)
+    {
+    case 'S':
+      options.scenario = std::find_if(std::begin(scenarioNames), std::end(scenarioNames),
+                                      [](const char *name) { return strcmp(name, optarg) == 0; }) -
+                         std::begin(scenarioNames);
+      if (options.scenario > SCENARIO_STRANGERS)
+      {
+        usage(argv[0]);
+      }
+      break;
+    case 'r':
+      options.rate = atof(optarg);
+      break;
+    case 's':
+      options.seconds = atol(optarg);
+      break;
+    case 'o':
+      options.outage = atol(optarg);
+      break;
+    case 'u':
+      options.users = constrain(atoi(optarg), 1, 50); // MAX_USERS in main.cpp
+      break;
+    case 't':
+      options.strangers = max(atol(optarg), 1L);
+      break;
+    case 'c':
+      options.channelCount = constrain(atoi(optarg), 1, MAX_CHANNELS);
+      break;
+    case 'd':
+      options.drain = atol(optarg);
+      break;
+    case 'v':
+      options.verbose = true;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+
+  if (options.rate <= 0 || options.seconds == 0)
+  {
+    usage(argv[0]);
+  }
+}
+
+/**
+ * Give the firmware its token, password, channels and the authorized users,
+ * the configuration portal does not run on the host.
+ */
+static void prepareStorage()
+{
+  LittleFS.begin();
+
+  File file = LittleFS.open("telegramToken", "w");
+  file.print("0:load");
+  file.close();
+
+  file = LittleFS.open("telegramPassword", "w");
+  file.print(LOAD_PASSWORD);
+  file.close();
+
+  file = LittleFS.open("numberOfChannels", "w");
+  file.print(options.channelCount);
+  file.close();
+
+  file = LittleFS.open("users", "w");
+  for (byte i = 0; i < options.users; i++)
+  {
+    file.println(LOAD_FIRST_USER + i);
+  }
+  file.close();
+}
+
+int main(int argc, char **argv)
+{
+  parseOptions(argc, argv);
+  if (!options.verbose)
+  {
+    setSerialOutput(nullptr);
+  }
+  signal(SIGPIPE, SIG_IGN);
+  randomSeed(1);
+
+  prepareStorage();
+  std::thread server(serve, listenForFirmware());
+  setup();
+  poller.begin(telegramToken, handleFirmwareMessage);
+  setPinWriteHook(handlePinWrite);
+
+  std::thread generator(generate);
+  while (generating)
+  {
+    runLoop();
+  }
+
+  // Presses still in flight count as dropped when they are not sent in time
+  unsigned long drainStart = millis();
+  while (millis() - drainStart < options.drain * 1000 && pressesPending())
+  {
+    runLoop();
+  }
+
+  finished = true;
+  generator.join();
+  server.join();
+  report();
+  return 0;
+}
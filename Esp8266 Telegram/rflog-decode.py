@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+
+# Decodes a dump of the RF log, the record of every telegram the bridge
+# transmitted. Get a dump over MQTT with
+#
+#   mosquitto_sub -t '<base>/rflog' -C 1 > rflog.bin &
+#   mosquitto_pub -t '<base>/rflog/dump' -n
+#   ./rflog-decode.py rflog.bin
+#
+# or paste the messages of the Telegram "Log dump" command into a file;
+# base64 text is recognised and decoded.
+import argparse
+import base64
+import binascii
+import datetime
+import struct
+import sys
+
+HEADER = struct.Struct('<4sHHII')
+RECORD = struct.Struct('<IIBBBBBBH')
+LATENCY_UNKNOWN = 0xFFFF
+GROUP = 0x04
+
+SOURCES = ['mqtt', 'telegram', 'schedule', 'scene', 'lan', 'udp']
+PROTOCOLS = ['kaku', 'kakuold', 'action', 'elro']
+ACTIONS = ['off', 'on', 'dim', '?']
+
+
+def load(path):
+    with (sys.stdin.buffer if path == '-' else open(path, 'rb')) as f:
+        data = f.read()
+    if not data.startswith(b'RFL1'):
+        try:
+            data = base64.b64decode(b''.join(data.split()), validate=True)
+        except (binascii.Error, ValueError):
+            sys.exit("Neither a binary nor a base64 dump")
+    return data
+
+
+def name(names, value):
+    return names[value] if value < len(names) else str(value)
+
+
+parser = argparse.ArgumentParser(description="Decode a dump of the RF log")
+parser.add_argument('dump', nargs='?', default='-', help="binary or base64 dump, - for stdin")
+parser.add_argument('--utc', action='store_true', help="print times in UTC instead of local time")
+args = parser.parse_args()
+
+data = load(args.dump)
+magic, recordSize, records, written, _ = HEADER.unpack_from(data)
+if magic != b'RFL1' or recordSize != RECORD.size:
+    sys.exit("Not an RF log dump, or an unknown version")
+if len(data) < HEADER.size + records * recordSize:
+    sys.exit("Dump is truncated")
+
+print("%d records, %d written since the log was created" % (records, written))
+for i in range(records):
+    (time, address, unit, protocol, action, source, repeats, _,
+     latency) = RECORD.unpack_from(data, HEADER.size + i * recordSize)
+
+    when = datetime.datetime.fromtimestamp(time, datetime.timezone.utc)
+    if not args.utc:
+        when = when.astimezone()
+    what = name(ACTIONS, action & 0x03)
+    if action & 0x03 == 2:
+        what += " %d" % (action >> 4)
+    target = "group" if action & GROUP else "unit %d" % unit
+
+    print("%s  %-8s  %-7s %8d %-7s  %-6s x%-3d %s" % (
+        when.strftime('%Y-%m-%d %H:%M:%S'), name(SOURCES, source), name(PROTOCOLS, protocol),
+        address, target, what, repeats,
+        "-" if latency == LATENCY_UNKNOWN else "%d ms" % latency))
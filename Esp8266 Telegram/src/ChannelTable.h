@@ -0,0 +1,55 @@
+#ifndef CHANNELTABLE_h
+#define CHANNELTABLE_h
+
+#include <Arduino.h>
+#include "RemoteProtocols.h"
+
+#define MAX_CHANNELS 64
+#define UNITS_PER_ADDRESS 16 // The KaKu unit field is 4 bits
+
+struct ChannelTarget
+{
+  byte protocol; // RemoteProtocol
+  byte unit;
+  unsigned long address;
+};
+
+/**
+ * Maps every channel to a protocol, address and unit. By default channel n is
+ * unit n % 16 of a KaKu address derived from the transmitter's own: the MAC
+ * based address fills the low 24 bits and n / 16 goes into the top two of the
+ * 26 address bits, so channels 0-15 keep the address they always had. Channels
+ * that differ from the default are stored in the "channels" file, one
+ * "<channel> <protocol> <address> <unit>" line each.
+ */
+class ChannelTable
+{
+public:
+  void begin(unsigned long defaultAddress);
+  void load();
+  void save();
+
+  /**
+   * Configure a channel from text like "elro 21 2" or "kakuold 0 4". A protocol
+   * name on its own ("kaku") restores the default. Returns false on invalid
+   * input, leaving the channel unchanged.
+   */
+  bool configure(byte channel, const char *text);
+
+  /**
+   * Describe a channel in the format accepted by configure().
+   */
+  String describe(byte channel) const;
+
+  const ChannelTarget &operator[](byte channel) const { return _targets[channel]; }
+
+  void send(NewRemoteTransmitter &transmitter, byte channel, byte switchType, byte dimLevel = 0) const;
+
+private:
+  ChannelTarget _targets[MAX_CHANNELS];
+  unsigned long _defaultAddress;
+
+  ChannelTarget _default(byte channel) const;
+};
+
+#endif
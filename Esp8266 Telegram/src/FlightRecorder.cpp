@@ -0,0 +1,194 @@
+#include "FlightRecorder.h"
+#include <LittleFS.h>
+
+static_assert(sizeof(RfRecord) == 16, "The host tool expects 16 byte records");
+static_assert(sizeof(RfLogHeader) == 16, "The host tool expects a 16 byte header");
+
+static const char logMagic[4] = {'R', 'F', 'L', '1'};
+
+static size_t slotOffset(uint32_t number)
+{
+  return sizeof(RfLogHeader) + (number % RF_LOG_RECORDS) * sizeof(RfRecord);
+}
+
+void FlightRecorder::begin()
+{
+  _ready = false;
+  _written = 0;
+  _stagedCount = 0;
+
+  File file = LittleFS.open("rflog", "r");
+  if (file)
+  {
+    RfLogHeader header;
+    bool valid = file.read((uint8_t *)&header, sizeof(header)) == sizeof(header) &&
+                 memcmp(header.magic, logMagic, sizeof(logMagic)) == 0 &&
+                 header.recordSize == sizeof(RfRecord) && header.records == RF_LOG_RECORDS &&
+                 file.size() == slotOffset(RF_LOG_RECORDS - 1) + sizeof(RfRecord);
+    file.close();
+
+    if (valid)
+    {
+      _written = header.written;
+      _ready = true;
+      return;
+    }
+  }
+
+  // Missing, or written by a build with another layout
+  _ready = _create();
+  if (!_ready)
+  {
+    Serial.println("Unable to create the RF log");
+  }
+}
+
+bool FlightRecorder::_create()
+{
+  File file = LittleFS.open("rflog", "w");
+  if (!file)
+  {
+    return false;
+  }
+
+  RfLogHeader header = {};
+  memcpy(header.magic, logMagic, sizeof(logMagic));
+  header.recordSize = sizeof(RfRecord);
+  header.records = RF_LOG_RECORDS;
+  file.write((const uint8_t *)&header, sizeof(header));
+
+  // Full size right away, later writes only replace records
+  RfRecord empty = {};
+  for (uint16_t i = 0; i < RF_LOG_RECORDS; i++)
+  {
+    file.write((const uint8_t *)&empty, sizeof(empty));
+  }
+  file.close();
+  return true;
+}
+
+void FlightRecorder::loop()
+{
+  if (_stagedCount > 0 && millis() - _stagedAt >= RF_LOG_FLUSH_INTERVAL)
+  {
+    flush();
+  }
+}
+
+void FlightRecorder::record(const RfRecord &record)
+{
+  if (_stagedCount == 0)
+  {
+    _stagedAt = millis();
+  }
+  _staged[_stagedCount++] = record;
+
+  if (_stagedCount == RF_LOG_STAGED)
+  {
+    flush();
+  }
+}
+
+void FlightRecorder::flush()
+{
+  if (_stagedCount == 0)
+  {
+    return;
+  }
+  if (!_ready)
+  {
+    _stagedCount = 0;
+    return;
+  }
+
+  File file = LittleFS.open("rflog", "r+");
+  if (!file)
+  {
+    _stagedCount = 0;
+    return;
+  }
+
+  // The staged records are contiguous in the file, unless they wrap around
+  byte done = 0;
+  while (done < _stagedCount)
+  {
+    uint32_t number = _written + done;
+    byte run = min((uint32_t)(_stagedCount - done), RF_LOG_RECORDS - number % RF_LOG_RECORDS);
+    file.seek(slotOffset(number), SeekSet);
+    file.write((const uint8_t *)&_staged[done], run * sizeof(RfRecord));
+    done += run;
+  }
+  _written += _stagedCount;
+  _stagedCount = 0;
+
+  RfLogHeader header = {};
+  memcpy(header.magic, logMagic, sizeof(logMagic));
+  header.recordSize = sizeof(RfRecord);
+  header.records = RF_LOG_RECORDS;
+  header.written = _written;
+  file.seek(0, SeekSet);
+  file.write((const uint8_t *)&header, sizeof(header));
+  file.close();
+}
+
+uint16_t FlightRecorder::count() const
+{
+  uint32_t total = _written + _stagedCount;
+  return total < RF_LOG_RECORDS ? total : RF_LOG_RECORDS;
+}
+
+bool FlightRecorder::read(uint16_t index, RfRecord &record) const
+{
+  if (index >= count())
+  {
+    return false;
+  }
+
+  uint32_t number = _written + _stagedCount - count() + index;
+  if (number >= _written)
+  {
+    record = _staged[number - _written];
+    return true;
+  }
+
+  File file = LittleFS.open("rflog", "r");
+  if (!file || !file.seek(slotOffset(number), SeekSet))
+  {
+    return false;
+  }
+  bool result = file.read((uint8_t *)&record, sizeof(record)) == sizeof(record);
+  file.close();
+  return result;
+}
+
+void FlightRecorder::dump(Print &out) const
+{
+  RfLogHeader header = {};
+  memcpy(header.magic, logMagic, sizeof(logMagic));
+  header.recordSize = sizeof(RfRecord);
+  header.records = count();
+  header.written = _written + _stagedCount;
+  out.write((const uint8_t *)&header, sizeof(header));
+
+  // One open file for all records instead of one per read()
+  File file = LittleFS.open("rflog", "r");
+  uint32_t first = _written + _stagedCount - count();
+  for (uint32_t number = first; number < _written + _stagedCount; number++)
+  {
+    RfRecord record = {};
+    if (number >= _written)
+    {
+      record = _staged[number - _written];
+    }
+    else if (file)
+    {
+      file.seek(slotOffset(number), SeekSet);
+      file.read((uint8_t *)&record, sizeof(record));
+    }
+    out.write((const uint8_t *)&record, sizeof(record));
+  }
+  if (file)
+  {
+    file.close();
+  }
+}
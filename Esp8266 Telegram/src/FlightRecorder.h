@@ -0,0 +1,92 @@
+#ifndef FLIGHTRECORDER_h
+#define FLIGHTRECORDER_h
+
+#include <Arduino.h>
+
+#define RF_LOG_RECORDS 256             // Records kept, the oldest are overwritten
+#define RF_LOG_STAGED 16               // Records collected in RAM before they are written
+#define RF_LOG_FLUSH_INTERVAL 300000   // Time in ms a staged record waits for the others
+#define RF_LOG_LATENCY_UNKNOWN 0xFFFF
+#define RF_LOG_GROUP 0x04              // Action flag of a group telegram
+
+enum RfSource
+{
+  RF_SOURCE_MQTT,
+  RF_SOURCE_TELEGRAM,
+  RF_SOURCE_SCHEDULE,
+  RF_SOURCE_SCENE, // Scenes, whoever started them
+  RF_SOURCE_LAN,
+  RF_SOURCE_UDP,
+};
+
+/**
+ * One transmitted telegram, 16 bytes little endian as stored.
+ */
+struct RfRecord
+{
+  uint32_t time; // UTC seconds
+  uint32_t address;
+  byte unit;
+  byte protocol; // RemoteProtocol
+  byte action;   // SwitchType in bits 0-1, RF_LOG_GROUP, dim level in bits 4-7
+  byte source;   // RfSource
+  byte repeats;  // Times the telegram was sent
+  byte reserved;
+  uint16_t latency; // Arrival to transmit in ms, RF_LOG_LATENCY_UNKNOWN when not measured
+};
+
+/**
+ * Header of the log file and of a dump. In the file records is the
+ * capacity, in a dump the number of records that follow, oldest first.
+ */
+struct RfLogHeader
+{
+  char magic[4]; // "RFL1"
+  uint16_t recordSize;
+  uint16_t records;
+  uint32_t written; // Records written since the log was created
+  uint32_t reserved;
+};
+
+/**
+ * Circular log of transmitted telegrams in the "rflog" file, to tell
+ * afterwards whether the bridge sent anything. The file is created at its
+ * full size once, so it never grows. Records are staged in RAM and written
+ * RF_LOG_STAGED at a time, or after RF_LOG_FLUSH_INTERVAL, to keep flash
+ * writes rare; staged records are lost on a crash.
+ */
+class FlightRecorder
+{
+public:
+  void begin();
+  void loop();
+  void record(const RfRecord &record);
+  void flush();
+
+  /**
+   * Number of records available, including the staged ones.
+   */
+  uint16_t count() const;
+
+  /**
+   * Read a record, 0 is the oldest.
+   */
+  bool read(uint16_t index, RfRecord &record) const;
+
+  /**
+   * Write a dump, the header followed by all records oldest first.
+   */
+  void dump(Print &out) const;
+  size_t dumpSize() const { return sizeof(RfLogHeader) + count() * sizeof(RfRecord); }
+
+private:
+  RfRecord _staged[RF_LOG_STAGED];
+  byte _stagedCount = 0;
+  unsigned long _stagedAt = 0;
+  uint32_t _written = 0; // Records in the file, counted since it was created
+  bool _ready = false;
+
+  bool _create();
+};
+
+#endif
@@ -9,8 +9,11 @@
 #ifdef ESP8266
     // interrupt handler and related code must be in RAM on ESP8266,
     #define RECEIVE_ATTR ICACHE_RAM_ATTR
+    // the cycle counted transmit loop is kept in RAM to avoid cache misses
+    #define TRANSMIT_ATTR ICACHE_RAM_ATTR
 #else
     #define RECEIVE_ATTR
+    #define TRANSMIT_ATTR
 #endif
 
 NewRemoteTransmitter::NewRemoteTransmitter(unsigned long address, byte pin, unsigned int periodusec, byte repeats) {
@@ -18,157 +21,190 @@ NewRemoteTransmitter::NewRemoteTransmitter(unsigned long address, byte pin, unsi
 	_pin = pin;
 	_periodusec = periodusec;
 	_repeats = (1 << repeats) - 1; // I.e. _repeats = 2^repeats - 1
+	_fast = false;
+	_edgeLatency = 0;
+	timing = {};
 
 	pinMode(_pin, OUTPUT);
 }
 
 void NewRemoteTransmitter::sendGroup(boolean switchOn) {
-	for (int8_t i = _repeats; i >= 0; i--) {
-		_sendStartPulse();
-
-		_sendAddress();
-
-		// Do send group bit
-		_sendBit(true);
-
-		// Switch on | off
-		_sendBit(switchOn);
-
-		// No unit. Is this actually ignored?..
-		_sendUnit(0);
-
-		_sendStopPulse();
-		yield();
-	}
+	// No unit. Is this actually ignored?..
+	_send(true, switchOn ? SWITCH_ON : SWITCH_OFF, 0, 0);
 }
 
 void NewRemoteTransmitter::sendUnit(byte unit, boolean switchOn) {
-	for (int8_t i = _repeats; i >= 0; i--) {
-		_sendStartPulse();
+	_send(false, switchOn ? SWITCH_ON : SWITCH_OFF, unit, 0);
+}
 
-		_sendAddress();
+void NewRemoteTransmitter::sendDim(byte unit, byte dimLevel) {
+	_send(false, SWITCH_DIM, unit, dimLevel);
+}
 
-		// No group bit
-		_sendBit(false);
+void NewRemoteTransmitter::sendGroupDim(byte dimLevel) {
+	_send(true, SWITCH_DIM, 0, dimLevel);
+}
 
-		// Switch on | off
-		_sendBit(switchOn);
+byte NewRemoteTransmitter::encodeTelegram(unsigned long address, boolean group, byte switchType, byte unit, byte dimLevel, byte *pulses) {
+	byte count = 0;
 
-		_sendUnit(unit);
+	// A '0' is short-long, a '1' is long-short, each half being one pulse
+	#define ENCODE_BIT(isBitOne) \
+		pulses[count++] = (isBitOne) ? PULSE_LONG : PULSE_SHORT; \
+		pulses[count++] = (isBitOne) ? PULSE_SHORT : PULSE_LONG;
 
-		_sendStopPulse();
+	pulses[count++] = PULSE_START;
 
-		yield();
+	for (int8_t i=25; i>=0; i--) {
+		ENCODE_BIT((address >> i) & 1);
 	}
-}
-
-void NewRemoteTransmitter::sendDim(byte unit, byte dimLevel) {
-	for (int8_t i = _repeats; i >= 0; i--) {
-		_sendStartPulse();
-
-		_sendAddress();
 
-		// No group bit
-		_sendBit(false);
+	ENCODE_BIT(group);
 
-		// Switch type 'dim'
-		digitalWrite(_pin, HIGH);
-		delayMicroseconds(_periodusec);
-		digitalWrite(_pin, LOW);
-		delayMicroseconds(_periodusec);
-		digitalWrite(_pin, HIGH);
-		delayMicroseconds(_periodusec);
-		digitalWrite(_pin, LOW);
-		delayMicroseconds(_periodusec);
+	if (switchType == SWITCH_DIM) {
+		// Switch type 'dim' is two short pulses
+		pulses[count++] = PULSE_SHORT;
+		pulses[count++] = PULSE_SHORT;
+	} else {
+		ENCODE_BIT(switchType == SWITCH_ON);
+	}
 
-		_sendUnit(unit);
+	for (int8_t i=3; i>=0; i--) {
+		ENCODE_BIT(unit & 1<<i);
+	}
 
+	if (switchType == SWITCH_DIM) {
 		for (int8_t j=3; j>=0; j--) {
-		   _sendBit(dimLevel & 1<<j);
+			ENCODE_BIT(dimLevel & 1<<j);
 		}
+	}
 
-		_sendStopPulse();
+	#undef ENCODE_BIT
 
-		yield();
-	}
+	pulses[count++] = PULSE_STOP;
+	return count;
 }
 
-void NewRemoteTransmitter::sendGroupDim(byte dimLevel) {
-	for (int8_t i = _repeats; i >= 0; i--) {
-		_sendStartPulse();
+unsigned long NewRemoteTransmitter::pulseLowTime(byte pulse) const {
+	switch (pulse) {
+		case PULSE_LONG:
+			return _periodusec * 5;
+		case PULSE_START:
+			return _periodusec * 10 + (_periodusec >> 1); // Actually 10.5T insteat of 10.44T. Close enough.
+		case PULSE_STOP:
+			return _periodusec * 40;
+		default:
+			return _periodusec;
+	}
+}
 
-		_sendAddress();
+unsigned long NewRemoteTransmitter::telegramTime(const byte *pulses, byte count) const {
+	unsigned long total = 0;
+	for (byte i = 0; i < count; i++) {
+		total += _periodusec + pulseLowTime(pulses[i]);
+	}
+	return total;
+}
 
-		// No group bit
-		_sendBit(true);
+void NewRemoteTransmitter::_send(boolean group, byte switchType, byte unit, byte dimLevel) {
+	byte pulses[maxPulses];
+	byte count = encodeTelegram(_address, group, switchType, unit, dimLevel, pulses);
 
-		// Switch type 'dim'
-		digitalWrite(_pin, HIGH);
-		delayMicroseconds(_periodusec);
-		digitalWrite(_pin, LOW);
-		delayMicroseconds(_periodusec);
-		digitalWrite(_pin, HIGH);
-		delayMicroseconds(_periodusec);
-		digitalWrite(_pin, LOW);
-		delayMicroseconds(_periodusec);
+	SymbolTiming symbolTiming;
+	for (byte i = 0; i < 4; i++) {
+		symbolTiming.high[i] = _periodusec;
+		symbolTiming.low[i] = pulseLowTime(i);
+	}
 
-		_sendUnit(0);
+	_transmit(pulses, count, symbolTiming, _repeats + 1);
+}
 
-		for (int8_t j=3; j>=0; j--) {
-		   _sendBit(dimLevel & 1<<j);
+void NewRemoteTransmitter::_transmit(const byte *symbols, byte count, const SymbolTiming &symbolTiming, byte telegrams) {
+	timing = {};
+	for (byte i = 0; i < telegrams; i++) {
+		if (_fast) {
+			_sendTelegramFast(symbols, count, symbolTiming);
+		} else {
+			_sendTelegram(symbols, count, symbolTiming);
 		}
-
-		_sendStopPulse();
 		yield();
 	}
 }
 
-void NewRemoteTransmitter::_sendStartPulse(){
-	digitalWrite(_pin, HIGH);
-	delayMicroseconds(_periodusec);
-	digitalWrite(_pin, LOW);
-	delayMicroseconds(_periodusec * 10 + (_periodusec >> 1)); // Actually 10.5T insteat of 10.44T. Close enough.
+void NewRemoteTransmitter::_sendTelegram(const byte *symbols, byte count, const SymbolTiming &symbolTiming) {
+	for (byte i = 0; i < count; i++) {
+		digitalWrite(_pin, HIGH);
+		delayMicroseconds(symbolTiming.high[symbols[i] & 3]);
+		digitalWrite(_pin, LOW);
+		delayMicroseconds(symbolTiming.low[symbols[i] & 3]);
+	}
 }
 
-void NewRemoteTransmitter::_sendAddress() {
-	for (int8_t i=25; i>=0; i--) {
-	   _sendBit((_address >> i) & 1);
+boolean NewRemoteTransmitter::calibrate() {
+#ifdef ESP8266
+	if (_pin > 15) {
+		return false;
 	}
-}
 
-void NewRemoteTransmitter::_sendUnit(byte unit) {
-	for (int8_t i=3; i>=0; i--) {
-	   _sendBit(unit & 1<<i);
+	// Time the deadline check and register write while keeping the pin low
+	uint32_t mask = 1 << _pin;
+	uint32_t total = 0;
+	for (byte i = 0; i < 16; i++) {
+		uint32_t deadline = ESP.getCycleCount() + 1000;
+		while ((int32_t)(ESP.getCycleCount() - deadline) < 0);
+		GPOC = mask;
+		total += ESP.getCycleCount() - deadline;
 	}
-}
 
-void NewRemoteTransmitter::_sendStopPulse() {
-	digitalWrite(_pin, HIGH);
-	delayMicroseconds(_periodusec);
-	digitalWrite(_pin, LOW);
-	delayMicroseconds(_periodusec * 40);
+	_edgeLatency = total / 16;
+	_fast = true;
+	return true;
+#else
+	return false;
+#endif
 }
 
-void NewRemoteTransmitter::_sendBit(boolean isBitOne) {
-	if (isBitOne) {
-		// Send '1'
-		digitalWrite(_pin, HIGH);
-		delayMicroseconds(_periodusec);
-		digitalWrite(_pin, LOW);
-		delayMicroseconds(_periodusec * 5);
-		digitalWrite(_pin, HIGH);
-		delayMicroseconds(_periodusec);
-		digitalWrite(_pin, LOW);
-		delayMicroseconds(_periodusec);
-	} else {
-		// Send '0'
-		digitalWrite(_pin, HIGH);
-		delayMicroseconds(_periodusec);
-		digitalWrite(_pin, LOW);
-		delayMicroseconds(_periodusec);
-		digitalWrite(_pin, HIGH);
-		delayMicroseconds(_periodusec);
-		digitalWrite(_pin, LOW);
-		delayMicroseconds(_periodusec * 5);
+void TRANSMIT_ATTR NewRemoteTransmitter::_sendTelegramFast(const byte *symbols, byte count, const SymbolTiming &symbolTiming) {
+#ifdef ESP8266
+	uint32_t mask = 1 << _pin;
+	uint32_t cyclesPerMicro = ESP.getCpuFreqMHz();
+	uint32_t high[4];
+	uint32_t low[4];
+	for (byte i = 0; i < 4; i++) {
+		high[i] = symbolTiming.high[i] * cyclesPerMicro;
+		low[i] = symbolTiming.low[i] * cyclesPerMicro;
 	}
-}
\ No newline at end of file
+
+	if (timing.edges == 0) {
+		timing.errorMin = INT32_MAX;
+		timing.errorMax = INT32_MIN;
+	}
+
+	// Deadlines are absolute, so a late edge does not shift the ones after it
+	uint32_t deadline = ESP.getCycleCount() + high[0];
+	for (byte i = 0; i < count; i++) {
+		for (byte level = 0; level < 2; level++) {
+			uint32_t target = deadline - _edgeLatency;
+			while ((int32_t)(ESP.getCycleCount() - target) < 0);
+			if (level == 0) {
+				GPOS = mask;
+			} else {
+				GPOC = mask;
+			}
+
+			int32_t error = (int32_t)(ESP.getCycleCount() - deadline);
+			timing.errorMin = min(timing.errorMin, error);
+			timing.errorMax = max(timing.errorMax, error);
+			timing.errorTotal += error < 0 ? -error : error;
+			timing.edges++;
+
+			deadline += level == 0 ? high[symbols[i] & 3] : low[symbols[i] & 3];
+		}
+	}
+
+	// Hold the final low time before returning
+	while ((int32_t)(ESP.getCycleCount() - deadline) < 0);
+#else
+	_sendTelegram(symbols, count, symbolTiming);
+#endif
+}
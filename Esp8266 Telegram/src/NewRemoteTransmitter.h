@@ -77,39 +77,114 @@ class NewRemoteTransmitter {
 		 */
 		void sendGroupDim(byte dimLevel);
 
+		/**
+		 * Switch to the cycle counted transmit path. Edges are written straight to the
+		 * GPIO set/clear registers at absolute deadlines derived from ESP.getCycleCount(),
+		 * so timing errors do not accumulate over a telegram. The delay between reaching
+		 * a deadline and the pin changing is measured here and subtracted from every
+		 * deadline. Only available on ESP8266 for GPIO 0..15; returns false otherwise.
+		 */
+		boolean calibrate();
+
+		/**
+		 * Edge timing of the last command sent with the cycle counted path, all repeats
+		 * included. Errors are the difference between the moment the pin was written and
+		 * its nominal deadline, in CPU cycles.
+		 */
+		struct TimingStats {
+			int32_t errorMin;
+			int32_t errorMax;
+			uint32_t errorTotal;	// Sum of absolute errors
+			uint32_t edges;
+		};
+		TimingStats timing;
+
+		/**
+		 * Low time following each high pulse of one period. Every symbol on air is a
+		 * single period high followed by one of these.
+		 */
+		enum Pulse {
+			PULSE_SHORT = 0,	// 1 period
+			PULSE_LONG = 1,		// 5 periods
+			PULSE_START = 2,	// 10.5 periods, ends the start pulse
+			PULSE_STOP = 3		// 40 periods, ends the stop pulse and the telegram
+		};
+
+		/**
+		 * Switch types, as encoded in the on/off bit position.
+		 */
+		enum SwitchType {
+			SWITCH_OFF = 0,
+			SWITCH_ON = 1,
+			SWITCH_DIM = 2
+		};
+
+		/**
+		 * Maximum number of pulses in a telegram: start, 26 address bits, group, switch,
+		 * 4 unit bits, 4 dim bits (2 pulses per bit) and stop.
+		 */
+		static const byte maxPulses = 2 + 2 * (26 + 1 + 1 + 4 + 4);
+
+		/**
+		 * Encodes one telegram as a list of pulses. This is a pure function, so the
+		 * waveform can be verified without hardware.
+		 *
+		 * @param address	Address [0..2^26-1]
+		 * @param group		True for a group command.
+		 * @param switchType	SWITCH_OFF, SWITCH_ON or SWITCH_DIM.
+		 * @param unit		[0..15] target unit, ignored for group commands.
+		 * @param dimLevel	[0..15] Dim level, only used for SWITCH_DIM.
+		 * @param pulses	Buffer of at least maxPulses entries.
+		 * @return		Number of pulses written.
+		 */
+		static byte encodeTelegram(unsigned long address, boolean group, byte switchType, byte unit, byte dimLevel, byte *pulses);
+
+		/**
+		 * Duration in microseconds of the low time after a pulse.
+		 */
+		unsigned long pulseLowTime(byte pulse) const;
+
+		/**
+		 * Air time in microseconds of one telegram, repeats not included.
+		 */
+		unsigned long telegramTime(const byte *pulses, byte count) const;
+
 	// protected:
 		unsigned long _address;		// Address of this transmitter.
 		byte _pin;					// Transmitter output pin
 		unsigned int _periodusec;	// Oscillator period in microseconds
 		byte _repeats;				// Number over repetitions of one telegram
+		boolean _fast;				// Use the cycle counted transmit path
+		uint32_t _edgeLatency;		// Cycles between a deadline and the pin changing
 
 		/**
-		 * Transmits start-pulse
+		 * High and low time in microseconds of up to 4 symbols. For this protocol the
+		 * symbols are the pulses above; other protocols bring their own table.
 		 */
-		void _sendStartPulse();
+		struct SymbolTiming {
+			unsigned long high[4];
+			unsigned long low[4];
+		};
 
 		/**
-		 * Transmits address part
+		 * Encodes a telegram for the current address and transmits it with all repeats.
 		 */
-		void _sendAddress();
+		void _send(boolean group, byte switchType, byte unit, byte dimLevel);
 
 		/**
-		 * Transmits unit part.
-		 *
-		 * @param unit      [0-15] target unit.
+		 * Transmits a list of symbols the given number of times. This is the engine
+		 * shared by all protocols.
 		 */
-		void _sendUnit(byte unit);
+		void _transmit(const byte *symbols, byte count, const SymbolTiming &symbolTiming, byte telegrams);
 
 		/**
-		 * Transmits stop pulse.
+		 * Transmits one encoded telegram.
 		 */
-		void _sendStopPulse();
+		void _sendTelegram(const byte *symbols, byte count, const SymbolTiming &symbolTiming);
 
 		/**
-		 * Transmits a single bit.
-		 *
-		 * @param isBitOne	True, to send '1', false to send '0'.
+		 * Transmits one encoded telegram using the GPIO registers and the cycle counter.
 		 */
-		void _sendBit(boolean isBitOne);
+		void _sendTelegramFast(const byte *symbols, byte count, const SymbolTiming &symbolTiming);
 };
 #endif
\ No newline at end of file
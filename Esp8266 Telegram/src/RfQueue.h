@@ -0,0 +1,86 @@
+#ifndef RFQUEUE_h
+#define RFQUEUE_h
+
+#include <Arduino.h>
+#include "ChannelTable.h"
+
+#define RF_QUEUE_SIZE MAX_CHANNELS // Commands are coalesced per channel, so every channel fits at once
+
+struct RfCommand
+{
+  byte channel;
+  bool switchOn;
+  unsigned long receivedAt; // millis() when the command arrived
+  byte source;              // RfSource, for the RF log
+};
+
+/**
+ * Fixed size FIFO of pending RF commands. A command for a channel that is
+ * still waiting replaces the pending one, as only the last state matters.
+ */
+class RfQueue
+{
+public:
+  bool push(const RfCommand &command)
+  {
+    for (byte i = 0; i < _count; i++)
+    {
+      RfCommand &pending = _items[(_head + i) % RF_QUEUE_SIZE];
+      if (pending.channel == command.channel)
+      {
+        pending.switchOn = command.switchOn;
+        pending.source = command.source;
+        return true;
+      }
+    }
+
+    if (_count == RF_QUEUE_SIZE)
+    {
+      return false;
+    }
+
+    _items[(_head + _count) % RF_QUEUE_SIZE] = command;
+    _count++;
+    return true;
+  }
+
+  bool pop(RfCommand &command)
+  {
+    if (_count == 0)
+    {
+      return false;
+    }
+
+    command = _items[_head];
+    _head = (_head + 1) % RF_QUEUE_SIZE;
+    _count--;
+    return true;
+  }
+
+  /**
+   * Drop the pending command for a channel, if any.
+   */
+  void cancel(byte channel)
+  {
+    byte kept = 0;
+    for (byte i = 0; i < _count; i++)
+    {
+      const RfCommand &pending = _items[(_head + i) % RF_QUEUE_SIZE];
+      if (pending.channel != channel)
+      {
+        _items[(_head + kept) % RF_QUEUE_SIZE] = pending;
+        kept++;
+      }
+    }
+    _count = kept;
+  }
+
+  byte size() const { return _count; }
+
+private:
+  RfCommand _items[RF_QUEUE_SIZE];
+  byte _head = 0;
+  byte _count = 0;
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef SCENETABLE_h
+#define SCENETABLE_h
+
+#include <Arduino.h>
+#include "ChannelTable.h"
+
+#define MAX_SCENES 8
+#define SCENE_NAME_SIZE 16
+
+// Target level of a channel in a scene
+#define SCENE_NONE 0 // Channel is not part of the scene
+#define SCENE_OFF 1
+#define SCENE_ON 2
+#define SCENE_DIM 16 // SCENE_DIM + dim level 0..15
+
+struct Scene
+{
+  char name[SCENE_NAME_SIZE]; // Empty for an unused scene
+  byte levels[MAX_CHANNELS];
+};
+
+/**
+ * One telegram of a scene, with all repeats.
+ */
+struct SceneFrame
+{
+  byte protocol;
+  bool group;
+  byte switchType; // NewRemoteTransmitter::SwitchType
+  byte unit;
+  byte dimLevel;
+  unsigned long address;
+  byte source; // RfSource of the command that planned the frame, for the RF log
+};
+
+/**
+ * Frames of planned scenes, sent one per loop. New plans are appended, so a
+ * scene started while another is still being sent does not cut it short.
+ */
+class ScenePlan
+{
+public:
+  void clear() { _count = _position = 0; }
+  bool add(const SceneFrame &frame);
+  bool pop(SceneFrame &frame);
+  byte size() const { return _count - _position; }
+
+  /**
+   * Drop the frames added after size() was waiting.
+   */
+  void truncate(byte waiting) { _count = _position + waiting; }
+
+private:
+  SceneFrame _frames[MAX_CHANNELS];
+  byte _count = 0;
+  byte _position = 0;
+};
+
+/**
+ * Named presets for many channels at once, stored in the "scenes" file as
+ * "<name> <channel>=<on|off|dimN> ...".
+ */
+class SceneTable
+{
+public:
+  void load();
+  void save();
+
+  /**
+   * Define or replace a scene from text like "evening 0=on 3=off 4=dim8".
+   * Names are a single word of letters, digits, '-' and '_'.
+   * Channels are counted from channelBase. Returns the scene index, -1 on
+   * invalid input or a full table.
+   */
+  int define(const char *text, byte channelBase = 0);
+  bool remove(const char *name);
+  int find(const char *name) const;
+
+  const char *name(byte index) const { return _scenes[index].name; }
+  const Scene &operator[](byte index) const { return _scenes[index]; }
+  String describe(byte index, byte channelBase = 0) const;
+
+  /**
+   * Plan the fewest frames that bring the first activeChannels channels to the
+   * levels of a scene, appended to plan. Returns false when the plan is full,
+   * leaving plan as it was.
+   * Channels known to be in the requested on/off state are skipped. When the
+   * scene sets all 16 units of a KaKu address, one group frame sets the most
+   * common level and unit frames only correct the channels that differ, if
+   * that takes fewer frames. A group frame followed by corrections is only
+   * used when no unit is switched off, so no receiver flashes. The frames
+   * carry source, the RfSource they are logged with.
+   */
+  static bool plan(const Scene &scene, const ChannelTable &channels, byte activeChannels, uint64_t known, uint64_t state, ScenePlan &plan, byte source);
+
+private:
+  Scene _scenes[MAX_SCENES] = {};
+};
+
+/**
+ * Transmit one frame of a plan with all repeats.
+ */
+void sendSceneFrame(NewRemoteTransmitter &transmitter, const SceneFrame &frame);
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef SCHEDULER_h
+#define SCHEDULER_h
+
+#include <Arduino.h>
+#include <time.h>
+
+#define MAX_SCHEDULES 24
+#define SCHEDULE_CATCHUP 60          // Seconds a deadline may be missed by a restart and still fire
+#define SCHEDULE_VALID_TIME 1577836800 // 2020-01-01, before this the clock has not been set
+
+enum ScheduleBase
+{
+  SCHEDULE_TIME,
+  SCHEDULE_SUNRISE,
+  SCHEDULE_SUNSET,
+};
+
+struct ScheduleEntry
+{
+  byte days;       // Bit 0 is Monday, bit 6 Sunday. 0 marks an unused entry.
+  byte base;       // ScheduleBase
+  int16_t minutes; // Local minute of the day, or offset to sunrise or sunset
+  byte channel;
+  bool switchOn;
+};
+
+typedef void (*ScheduleAction)(byte channel, bool switchOn);
+
+/**
+ * Switches channels at fixed local times or relative to sunrise and sunset,
+ * without help from the broker or Telegram. Times are local to the TZ
+ * environment variable.
+ *
+ * Every entry keeps its next deadline, so poll() only compares the clock
+ * with the earliest one. Deadlines are recalculated for the entries that
+ * fired and when the table changes.
+ *
+ * Entries are stored in the "schedules" file, one per line in the format
+ * accepted by add(), e.g. "mtwtf-- 07:30 3 on", "daily sunset-15 0 on".
+ */
+class Scheduler
+{
+public:
+  void begin(ScheduleAction action);
+  void load();
+  void save();
+
+  /**
+   * Position used for sunrise and sunset, in degrees. East and north are
+   * positive.
+   */
+  void setLocation(float latitude, float longitude);
+
+  /**
+   * Add an entry from text: days ("daily" or seven characters Monday to
+   * Sunday, '-' for days off), time ("HH:MM", "sunrise", "sunset+30"),
+   * channel and "on" or "off". Channels are counted from channelBase.
+   * Returns the index of the new entry, -1 on invalid input or a full table.
+   */
+  int add(const char *text, byte channelBase = 0);
+  bool remove(byte index);
+
+  /**
+   * Describe an entry in the format accepted by add(). Empty for unused entries.
+   */
+  String describe(byte index, byte channelBase = 0) const;
+
+  /**
+   * Fire the entries that are due. Call from loop() with the current UTC time.
+   */
+  void poll(time_t now);
+
+  time_t next() const { return _next; }
+
+  /**
+   * Minutes after midnight UTC of sunrise or sunset on a day of the year
+   * (1..366), or -1 when the sun does not rise or set that day. This is
+   * accurate to a minute or two, which is plenty for lights.
+   */
+  static int sunEvent(int dayOfYear, float latitude, float longitude, bool sunrise);
+
+  /**
+   * First time after after at which entry fires, 0 if it never does.
+   */
+  time_t deadline(const ScheduleEntry &entry, time_t after) const;
+
+private:
+  ScheduleEntry _entries[MAX_SCHEDULES];
+  time_t _due[MAX_SCHEDULES];
+  time_t _next;
+  time_t _plannedAt;
+  bool _planned;
+  bool _caughtUp; // The first plan after boot has looked back SCHEDULE_CATCHUP seconds
+  float _latitude;
+  float _longitude;
+  ScheduleAction _action;
+
+  void _plan(time_t after);
+  void _updateNext();
+};
+
+#endif
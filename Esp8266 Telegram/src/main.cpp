@@ -2,14 +2,21 @@
 #include <WiFiManager.h>
 #include <FS.h>
 #include <LittleFS.h>
-#include <FastBot.h>
 #include "ntp.h"
+#include "poller.h"
+#include "RfQueue.h"
+#include "ratelimit.h"
 #include "NewRemoteTransmitter.h"
+#include "ChannelTable.h"
+#include "Scheduler.h"
+#include "SceneTable.h"
+#include "FlightRecorder.h"
+#include <base64.h>
 
 // Constants
 #define RF_PIN D5
 #define MAX_USERS 50
-#define BOT_MTBS 1000 // mean time between scan messages
+#define TIMEZONE "CET-1CEST,M3.5.0,M10.5.0/3" // Schedules run on Amsterdam time
 
 // General variables
 long numberOfChannels = 1;
@@ -18,13 +25,57 @@ String telegramPassword = "Digitaal Kantoor"; // Default password
 
 NewRemoteTransmitter transmitter(0, RF_PIN, 260, 4);
 WiFiManager wm;
-FastBot bot;
+TelegramPoller poller;
+RateLimiter limiter;
+ChannelTable channels;
+Scheduler scheduler;
+SceneTable scenes;
+ScenePlan scenePlan;
+FlightRecorder recorder;
 int resetCode = -1;
 
-String inlineKeyboardLabels = "";
-String inlineKeyboardIds = "";
-String settingsKeyboardLabels = "Show password \n Sign out \n Reset receiver";
-String settingsKeyboardIds = "password, logoff, reset";
+/*
+ * Callback payloads are a single verb character, optionally followed by a
+ * channel, page or scene number in decimal. The channel keyboard is rendered from a
+ * flash template so each button can show the last state sent to its channel.
+ * Telegram allows 100 buttons per keyboard, so channels are shown in pages.
+ */
+#define VERB_ON 'n'
+#define VERB_OFF 'f'
+#define VERB_SETTINGS 's'
+#define VERB_PASSWORD 'p'
+#define VERB_LOGOFF 'l'
+#define VERB_RESET 'r'
+#define VERB_STATS 't'
+#define VERB_PAGE 'g'
+#define VERB_SCENE 'c'
+
+#define CHANNELS_PER_PAGE 16
+
+#define STATE_MARK "\xE2\x97\x8F " // Black circle in front of the active button
+
+static const char channelKeyboardRow[] PROGMEM =
+    "[{\"text\":\"%s%ld on\",\"callback_data\":\"n%ld\"},"
+    "{\"text\":\"%s%ld off\",\"callback_data\":\"f%ld\"}],";
+static const char channelKeyboardPrevious[] PROGMEM = "{\"text\":\"\xC2\xAB Previous\",\"callback_data\":\"g%ld\"},";
+static const char channelKeyboardNext[] PROGMEM = "{\"text\":\"Next \xC2\xBB\",\"callback_data\":\"g%ld\"},";
+static const char channelKeyboardScene[] PROGMEM = "{\"text\":\"%s\",\"callback_data\":\"c%u\"},";
+static const char channelKeyboardEnd[] PROGMEM = "{\"text\":\"Settings\",\"callback_data\":\"s\"}]]}";
+static const char channelMenuText[] PROGMEM = "What do you want to do?";
+
+static const char settingsKeyboard[] PROGMEM =
+    "{\"inline_keyboard\":["
+    "[{\"text\":\"Show password\",\"callback_data\":\"p\"}],"
+    "[{\"text\":\"Show statistics\",\"callback_data\":\"t\"}],"
+    "[{\"text\":\"Sign out\",\"callback_data\":\"l\"}],"
+    "[{\"text\":\"Reset receiver\",\"callback_data\":\"r\"}]]}";
+static const char startKeyboard[] PROGMEM = "{\"keyboard\":[[\"Start\"]],\"resize_keyboard\":true}";
+static const char removeKeyboard[] PROGMEM = "{\"remove_keyboard\":true}";
+
+uint64_t channelState = 0; // Last state sent per channel
+uint64_t channelKnown = 0; // Channels that have been switched since boot
+RfQueue rfQueue;
+uint32_t rfDropped = 0; // Commands and scenes lost because the RF queue or scene plan was full
 
 uint32_t users[MAX_USERS]; // Array of users
 
@@ -33,7 +84,6 @@ void writeFile(const char *path, String data);
 void getUsers();
 void saveUsers();
 void saveParamCallback();
-void handleNewMessages(int numNewMessages);
 
 void setupStorage()
 {
@@ -43,6 +93,10 @@ void setupStorage()
     return;
   }
 
+  channels.load();
+  scenes.load();
+  recorder.begin();
+
   if (LittleFS.exists("numberOfChannels"))
   {
     String result = readFile("numberOfChannels");
@@ -54,9 +108,9 @@ void setupStorage()
       numberOfChannels = 1;
     }
 
-    if (numberOfChannels >= 16)
+    if (numberOfChannels >= MAX_CHANNELS)
     {
-      numberOfChannels = 16;
+      numberOfChannels = MAX_CHANNELS;
     }
   }
 
@@ -85,7 +139,7 @@ void setupWifi()
   // wm.resetSettings();
 
   String numberOfChannelsString = String(numberOfChannels);
-  WiFiManagerParameter numberOfChannelsField("numberOfChannels", "Number of receivers", numberOfChannelsString.c_str(), 10, "type=\"number\" min=\"1\" max=\"16\"");
+  WiFiManagerParameter numberOfChannelsField("numberOfChannels", "Number of receivers", numberOfChannelsString.c_str(), 10, "type=\"number\" min=\"1\" max=\"64\"");
   WiFiManagerParameter telegramTokenField("telegramToken", "Telegram Token", telegramToken.c_str(), 256, "placeholder=\"000000000:XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX\"");
   WiFiManagerParameter telegramPasswordField("telegramPassword", "Telegram Password", telegramPassword.c_str(), 256);
 
@@ -112,33 +166,13 @@ void setupWifi()
   Serial.println("Connected to WiFi");
 }
 
-void handleMessage(FB_msg &msg);
+void handleMessage(TelegramMessage &msg);
 void setupTelegram()
 {
-  bot.setToken(telegramToken);
-  bot.attach(handleMessage);
-
-  // Setup menu
-  inlineKeyboardLabels = "";
-  inlineKeyboardIds = "";
-  for (long i = 0; i < numberOfChannels; i++)
-  {
-    inlineKeyboardLabels += String(i + 1) + " on";
-    inlineKeyboardLabels += " \t ";
-    inlineKeyboardLabels += String(i + 1) + " off";
-    inlineKeyboardLabels += " \n ";
-
-    inlineKeyboardIds += "ON_" + String(i);
-    inlineKeyboardIds += ", ";
-    inlineKeyboardIds += "OFF_" + String(i);
-    inlineKeyboardIds += ", ";
-  }
-  inlineKeyboardLabels += "Settings";
-  inlineKeyboardIds += "settings";
+  poller.begin(telegramToken, handleMessage);
 
   // check connection
-  uint8_t res = bot.tick();
-  if (res > 1)
+  if (!poller.check())
   {
     Serial.println("Unable to connect to telegram");
     wm.resetSettings();
@@ -154,6 +188,22 @@ void setupTransmitter()
 
   // Make each transmitter unique
   transmitter._address = (uint32_t)(mac[3] << 16 | mac[4] << 8 | mac[5]);
+  channels.begin(transmitter._address);
+
+  if (!transmitter.calibrate())
+  {
+    Serial.println("Cycle counted transmit not available, using digitalWrite");
+  }
+}
+
+void runSchedule(byte channel, bool switchOn);
+void setupScheduler()
+{
+  setenv("TZ", TIMEZONE, 1);
+  tzset();
+
+  scheduler.begin(runSchedule);
+  scheduler.load();
 }
 
 void setup()
@@ -164,6 +214,7 @@ void setup()
   setupStorage();
   setupWifi();
   setupNTP();
+  setupScheduler();
   setupTelegram();
 }
 
@@ -176,6 +227,7 @@ void loopRestartTimer()
     {
       // Is it 2 o clock GMT at night? (3 or 4 amsterdam time)
       // If yes to both, please reset.
+      recorder.flush();
       ESP.restart();
     }
   }
@@ -186,7 +238,7 @@ void authorize(uint32_t userId);
 void deauthorize(uint32_t userId);
 void loopTelegram()
 {
-  uint8_t res = bot.tick();
+  uint8_t res = poller.tick();
   if (res > 1)
   {
     Serial.print("TICK: ");
@@ -195,9 +247,64 @@ void loopTelegram()
   }
 }
 
+void logTransmission(const SceneFrame &frame, uint32_t latency)
+{
+  RfRecord record = {};
+  record.time = now();
+  record.address = frame.address;
+  record.unit = frame.unit;
+  record.protocol = frame.protocol;
+  record.action = frame.switchType | (frame.group ? RF_LOG_GROUP : 0) | frame.dimLevel << 4;
+  record.source = frame.source;
+  record.repeats = protocolTelegrams(frame.protocol, frame.group);
+  record.latency = min(latency, (uint32_t)RF_LOG_LATENCY_UNKNOWN);
+  recorder.record(record);
+}
+
+void loopTransmitter()
+{
+  // A scene goes first, so buttons pressed after it win
+  SceneFrame frame;
+  if (scenePlan.pop(frame))
+  {
+    logTransmission(frame, RF_LOG_LATENCY_UNKNOWN);
+    sendSceneFrame(transmitter, frame);
+    return;
+  }
+
+  RfCommand command;
+  if (rfQueue.pop(command))
+  {
+    uint32_t latency = millis() - command.receivedAt;
+    poller.recordLatency(latency);
+
+    const ChannelTarget &target = channels[command.channel];
+    byte switchType = command.switchOn ? NewRemoteTransmitter::SWITCH_ON : NewRemoteTransmitter::SWITCH_OFF;
+    SceneFrame sent = {};
+    sent.protocol = target.protocol;
+    sent.group = false;
+    sent.switchType = switchType;
+    sent.unit = target.unit;
+    sent.dimLevel = 0;
+    sent.address = target.address;
+    sent.source = command.source;
+    logTransmission(sent, latency);
+    channels.send(transmitter, command.channel, switchType);
+  }
+}
+
+void loopScheduler()
+{
+  // Only compares the clock with the earliest deadline
+  scheduler.poll(now());
+}
+
 void loop()
 {
   loopTelegram();
+  loopScheduler();
+  loopTransmitter();
+  recorder.loop();
   loopRestartTimer();
 }
 
@@ -257,9 +364,17 @@ String readFile(const char *path)
     return result;
   }
 
+  // Read in blocks instead of growing the String one character at a time
+  char buffer[64];
+  result.reserve(file.size());
   while (file.available())
   {
-    result += (char)file.read();
+    size_t length = file.read((uint8_t *)buffer, sizeof(buffer));
+    if (length == 0)
+    {
+      break;
+    }
+    result.concat(buffer, length);
   }
   file.close();
   return result;
@@ -353,67 +468,536 @@ void deauthorize(uint32_t userId)
   saveUsers();
 }
 
-void handleMessage(FB_msg &msg)
+// bit() is only 32 bits wide
+inline uint64_t channelBit(long channel)
 {
-  if (isAuthorized(msg.userID.toInt()))
+  return 1ULL << channel;
+}
+
+String channelKeyboard(long page)
+{
+  long first = page * CHANNELS_PER_PAGE;
+  long last = min(first + CHANNELS_PER_PAGE, numberOfChannels);
+
+  String result = F("{\"inline_keyboard\":[");
+  result.reserve(CHANNELS_PER_PAGE * 96 + MAX_SCENES * 48 + 192);
+
+  // Room for a row with both state marks and four numbers of any length
+  char row[sizeof(channelKeyboardRow) + 2 * sizeof(STATE_MARK) + 4 * 20];
+  for (long i = first; i < last; i++)
   {
-    if (msg.query)
+    bool known = channelKnown & channelBit(i);
+    bool on = channelState & channelBit(i);
+    snprintf_P(row, sizeof(row), channelKeyboardRow,
+               known && on ? STATE_MARK : "", i + 1, i,
+               known && !on ? STATE_MARK : "", i + 1, i);
+    result += row;
+  }
+
+  // Scenes share one row on the first page
+  bool hasScenes = false;
+  for (byte i = 0; page == 0 && i < MAX_SCENES; i++)
+  {
+    if (scenes.name(i)[0] == '\0')
     {
-      if (msg.data.equals("settings"))
-      {
-        bot.inlineMenuCallback("Here are the possible settings:", settingsKeyboardLabels, settingsKeyboardIds, msg.chatID);
-      }
-      else if (msg.data.equals("password"))
+      continue;
+    }
+    if (!hasScenes)
+    {
+      result += '[';
+      hasScenes = true;
+    }
+    snprintf_P(row, sizeof(row), channelKeyboardScene, scenes.name(i), i);
+    result += row;
+  }
+  if (hasScenes)
+  {
+    result.setCharAt(result.length() - 1, ']');
+    result += ',';
+  }
+
+  // Navigation shares the last row with the settings button
+  result += '[';
+  if (page > 0)
+  {
+    snprintf_P(row, sizeof(row), channelKeyboardPrevious, page - 1);
+    result += row;
+  }
+  if (last < numberOfChannels)
+  {
+    snprintf_P(row, sizeof(row), channelKeyboardNext, page + 1);
+    result += row;
+  }
+  result += FPSTR(channelKeyboardEnd);
+  return result;
+}
+
+// Remember the state shown on the keyboard, returns true when it changed
+bool setChannelState(long channel, bool switchOn)
+{
+  uint64_t mask = channelBit(channel);
+  bool changed = !(channelKnown & mask) || ((channelState & mask) != 0) != switchOn;
+
+  channelKnown |= mask;
+  if (switchOn)
+  {
+    channelState |= mask;
+  }
+  else
+  {
+    channelState &= ~mask;
+  }
+  return changed;
+}
+
+void runSchedule(byte channel, bool switchOn)
+{
+  Serial.printf("Schedule: channel %u %s\n", channel + 1, switchOn ? "on" : "off");
+  if (!rfQueue.push({channel, switchOn, millis(), RF_SOURCE_SCHEDULE}))
+  {
+    Serial.println("RF queue full, schedule dropped");
+    rfDropped++;
+    return;
+  }
+  setChannelState(channel, switchOn);
+}
+
+void handleChannel(TelegramMessage &msg, long channel, bool switchOn)
+{
+  if (!rfQueue.push({(byte)channel, switchOn, poller.receivedAt(), RF_SOURCE_TELEGRAM}))
+  {
+    rfDropped++;
+    poller.sendMessage(msg.chatID, "Too many commands waiting, channel " + String(channel + 1) + " was not switched.", "");
+    return;
+  }
+  bool changed = setChannelState(channel, switchOn);
+
+  // Only touch the menu when a button has to move
+  if (changed)
+  {
+    poller.editMessageReplyMarkup(msg.chatID, msg.messageID, channelKeyboard(channel / CHANNELS_PER_PAGE));
+  }
+}
+
+void handleChannelOn(TelegramMessage &msg, long channel)
+{
+  handleChannel(msg, channel, true);
+}
+
+void handleChannelOff(TelegramMessage &msg, long channel)
+{
+  handleChannel(msg, channel, false);
+}
+
+void handleScene(TelegramMessage &msg, long index)
+{
+  if (index >= MAX_SCENES || scenes.name(index)[0] == '\0')
+  {
+    return;
+  }
+
+  const Scene &scene = scenes[index];
+  if (!SceneTable::plan(scene, channels, numberOfChannels, channelKnown, channelState, scenePlan, RF_SOURCE_SCENE))
+  {
+    rfDropped++;
+    poller.sendMessage(msg.chatID, "Too many commands waiting, scene " + String(scene.name) + " was not started.", "");
+    return;
+  }
+  Serial.printf("Scene %s, %u frames waiting\n", scene.name, scenePlan.size());
+
+  bool changed = false;
+  for (long i = 0; i < numberOfChannels; i++)
+  {
+    if (scene.levels[i] == SCENE_NONE)
+    {
+      continue;
+    }
+
+    // The scene replaces whatever was still waiting for this channel
+    rfQueue.cancel(i);
+    changed |= setChannelState(i, scene.levels[i] != SCENE_OFF);
+  }
+
+  // Scene buttons are on the first page
+  if (changed)
+  {
+    poller.editMessageReplyMarkup(msg.chatID, msg.messageID, channelKeyboard(0));
+  }
+}
+
+void handlePage(TelegramMessage &msg, long page)
+{
+  if (page * CHANNELS_PER_PAGE >= numberOfChannels)
+  {
+    return;
+  }
+  poller.editMessageReplyMarkup(msg.chatID, msg.messageID, channelKeyboard(page));
+}
+
+void handleSettings(TelegramMessage &msg, long)
+{
+  poller.sendMessage(msg.chatID, F("Here are the possible settings:"), FPSTR(settingsKeyboard));
+}
+
+void handlePassword(TelegramMessage &msg, long)
+{
+  String reply = "The password is: " + telegramPassword;
+  poller.sendMessage(msg.chatID, reply, "");
+}
+
+void handleStats(TelegramMessage &msg, long)
+{
+  String reply = poller.statsText();
+  reply += "\nLimited: " + String(limiter.stats.limited);
+  reply += "\nLocked out: " + String(limiter.stats.lockedOut);
+  reply += "\nWrong passwords: " + String(limiter.stats.failures);
+  reply += "\nRF queue full: " + String(rfDropped);
+
+  const NewRemoteTransmitter::TimingStats &timing = transmitter.timing;
+  if (timing.edges > 0)
+  {
+    // Edge errors are measured in CPU cycles
+    float cyclesPerMicro = ESP.getCpuFreqMHz();
+    reply += "\nRF edge error: " + String(timing.errorMin / cyclesPerMicro, 2);
+    reply += " to " + String(timing.errorMax / cyclesPerMicro, 2);
+    reply += " us, avg " + String(timing.errorTotal / cyclesPerMicro / timing.edges, 2) + " us";
+  }
+  poller.sendMessage(msg.chatID, reply, "");
+}
+
+void handleLogoff(TelegramMessage &msg, long)
+{
+  deauthorize(atol(msg.userID));
+  String reply = "You are logged off.";
+  poller.sendMessage(msg.chatID, reply, FPSTR(removeKeyboard));
+}
+
+void handleReset(TelegramMessage &msg, long)
+{
+  // Generate random number before allowing to continue
+  randomSeed(ESP.getCycleCount());
+  resetCode = random(100000, 999999);
+  String reply = "Are you sure? Type 'Reset " + String(resetCode, DEC) + "' to reset this device to factory settings.";
+  poller.sendMessage(msg.chatID, reply, FPSTR(removeKeyboard));
+}
+
+// Handlers of ARG_NONE routes leave the argument unnamed, it is always -1
+typedef void (*CallbackHandler)(TelegramMessage &msg, long channel);
+
+enum CallbackArgument
+{
+  ARG_NONE,
+  ARG_CHANNEL, // Checked against the number of channels
+  ARG_NUMBER,  // Checked by the handler
+};
+
+struct CallbackRoute
+{
+  char verb;
+  byte argument;
+  CallbackHandler handler;
+};
+
+const CallbackRoute callbackRoutes[] = {
+    {VERB_ON, ARG_CHANNEL, handleChannelOn},
+    {VERB_OFF, ARG_CHANNEL, handleChannelOff},
+    {VERB_PAGE, ARG_NUMBER, handlePage},
+    {VERB_SCENE, ARG_NUMBER, handleScene},
+    {VERB_SETTINGS, ARG_NONE, handleSettings},
+    {VERB_PASSWORD, ARG_NONE, handlePassword},
+    {VERB_STATS, ARG_NONE, handleStats},
+    {VERB_LOGOFF, ARG_NONE, handleLogoff},
+    {VERB_RESET, ARG_NONE, handleReset},
+};
+
+void handleCallback(TelegramMessage &msg)
+{
+  const char *data = msg.data;
+  size_t length = strlen(msg.data);
+
+  // Stop the spinner on the button before doing anything else
+  poller.answerCallbackQuery(msg.queryID);
+
+  if (length < 1 || length > 3)
+  {
+    return;
+  }
+
+  for (const CallbackRoute &route : callbackRoutes)
+  {
+    if (route.verb != data[0])
+    {
+      continue;
+    }
+
+    long channel = -1;
+    if (route.argument != ARG_NONE)
+    {
+      char *end;
+      channel = strtol(data + 1, &end, 10);
+      if (end == data + 1 || *end != '\0' || channel < 0)
       {
-        String reply = "The password is: " + telegramPassword;
-        bot.sendMessage(reply, msg.chatID);
+        return;
       }
-      else if (msg.data.equals("logoff"))
+      if (route.argument == ARG_CHANNEL && channel >= numberOfChannels)
       {
-        deauthorize(msg.userID.toInt());
-        String reply = "You are logged off.";
-        bot.closeMenuText(reply, msg.chatID);
+        return;
       }
-      else if (msg.data.equals("reset"))
+    }
+    else if (length != 1)
+    {
+      return;
+    }
+
+    route.handler(msg, channel);
+    return;
+  }
+}
+
+// "Channel 3 elro 21 2" points the third channel at another receiver, "Channel 3" shows it
+void handleChannelProtocol(TelegramMessage &msg)
+{
+  char *text;
+  long channel = strtol(msg.text + 8, &text, 10) - 1;
+  if (channel < 0 || channel >= numberOfChannels)
+  {
+    poller.sendMessage(msg.chatID, "Unknown channel.", "");
+    return;
+  }
+
+  if (*text != '\0' && (msg.truncated || !channels.configure(channel, text)))
+  {
+    poller.sendMessage(msg.chatID, "Use: Channel <number> <kaku|kakuold|action|elro> <address> <unit>", "");
+    return;
+  }
+
+  if (*text != '\0')
+  {
+    channels.save();
+  }
+  poller.sendMessage(msg.chatID, "Channel " + String(channel + 1) + ": " + channels.describe(channel), "");
+}
+
+/*
+ * "Schedule" lists the schedules, "Schedule mtwtf-- 07:30 3 on" adds one,
+ * "Schedule remove 2" removes one and "Schedule location 52.37 4.90" sets
+ * the position used for sunrise and sunset. Channels and schedules are
+ * counted from 1, like on the keyboard.
+ */
+void handleScheduleCommand(TelegramMessage &msg)
+{
+  const char *text = msg.text + 8;
+  if (strcasecmp(text, "s") == 0)
+  {
+    text++; // "Schedules"
+  }
+  while (*text == ' ')
+  {
+    text++;
+  }
+
+  bool changed = false;
+  if (*text == '\0')
+  {
+    String reply = "Schedules:";
+    for (byte i = 0; i < MAX_SCHEDULES; i++)
+    {
+      String entry = scheduler.describe(i, 1);
+      if (entry.length() > 0)
       {
-        // Generate random number before allowing to continue
-        randomSeed(ESP.getCycleCount());
-        resetCode = random(100000, 999999);
-        String reply = "Are you sure? Type 'Reset " + String(resetCode, DEC) + "' to reset this device to factory settings.";
-        bot.closeMenuText(reply, msg.chatID);
+        reply += "\n" + String(i + 1) + ": " + entry;
       }
-      else
+    }
+    poller.sendMessage(msg.chatID, reply, "");
+    return;
+  }
+  else if (msg.truncated)
+  {
+    // Never act on part of a command
+  }
+  else if (strncasecmp(text, "remove ", 7) == 0)
+  {
+    long index = atol(text + 7) - 1;
+    changed = index >= 0 && index < MAX_SCHEDULES && scheduler.remove(index);
+  }
+  else if (strncasecmp(text, "location ", 9) == 0)
+  {
+    float latitude, longitude;
+    changed = sscanf(text + 9, "%f %f", &latitude, &longitude) == 2;
+    if (changed)
+    {
+      scheduler.setLocation(latitude, longitude);
+    }
+  }
+  else
+  {
+    changed = scheduler.add(text, 1) >= 0;
+  }
+
+  if (!changed)
+  {
+    poller.sendMessage(msg.chatID, "Use: Schedule <mtwtfss|daily> <HH:MM|sunrise+M|sunset-M> <channel> <on|off>", "");
+    return;
+  }
+
+  scheduler.save();
+  poller.sendMessage(msg.chatID, "Schedules saved.", "");
+}
+
+/*
+ * "Scenes" lists the scenes, "Scene evening 1=on 2=off 3=dim8" defines one
+ * and "Scene remove evening" removes it. Defined scenes get a button on the
+ * first page of the keyboard.
+ */
+void handleSceneCommand(TelegramMessage &msg)
+{
+  const char *text = msg.text + 5;
+  if (strcasecmp(text, "s") == 0)
+  {
+    text++; // "Scenes"
+  }
+  while (*text == ' ')
+  {
+    text++;
+  }
+
+  bool changed = false;
+  if (*text == '\0')
+  {
+    String reply = "Scenes:";
+    for (byte i = 0; i < MAX_SCENES; i++)
+    {
+      if (scenes.name(i)[0] != '\0')
       {
-        String id;
-        for (long i = 0; i < numberOfChannels; i++)
-        {
-          // String label = String(i + 1) + " on";
-          id = "ON_" + String(i);
-          if (msg.data.equals(id))
-          {
-            transmitter.sendUnit(i,true);
-            bot.sendMessage("Device is turned on.", msg.chatID);
-            return;
-          }
-
-          id = "OFF_" + String(i);
-          if (msg.data.equals(id))
-          {
-            transmitter.sendUnit(i,false);
-            bot.sendMessage("Device is turned off.", msg.chatID);
-            return;
-          }
-        }
+        reply += "\n" + scenes.describe(i, 1);
       }
     }
+    poller.sendMessage(msg.chatID, reply, "");
+    return;
+  }
+  else if (msg.truncated)
+  {
+    // Never act on part of a command
+  }
+  else if (strncasecmp(text, "remove ", 7) == 0)
+  {
+    changed = scenes.remove(text + 7);
+  }
+  else
+  {
+    changed = scenes.define(text, 1) >= 0;
+  }
+
+  if (!changed)
+  {
+    poller.sendMessage(msg.chatID, "Use: Scene <name> <channel>=<on|off|dim0..15> ... or Scene remove <name>", "");
+    return;
+  }
+
+  scenes.save();
+  poller.sendMessage(msg.chatID, "Scenes saved.", "");
+}
+
+/**
+ * Sends what is written to it as base64, in messages well below the
+ * Telegram limit. Chunks are a multiple of 3 bytes, so the messages can be
+ * joined and decoded as one.
+ */
+class Base64Messages : public Print
+{
+public:
+  Base64Messages(const String &chatID) : _chatID(chatID) {}
+
+  size_t write(uint8_t c) override
+  {
+    _chunk[_length++] = c;
+    if (_length == sizeof(_chunk))
+    {
+      flush();
+    }
+    return 1;
+  }
+
+  void flush()
+  {
+    if (_length > 0)
+    {
+      poller.sendMessage(_chatID, base64::encode(_chunk, _length, false), "");
+      _length = 0;
+    }
+  }
+
+private:
+  const String &_chatID;
+  uint8_t _chunk[768];
+  size_t _length = 0;
+};
+
+static const char *const logSources[] = {"mqtt", "telegram", "schedule", "scene", "lan", "udp"};
+static const char *const logActions[] = {"off", "on", "dim", "?"};
+
+/**
+ * "Log" shows the last transmissions, "Log dump" sends the whole RF log as
+ * base64 for rflog-decode.py.
+ */
+void handleLogCommand(TelegramMessage &msg)
+{
+  if (strcasecmp(msg.text, "Log dump") == 0)
+  {
+    Base64Messages out(msg.chatID);
+    recorder.dump(out);
+    out.flush();
+    return;
+  }
+
+  String reply = "Last transmissions (UTC):";
+  uint16_t count = recorder.count();
+  for (uint16_t i = count > 10 ? count - 10 : 0; i < count; i++)
+  {
+    RfRecord record;
+    if (!recorder.read(i, record))
+    {
+      break;
+    }
+
+    char line[80];
+    snprintf_P(line, sizeof(line), PSTR("\n%02d-%02d %02d:%02d:%02d %s %lu/"),
+               day(record.time), month(record.time), hour(record.time), minute(record.time), second(record.time),
+               record.source < 6 ? logSources[record.source] : "?", (unsigned long)record.address);
+    reply += line;
+    reply += record.action & RF_LOG_GROUP ? String("group") : String(record.unit);
+    reply += " ";
+    reply += logActions[record.action & 0x03];
+    if ((record.action & 0x03) == NewRemoteTransmitter::SWITCH_DIM)
+    {
+      reply += " " + String(record.action >> 4);
+    }
+    if (record.latency != RF_LOG_LATENCY_UNKNOWN)
+    {
+      reply += " " + String(record.latency) + " ms";
+    }
+  }
+  poller.sendMessage(msg.chatID, reply, "");
+}
+
+void handleMessage(TelegramMessage &msg)
+{
+  uint32_t userId = atol(msg.userID);
+
+  if (isAuthorized(userId))
+  {
+    if (msg.query)
+    {
+      handleCallback(msg);
+    }
     else
     {
-      if (msg.text.equalsIgnoreCase("Reset " + String(resetCode, DEC)))
+      if (strcasecmp(msg.text, ("Reset " + String(resetCode, DEC)).c_str()) == 0)
       {
         if (resetCode != -1)
         {
           String reply = "Device will be reset.";
-          bot.sendMessage(reply, msg.chatID);
+          poller.sendMessage(msg.chatID, reply, "");
           delay(1000);
           wm.resetSettings();
           LittleFS.format();
@@ -421,25 +1005,44 @@ void handleMessage(FB_msg &msg)
           ESP.restart();
         }
       }
+      else if (strncasecmp(msg.text, "Channel ", 8) == 0)
+      {
+        handleChannelProtocol(msg);
+      }
+      else if (strncasecmp(msg.text, "Schedule", 8) == 0)
+      {
+        handleScheduleCommand(msg);
+      }
+      else if (strncasecmp(msg.text, "Scene", 5) == 0)
+      {
+        handleSceneCommand(msg);
+      }
+      else if (strcasecmp(msg.text, "Log") == 0 || strcasecmp(msg.text, "Log dump") == 0)
+      {
+        handleLogCommand(msg);
+      }
       else
       {
-        bot.inlineMenuCallback("What do you want to do?", inlineKeyboardLabels, inlineKeyboardIds, msg.chatID);
+        poller.sendMessage(msg.chatID, FPSTR(channelMenuText), channelKeyboard(0));
       }
     }
   }
-  else
+  else if (limiter.allow(userId, millis()))
   {
-    if (msg.text.equals(telegramPassword))
+    // Unknown senders are limited before anything is compared or sent
+    if (!msg.truncated && telegramPassword.equals(msg.text))
     {
-      authorize(msg.userID.toInt());
+      limiter.forget(userId);
+      authorize(userId);
 
-      String reply = "Dear " + msg.first_name + ", you are logged on. Type /start to control your devices.";
-      bot.showMenuText(reply, "Start", msg.chatID);
+      String reply = "Dear " + String(msg.first_name) + ", you are logged on. Type /start to control your devices.";
+      poller.sendMessage(msg.chatID, reply, FPSTR(startKeyboard));
     }
     else
     {
-      String reply = "Dear " + msg.first_name + ", please give the secret code before you continue.";
-      bot.closeMenuText(reply, msg.chatID);
+      limiter.failed(userId, millis());
+      String reply = "Dear " + String(msg.first_name) + ", please give the secret code before you continue.";
+      poller.sendMessage(msg.chatID, reply, FPSTR(removeKeyboard));
     }
   }
 }
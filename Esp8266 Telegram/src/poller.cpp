@@ -0,0 +1,353 @@
+#include "poller.h"
+
+// Append text as the contents of a JSON string
+static void jsonEscape(String &json, const String &text)
+{
+  for (unsigned int i = 0; i < text.length(); i++)
+  {
+    char c = text.charAt(i);
+    if (c == '"' || c == '\\')
+    {
+      json += '\\';
+      json += c;
+    }
+    else if (c == '\n')
+    {
+      json += "\\n";
+    }
+    else if ((uint8_t)c >= 0x20)
+    {
+      json += c;
+    }
+  }
+}
+
+void TelegramPoller::begin(const String &token, TelegramHandler handler)
+{
+  _token = token;
+  _handler = handler;
+  _client.setInsecure();
+  _client.setTimeout(5000);
+  _hourStartedAt = millis();
+  stats.timeout = _timeout;
+}
+
+bool TelegramPoller::check()
+{
+  _client.stop();
+  _waiting = false;
+
+  if (!_sendRequest(0))
+  {
+    return false;
+  }
+
+  unsigned long start = millis();
+  while (!_client.available())
+  {
+    if (millis() - start > 10000 || !_client.connected())
+    {
+      _failed();
+      return false;
+    }
+    delay(10);
+  }
+  return _readResponse() <= 1;
+}
+
+uint8_t TelegramPoller::tick()
+{
+  if (!_waiting)
+  {
+    if ((long)(millis() - _nextPollAt) < 0)
+    {
+      return 0;
+    }
+
+    if (!_sendRequest(_timeout))
+    {
+      _failed();
+      return 4;
+    }
+    return 0;
+  }
+
+  if (_client.available())
+  {
+    return _readResponse();
+  }
+
+  // Allow some slack on top of the server-side timeout before giving up
+  if (millis() - _requestedAt > (_timeout + 10) * 1000UL || !_client.connected())
+  {
+    _failed();
+    return 4;
+  }
+
+  return 0;
+}
+
+bool TelegramPoller::answerCallbackQuery(const String &queryID)
+{
+  return _call("answerCallbackQuery", "{\"callback_query_id\":\"" + queryID + "\"}");
+}
+
+bool TelegramPoller::sendMessage(const String &chatID, const String &text, const String &replyMarkup)
+{
+  String json = "{\"chat_id\":" + chatID;
+  json += ",\"text\":\"";
+  jsonEscape(json, text);
+  json += "\"";
+  if (replyMarkup.length() > 0)
+  {
+    json += ",\"reply_markup\":" + replyMarkup;
+  }
+  json += "}";
+  return _call("sendMessage", json);
+}
+
+bool TelegramPoller::editMessageReplyMarkup(const String &chatID, int32_t messageID, const String &replyMarkup)
+{
+  String json = "{\"chat_id\":" + chatID;
+  json += ",\"message_id\":" + String(messageID);
+  json += ",\"reply_markup\":" + replyMarkup + "}";
+  return _call("editMessageReplyMarkup", json);
+}
+
+void TelegramPoller::recordLatency(uint32_t latency)
+{
+  stats.latencyCount++;
+  stats.latencyTotal += latency;
+  if (latency > stats.latencyMax)
+  {
+    stats.latencyMax = latency;
+  }
+}
+
+String TelegramPoller::statsText()
+{
+  String result = "Requests: " + String(stats.requests);
+  result += "\nRequests last hour: " + String(stats.requestsLastHour);
+  result += "\nErrors: " + String(stats.errors);
+  result += "\nPoll timeout: " + String(stats.timeout) + " s";
+  if (stats.latencyCount > 0)
+  {
+    result += "\nTap to transmit: " + String(stats.latencyTotal / stats.latencyCount) + " ms avg, ";
+    result += String(stats.latencyMax) + " ms max";
+  }
+  return result;
+}
+
+bool TelegramPoller::_connect()
+{
+  if (_client.connected())
+  {
+    return true;
+  }
+
+  _client.stop();
+  if (!_client.connect(TELEGRAM_HOST, TELEGRAM_PORT))
+  {
+    Serial.println("Unable to connect to telegram");
+    return false;
+  }
+  return true;
+}
+
+bool TelegramPoller::_sendRequest(uint16_t timeout)
+{
+  if (!_connect())
+  {
+    return false;
+  }
+
+  // Send the whole request in one TLS record
+  String request = "GET /bot" + _token;
+  request += "/getUpdates?limit=" + String(POLL_LIMIT);
+  request += "&timeout=" + String(timeout);
+  request += "&offset=" + String(_offset);
+  request += " HTTP/1.1\r\nHost: " TELEGRAM_HOST "\r\nConnection: keep-alive\r\n\r\n";
+  _client.print(request);
+
+  _waiting = true;
+  _requestedAt = millis();
+  _countRequest();
+  return true;
+}
+
+bool TelegramPoller::_call(const char *method, const String &json)
+{
+  // The polling connection is only free between two getUpdates requests
+  if (_waiting || !_connect())
+  {
+    return false;
+  }
+
+  String request = "POST /bot" + _token + "/" + method;
+  request += " HTTP/1.1\r\nHost: " TELEGRAM_HOST "\r\nContent-Type: application/json\r\nContent-Length: ";
+  request += String(json.length());
+  request += "\r\nConnection: keep-alive\r\n\r\n";
+  request += json;
+  _client.print(request);
+  _countRequest();
+
+  long contentLength;
+  int status = _readHead(contentLength);
+  _readBody(contentLength, nullptr);
+
+  if (status != 200)
+  {
+    Serial.printf("%s failed with status %d\n", method, status);
+    stats.errors++;
+    return false;
+  }
+  return true;
+}
+
+int TelegramPoller::_readHead(long &contentLength)
+{
+  // Header lines are read into a fixed buffer, longer lines are skipped
+  char line[48];
+  size_t length = _client.readBytesUntil('\n', line, sizeof(line) - 1);
+  line[length] = '\0';
+
+  int status = length > 12 ? atoi(line + 9) : 0;
+  contentLength = -1;
+  _keepAlive = true;
+
+  while (_client.connected() || _client.available())
+  {
+    length = _client.readBytesUntil('\n', line, sizeof(line) - 1);
+    line[length] = '\0';
+    if (length <= 1)
+    {
+      break;
+    }
+
+    if (length == sizeof(line) - 1)
+    {
+      _client.find("\n");
+    }
+
+    if (strncasecmp_P(line, PSTR("content-length:"), 15) == 0)
+    {
+      contentLength = atol(line + 15);
+    }
+    else if (strncasecmp_P(line, PSTR("connection: close"), 17) == 0)
+    {
+      _keepAlive = false;
+    }
+  }
+  return status;
+}
+
+void TelegramPoller::_readBody(long contentLength, UpdateParser *parser)
+{
+  if (contentLength < 0)
+  {
+    // Without a length the body ends when the server closes the connection
+    contentLength = LONG_MAX;
+    _keepAlive = false;
+  }
+
+  char buffer[128];
+  unsigned long start = millis();
+  long received = 0;
+  while (received < contentLength && (_client.connected() || _client.available()))
+  {
+    size_t wanted = min((long)sizeof(buffer), contentLength - received);
+    int length = _client.read((uint8_t *)buffer, wanted);
+    if (length <= 0)
+    {
+      if (millis() - start > 5000)
+      {
+        break;
+      }
+      yield();
+      continue;
+    }
+
+    received += length;
+    if (parser != nullptr)
+    {
+      parser->feed(buffer, length);
+    }
+  }
+
+  if (!_keepAlive)
+  {
+    _client.stop();
+  }
+}
+
+uint8_t TelegramPoller::_readResponse()
+{
+  unsigned long arrivedAt = millis();
+  _waiting = false;
+
+  // Updates are parsed one by one straight from the TLS stream
+  long contentLength;
+  int status = _readHead(contentLength);
+  _parser.begin(_messages, POLL_LIMIT);
+  _readBody(contentLength, &_parser);
+
+  if (status != 200 || !_parser.ok())
+  {
+    Serial.printf("getUpdates failed with status %d\n", status);
+    _failed();
+    return 3;
+  }
+
+  _retryDelay = 0;
+  _nextPollAt = millis();
+
+  if (_parser.updates() == 0)
+  {
+    // Nothing happened during the whole timeout, poll less often
+    _timeout = min(_timeout * 2, POLL_TIMEOUT_MAX);
+    stats.timeout = _timeout;
+    return 0;
+  }
+
+  _offset = _parser.lastUpdateId() + 1;
+  _timeout = POLL_TIMEOUT_MIN;
+  stats.timeout = _timeout;
+  _receivedAt = arrivedAt;
+
+  // The body has been consumed, so handlers may use the connection again
+  for (uint8_t i = 0; i < _parser.count(); i++)
+  {
+    if (_handler != nullptr)
+    {
+      _handler(_messages[i]);
+    }
+  }
+
+  _receivedAt = 0;
+  return 1;
+}
+
+void TelegramPoller::_failed()
+{
+  stats.errors++;
+  _waiting = false;
+  _client.stop();
+
+  // Back off exponentially while Telegram or the network is unreachable
+  _retryDelay = _retryDelay == 0 ? POLL_RETRY_MIN : min(_retryDelay * 2, (uint32_t)POLL_RETRY_MAX);
+  _nextPollAt = millis() + _retryDelay;
+}
+
+void TelegramPoller::_countRequest()
+{
+  stats.requests++;
+  _requestsThisHour++;
+
+  if (millis() - _hourStartedAt >= 3600000UL)
+  {
+    stats.requestsLastHour = _requestsThisHour;
+    _requestsThisHour = 0;
+    _hourStartedAt = millis();
+    Serial.printf("Telegram: %u requests in the last hour\n", stats.requestsLastHour);
+  }
+}
@@ -0,0 +1,108 @@
+#ifndef TELEGRAMPOLLER_h
+#define TELEGRAMPOLLER_h
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+#include "updateparser.h"
+
+// Override with build_flags to point the bridge at a local Bot API stand-in
+#ifndef TELEGRAM_HOST
+#define TELEGRAM_HOST "api.telegram.org"
+#endif
+#ifndef TELEGRAM_PORT
+#define TELEGRAM_PORT 443
+#endif
+
+#define POLL_TIMEOUT_MIN 10    // Server-side timeout in seconds right after activity
+#define POLL_TIMEOUT_MAX 50    // Server-side timeout in seconds once the chat is idle
+#define POLL_RETRY_MIN 1000    // First retry delay in ms after a failed request
+#define POLL_RETRY_MAX 60000   // Maximum retry delay in ms
+#define POLL_LIMIT 5           // Maximum number of updates per response
+
+typedef void (*TelegramHandler)(TelegramMessage &msg);
+
+struct TelegramPollStats
+{
+  uint32_t requests;         // getUpdates requests since boot
+  uint32_t requestsLastHour; // getUpdates requests during the last full hour
+  uint32_t errors;           // Failed requests since boot
+  uint16_t timeout;          // Current server-side timeout in seconds
+  uint32_t latencyCount;     // Number of transmissions measured
+  uint32_t latencyTotal;     // Sum of update-to-transmit latencies in ms
+  uint32_t latencyMax;       // Worst update-to-transmit latency in ms
+};
+
+/**
+ * Receives updates with getUpdates long polling. The request is held open by
+ * Telegram until an update arrives or the timeout expires, so a tap is
+ * delivered right away while an idle bot only makes a request every
+ * POLL_TIMEOUT_MAX seconds. tick() never blocks while waiting for the server.
+ */
+class TelegramPoller
+{
+public:
+  void begin(const String &token, TelegramHandler handler);
+
+  /**
+   * Poll for updates. Returns 0 while waiting, 1 when updates were handled
+   * and a value above 1 on errors.
+   */
+  uint8_t tick();
+
+  /**
+   * Blocking request without server-side timeout, used to verify the token.
+   */
+  bool check();
+
+  /**
+   * Bot API calls made from within the handler. They reuse the idle polling
+   * connection, so no extra TLS handshake is needed. Payloads are JSON, text
+   * is escaped here and replyMarkup is passed on as is.
+   */
+  bool answerCallbackQuery(const String &queryID);
+  bool sendMessage(const String &chatID, const String &text, const String &replyMarkup);
+  bool editMessageReplyMarkup(const String &chatID, int32_t messageID, const String &replyMarkup);
+
+  /**
+   * Time at which the update currently being handled arrived.
+   */
+  unsigned long receivedAt() { return _receivedAt; }
+
+  /**
+   * Record the latency between receiving an update and starting its RF
+   * transmission.
+   */
+  void recordLatency(uint32_t latency);
+
+  String statsText();
+
+  TelegramPollStats stats;
+
+private:
+  BearSSL::WiFiClientSecure _client;
+  String _token;
+  TelegramHandler _handler = nullptr;
+  int32_t _offset = 0;
+  uint16_t _timeout = POLL_TIMEOUT_MIN;
+  uint32_t _retryDelay = 0;
+  unsigned long _nextPollAt = 0;
+  unsigned long _requestedAt = 0;
+  unsigned long _receivedAt = 0;
+  unsigned long _hourStartedAt = 0;
+  uint32_t _requestsThisHour = 0;
+  bool _waiting = false;
+  bool _keepAlive = true;
+  UpdateParser _parser;
+  TelegramMessage _messages[POLL_LIMIT];
+
+  bool _connect();
+  bool _sendRequest(uint16_t timeout);
+  bool _call(const char *method, const String &json);
+  int _readHead(long &contentLength);
+  void _readBody(long contentLength, UpdateParser *parser);
+  uint8_t _readResponse();
+  void _failed();
+  void _countRequest();
+};
+
+#endif
@@ -0,0 +1,107 @@
+#include "ratelimit.h"
+
+bool RateLimiter::allow(uint32_t userId, uint32_t now)
+{
+  Sender *sender = _findOrAdd(userId, now);
+  sender->lastSeen = now;
+
+  if ((int32_t)(now - sender->lockedUntil) < 0)
+  {
+    stats.lockedOut++;
+    return false;
+  }
+
+  // Add the tokens earned since the last refill
+  uint32_t earned = (now - sender->refilledAt) / LIMIT_REFILL_MS;
+  if (earned > 0)
+  {
+    sender->tokens = earned >= (uint32_t)(LIMIT_BURST - sender->tokens) ? LIMIT_BURST : sender->tokens + earned;
+    sender->refilledAt += earned * LIMIT_REFILL_MS;
+  }
+
+  if (sender->tokens == 0)
+  {
+    stats.limited++;
+    return false;
+  }
+
+  sender->tokens--;
+  return true;
+}
+
+void RateLimiter::failed(uint32_t userId, uint32_t now)
+{
+  Sender *sender = _findOrAdd(userId, now);
+  stats.failures++;
+
+  uint32_t lockout = LIMIT_LOCKOUT_MAX;
+  if (sender->failures < 22 && ((uint32_t)LIMIT_LOCKOUT_MS << sender->failures) < LIMIT_LOCKOUT_MAX)
+  {
+    lockout = (uint32_t)LIMIT_LOCKOUT_MS << sender->failures;
+  }
+
+  if (sender->failures < 255)
+  {
+    sender->failures++;
+  }
+  sender->lockedUntil = now + lockout;
+}
+
+void RateLimiter::forget(uint32_t userId)
+{
+  Sender *sender = _find(userId);
+  if (sender != nullptr)
+  {
+    *sender = {};
+  }
+}
+
+RateLimiter::Sender *RateLimiter::_find(uint32_t userId)
+{
+  for (Sender &sender : _senders)
+  {
+    if (sender.userId == userId && userId != 0)
+    {
+      return &sender;
+    }
+  }
+  return nullptr;
+}
+
+RateLimiter::Sender *RateLimiter::_findOrAdd(uint32_t userId, uint32_t now)
+{
+  Sender *sender = _find(userId);
+  if (sender != nullptr)
+  {
+    return sender;
+  }
+
+  // Take a free slot, or the one that has been quiet the longest
+  Sender *oldest = &_senders[0];
+  for (Sender &candidate : _senders)
+  {
+    if (candidate.userId == 0)
+    {
+      oldest = &candidate;
+      break;
+    }
+
+    if (now - candidate.lastSeen > now - oldest->lastSeen)
+    {
+      oldest = &candidate;
+    }
+  }
+
+  if (oldest->userId != 0)
+  {
+    stats.evicted++;
+  }
+
+  oldest->userId = userId;
+  oldest->refilledAt = now;
+  oldest->lockedUntil = now;
+  oldest->lastSeen = now;
+  oldest->tokens = LIMIT_BURST;
+  oldest->failures = 0;
+  return oldest;
+}
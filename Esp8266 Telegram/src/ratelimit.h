@@ -0,0 +1,63 @@
+#ifndef RATELIMIT_h
+#define RATELIMIT_h
+
+#include <stdint.h>
+
+#define LIMIT_SENDERS 16         // Number of unknown senders tracked at once
+#define LIMIT_BURST 3            // Messages a sender may send in a row
+#define LIMIT_REFILL_MS 20000    // Time to earn one more message
+#define LIMIT_LOCKOUT_MS 2000    // Lockout after the first wrong password
+#define LIMIT_LOCKOUT_MAX 3600000 // Longest lockout, reached by doubling
+
+struct RateLimitStats
+{
+  uint32_t limited;   // Messages dropped because the bucket was empty
+  uint32_t lockedOut; // Messages dropped during a password lockout
+  uint32_t failures;  // Wrong passwords
+  uint32_t evicted;   // Senders forgotten to make room for new ones
+};
+
+/**
+ * Token bucket per sender with exponential lockout after wrong passwords.
+ * Only unknown senders go through the limiter, authorized users skip it.
+ * The table has a fixed size; when it is full the sender that has been
+ * quiet the longest is replaced.
+ */
+class RateLimiter
+{
+public:
+  /**
+   * Returns true when a message from userId may be handled at time now.
+   */
+  bool allow(uint32_t userId, uint32_t now);
+
+  /**
+   * Register a wrong password. Every failure doubles the lockout.
+   */
+  void failed(uint32_t userId, uint32_t now);
+
+  /**
+   * Forget a sender, e.g. after a correct password.
+   */
+  void forget(uint32_t userId);
+
+  RateLimitStats stats = {};
+
+private:
+  struct Sender
+  {
+    uint32_t userId;
+    uint32_t refilledAt;
+    uint32_t lockedUntil;
+    uint32_t lastSeen;
+    uint8_t tokens;
+    uint8_t failures;
+  };
+
+  Sender _senders[LIMIT_SENDERS] = {};
+
+  Sender *_find(uint32_t userId);
+  Sender *_findOrAdd(uint32_t userId, uint32_t now);
+};
+
+#endif
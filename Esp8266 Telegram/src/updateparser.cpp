@@ -0,0 +1,424 @@
+#include "updateparser.h"
+#include <string.h>
+#include <stdlib.h>
+
+/*
+ * Depth counts the open containers: the response object is depth 1, the
+ * result array depth 2 and every update object depth 3. _keys[n] holds the
+ * current key of the object at depth n.
+ */
+#define DEPTH_UPDATE 3
+
+void UpdateParser::begin(TelegramMessage *messages, uint8_t capacity)
+{
+  _messages = messages;
+  _capacity = capacity;
+  _count = 0;
+  _updates = 0;
+  _lastUpdateId = -1;
+  _ok = false;
+  _error = false;
+  _hasMessage = false;
+
+  _depth = 0;
+  _objects = 0;
+  _expectKey = false;
+  memset(_keys, 0, sizeof(_keys));
+
+  _inString = false;
+  _inLiteral = false;
+  _isKey = false;
+  _escape = 0;
+
+  _field = FIELD_NONE;
+  _sink = nullptr;
+}
+
+void UpdateParser::feed(const char *data, size_t length)
+{
+  for (size_t i = 0; i < length && !_error; i++)
+  {
+    char c = data[i];
+
+    if (_inString)
+    {
+      if (_escape == 1)
+      {
+        _escape = 0;
+        switch (c)
+        {
+        case 'n':
+          _put('\n');
+          break;
+        case 't':
+          _put('\t');
+          break;
+        case 'r':
+        case 'b':
+        case 'f':
+          break;
+        case 'u':
+          _escape = 2;
+          _unicode = 0;
+          break;
+        default:
+          _put(c);
+        }
+      }
+      else if (_escape >= 2)
+      {
+        _unicode <<= 4;
+        _unicode |= (c <= '9') ? c - '0' : (c | 0x20) - 'a' + 10;
+        if (++_escape == 6)
+        {
+          _escape = 0;
+          _putUtf8(_unicode);
+        }
+      }
+      else if (c == '\\')
+      {
+        _escape = 1;
+      }
+      else if (c == '"')
+      {
+        _inString = false;
+        _endValue();
+      }
+      else
+      {
+        _put(c);
+      }
+      continue;
+    }
+
+    if (_inLiteral)
+    {
+      if (c != ',' && c != '}' && c != ']' && c != ' ' && c != '\n' && c != '\r' && c != '\t')
+      {
+        _put(c);
+        continue;
+      }
+      _inLiteral = false;
+      _endValue();
+    }
+
+    bool inObject = _objects & (1UL << _depth);
+    switch (c)
+    {
+    case '{':
+      _open(true);
+      break;
+    case '[':
+      _open(false);
+      break;
+    case '}':
+    case ']':
+      _close();
+      break;
+    case ':':
+      _expectKey = false;
+      break;
+    case ',':
+      _expectKey = inObject;
+      break;
+    case '"':
+      _inString = true;
+      _escape = 0;
+      if (_expectKey && inObject)
+      {
+        _isKey = true;
+        _sink = _depth < PARSER_MAX_DEPTH ? _keys[_depth] : nullptr;
+        _sinkSize = PARSER_KEY_SIZE;
+        _sinkLength = 0;
+        _overflow = false;
+      }
+      else
+      {
+        _startValue();
+      }
+      break;
+    case ' ':
+    case '\n':
+    case '\r':
+    case '\t':
+      break;
+    default:
+      _inLiteral = true;
+      _startValue();
+      _put(c);
+    }
+  }
+}
+
+TelegramMessage *UpdateParser::_current()
+{
+  return _count < _capacity ? &_messages[_count] : nullptr;
+}
+
+bool UpdateParser::_path(uint8_t depth, const char *key)
+{
+  return depth < PARSER_MAX_DEPTH && strcmp(_keys[depth], key) == 0;
+}
+
+void UpdateParser::_startValue()
+{
+  _isKey = false;
+  _field = FIELD_NONE;
+  _sinkLength = 0;
+  _overflow = false;
+
+  uint8_t d = _depth;
+  bool inUpdate = d >= DEPTH_UPDATE && _path(1, "result");
+  bool message = inUpdate && _path(DEPTH_UPDATE, "message");
+  bool query = inUpdate && _path(DEPTH_UPDATE, "callback_query");
+
+  if (d == 1 && _path(1, "ok"))
+  {
+    _field = FIELD_OK;
+  }
+  else if (d == DEPTH_UPDATE && inUpdate && _path(d, "update_id"))
+  {
+    _field = FIELD_UPDATE_ID;
+  }
+  else if (d == DEPTH_UPDATE + 1 && message)
+  {
+    if (_path(d, "message_id"))
+      _field = FIELD_MESSAGE_ID;
+    else if (_path(d, "text"))
+      _field = FIELD_TEXT;
+  }
+  else if (d == DEPTH_UPDATE + 1 && query)
+  {
+    if (_path(d, "id"))
+      _field = FIELD_QUERY_ID;
+    else if (_path(d, "data"))
+      _field = FIELD_DATA;
+  }
+  else if (d == DEPTH_UPDATE + 2 && (message || query) && _path(d - 1, "from"))
+  {
+    if (_path(d, "id"))
+      _field = FIELD_USER_ID;
+    else if (_path(d, "first_name"))
+      _field = FIELD_FIRST_NAME;
+  }
+  else if (d == DEPTH_UPDATE + 2 && message && _path(d - 1, "chat") && _path(d, "id"))
+  {
+    _field = FIELD_CHAT_ID;
+  }
+  else if (d == DEPTH_UPDATE + 2 && query && _path(d - 1, "message") && _path(d, "message_id"))
+  {
+    _field = FIELD_MESSAGE_ID;
+  }
+  else if (d == DEPTH_UPDATE + 3 && query && _path(d - 2, "message") && _path(d - 1, "chat") && _path(d, "id"))
+  {
+    _field = FIELD_CHAT_ID;
+  }
+
+  TelegramMessage *msg = _current();
+  _sink = nullptr;
+  switch (_field)
+  {
+  case FIELD_NONE:
+    return;
+  case FIELD_OK:
+  case FIELD_UPDATE_ID:
+  case FIELD_MESSAGE_ID:
+    _sink = _scratch;
+    _sinkSize = sizeof(_scratch);
+    return;
+  default:
+    break;
+  }
+
+  if (msg == nullptr)
+  {
+    return;
+  }
+
+  switch (_field)
+  {
+  case FIELD_USER_ID:
+    _sink = msg->userID;
+    _sinkSize = sizeof(msg->userID);
+    break;
+  case FIELD_FIRST_NAME:
+    _sink = msg->first_name;
+    _sinkSize = sizeof(msg->first_name);
+    break;
+  case FIELD_CHAT_ID:
+    _sink = msg->chatID;
+    _sinkSize = sizeof(msg->chatID);
+    break;
+  case FIELD_TEXT:
+    _sink = msg->text;
+    _sinkSize = sizeof(msg->text);
+    break;
+  case FIELD_QUERY_ID:
+    _sink = msg->queryID;
+    _sinkSize = sizeof(msg->queryID);
+    break;
+  case FIELD_DATA:
+    _sink = msg->data;
+    _sinkSize = sizeof(msg->data);
+    break;
+  default:
+    break;
+  }
+}
+
+void UpdateParser::_endValue()
+{
+  if (_sink == nullptr)
+  {
+    _isKey = false;
+    _field = FIELD_NONE;
+    return;
+  }
+
+  if (_overflow)
+  {
+    // Drop the whole field rather than acting on a partial value. Only a
+    // dropped command matters, a long name must not fail a password.
+    _sinkLength = 0;
+    TelegramMessage *msg = _current();
+    if (!_isKey && (_field == FIELD_TEXT || _field == FIELD_DATA) && msg != nullptr)
+    {
+      msg->truncated = true;
+    }
+  }
+  _sink[_sinkLength] = '\0';
+
+  TelegramMessage *msg = _current();
+  switch (_field)
+  {
+  case FIELD_OK:
+    _ok = strcmp(_scratch, "true") == 0;
+    break;
+  case FIELD_UPDATE_ID:
+    _lastUpdateId = atol(_scratch);
+    break;
+  case FIELD_MESSAGE_ID:
+    if (msg != nullptr)
+    {
+      msg->messageID = atol(_scratch);
+    }
+    break;
+  default:
+    break;
+  }
+
+  _isKey = false;
+  _field = FIELD_NONE;
+  _sink = nullptr;
+}
+
+void UpdateParser::_put(char c)
+{
+  if (_sink == nullptr)
+  {
+    return;
+  }
+
+  if (_sinkLength + 1 < _sinkSize)
+  {
+    _sink[_sinkLength++] = c;
+  }
+  else
+  {
+    _overflow = true;
+  }
+}
+
+void UpdateParser::_putUtf8(uint16_t code)
+{
+  if (code < 0x80)
+  {
+    _put((char)code);
+  }
+  else if (code < 0x800)
+  {
+    _put((char)(0xC0 | (code >> 6)));
+    _put((char)(0x80 | (code & 0x3F)));
+  }
+  else if (code < 0xD800 || code > 0xDFFF)
+  {
+    _put((char)(0xE0 | (code >> 12)));
+    _put((char)(0x80 | ((code >> 6) & 0x3F)));
+    _put((char)(0x80 | (code & 0x3F)));
+  }
+  else
+  {
+    // Surrogate pairs (emoji) are not needed for commands
+    _put('?');
+  }
+}
+
+void UpdateParser::_open(bool object)
+{
+  if (_depth >= 31)
+  {
+    // Nested deeper than the structure bitmap can describe
+    _error = true;
+    return;
+  }
+
+  TelegramMessage *msg = _current();
+  if (object && _depth == DEPTH_UPDATE && _path(1, "result") && msg != nullptr)
+  {
+    if (_path(DEPTH_UPDATE, "message"))
+    {
+      _hasMessage = true;
+      msg->query = false;
+    }
+    else if (_path(DEPTH_UPDATE, "callback_query"))
+    {
+      _hasMessage = true;
+      msg->query = true;
+    }
+  }
+
+  _depth++;
+  if (object)
+  {
+    _objects |= 1UL << _depth;
+  }
+  else
+  {
+    _objects &= ~(1UL << _depth);
+  }
+  _expectKey = object;
+
+  if (_depth < PARSER_MAX_DEPTH)
+  {
+    _keys[_depth][0] = '\0';
+  }
+
+  if (object && _depth == DEPTH_UPDATE && _path(1, "result"))
+  {
+    _updates++;
+    _hasMessage = false;
+    if (msg != nullptr)
+    {
+      memset(msg, 0, sizeof(TelegramMessage));
+    }
+  }
+}
+
+void UpdateParser::_close()
+{
+  if (_depth == 0)
+  {
+    _error = true;
+    return;
+  }
+
+  if (_depth == DEPTH_UPDATE && _path(1, "result") && _hasMessage && _current() != nullptr)
+  {
+    // Keep this message, the next update is parsed into the following slot
+    _count++;
+    _hasMessage = false;
+  }
+
+  _depth--;
+  _expectKey = false;
+}
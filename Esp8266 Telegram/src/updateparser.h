@@ -0,0 +1,99 @@
+#ifndef UPDATEPARSER_h
+#define UPDATEPARSER_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PARSER_MAX_DEPTH 8 // Keys are only tracked this deep
+#define PARSER_KEY_SIZE 24
+
+struct TelegramMessage
+{
+  char userID[16];
+  char chatID[24];
+  char first_name[64];
+  char text[128];
+  char data[65];    // Callback data, at most 64 bytes per the Bot API
+  char queryID[24]; // Callback query id
+  int32_t messageID;
+  bool query;
+  bool truncated; // The text or callback data was too long and has been dropped
+};
+
+/**
+ * Streaming parser for getUpdates responses. Bytes are fed as they arrive
+ * from the TLS stream and only the fields the bridge needs are copied into a
+ * caller supplied array of messages. Fields that do not fit are dropped, so
+ * the memory used does not depend on the size of the response. Only a
+ * dropped text or callback data sets truncated; other fields are left
+ * empty.
+ *
+ * The parser has no Arduino dependencies.
+ */
+class UpdateParser
+{
+public:
+  void begin(TelegramMessage *messages, uint8_t capacity);
+  void feed(const char *data, size_t length);
+
+  bool ok() const { return _ok && !_error; }
+  uint8_t count() const { return _count; }     // Messages stored
+  uint16_t updates() const { return _updates; } // Updates seen, including ignored ones
+  int32_t lastUpdateId() const { return _lastUpdateId; }
+
+private:
+  enum Field
+  {
+    FIELD_NONE,
+    FIELD_OK,
+    FIELD_UPDATE_ID,
+    FIELD_MESSAGE_ID,
+    FIELD_USER_ID,
+    FIELD_FIRST_NAME,
+    FIELD_CHAT_ID,
+    FIELD_TEXT,
+    FIELD_QUERY_ID,
+    FIELD_DATA,
+  };
+
+  TelegramMessage *_messages;
+  uint8_t _capacity;
+  uint8_t _count;
+  uint16_t _updates;
+  int32_t _lastUpdateId;
+  bool _ok;
+  bool _error;
+  bool _hasMessage;
+
+  // Structure
+  uint8_t _depth;
+  uint32_t _objects; // Bit n is set when the container at depth n is an object
+  bool _expectKey;
+  char _keys[PARSER_MAX_DEPTH][PARSER_KEY_SIZE];
+
+  // Current token
+  bool _inString;
+  bool _inLiteral;
+  bool _isKey;
+  uint8_t _escape; // 1 after a backslash, 2..5 while reading \uXXXX
+  uint16_t _unicode;
+
+  // Destination of the current value
+  Field _field;
+  char *_sink;
+  size_t _sinkSize;
+  size_t _sinkLength;
+  bool _overflow;
+  char _scratch[16]; // Numbers and literals that are not stored as text
+
+  TelegramMessage *_current();
+  bool _path(uint8_t depth, const char *key);
+  void _startValue();
+  void _endValue();
+  void _put(char c);
+  void _putUtf8(uint16_t code);
+  void _open(bool object);
+  void _close();
+};
+
+#endif
@@ -0,0 +1,275 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unity.h>
+#include "ChannelTable.h"
+#include "NewRemoteTransmitter.h"
+#include "RfQueue.h"
+#include "poller.h"
+#include "ratelimit.h"
+#include "updateparser.h"
+
+/*
+ * Benchmarks of the hot paths on the host, run with
+ *
+ *   pio test -e native -f test_bench -v
+ *
+ * Each benchmark prints one line like
+ *
+ *   bench=parse_updates,iterations=65536,ns_per_op=3120.4
+ *
+ * for scripts that compare runs. A name only changes when what it measures
+ * changes, so results stay comparable across commits.
+ */
+
+#define BENCH_MIN_NANOS 200000000ULL // Time at least 200 ms per benchmark
+#define BENCH_MAX_ITERATIONS (1UL << 30)
+#define BENCH_USER 123456789
+
+// From main.cpp
+void handleMessage(TelegramMessage &msg);
+extern long numberOfChannels;
+extern uint32_t users[];
+extern ChannelTable channels;
+extern RfQueue rfQueue;
+extern TelegramPoller poller;
+
+// A getUpdates response with a message and a button press
+static const char updates[] =
+    "{\"ok\":true,\"result\":["
+    "{\"update_id\":518004101,\"message\":{\"message_id\":812,"
+    "\"from\":{\"id\":123456789,\"is_bot\":false,\"first_name\":\"Jan\",\"language_code\":\"nl\"},"
+    "\"chat\":{\"id\":123456789,\"first_name\":\"Jan\",\"type\":\"private\"},"
+    "\"date\":1760800000,\"text\":\"/on 3\",\"entities\":[{\"offset\":0,\"length\":3,\"type\":\"bot_command\"}]}},"
+    "{\"update_id\":518004102,\"callback_query\":{\"id\":\"530495852340961234\","
+    "\"from\":{\"id\":123456789,\"is_bot\":false,\"first_name\":\"Jan\"},"
+    "\"message\":{\"message_id\":813,\"from\":{\"id\":7000000001,\"is_bot\":true,\"first_name\":\"Bridge\"},"
+    "\"chat\":{\"id\":123456789,\"type\":\"private\"},\"date\":1760800001,\"text\":\"Channels\","
+    "\"reply_markup\":{\"inline_keyboard\":[[{\"text\":\"1 on\",\"callback_data\":\"n0\"},{\"text\":\"1 off\",\"callback_data\":\"f0\"}]]}},"
+    "\"chat_instance\":\"-4223372036854775808\",\"data\":\"n0\"}}"
+    "]}";
+
+static volatile uint32_t sink; // Keeps results from being optimised away
+
+static uint64_t nanos()
+{
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * Run body often enough to time it, doubling the iterations until one run
+ * takes BENCH_MIN_NANOS, and print the result.
+ */
+template <typename Body>
+static void bench(const char *name, Body body)
+{
+  body(); // Warm up caches and lazy allocations
+
+  unsigned long iterations = 1;
+  uint64_t elapsed;
+  for (;;)
+  {
+    uint64_t start = nanos();
+    for (unsigned long i = 0; i < iterations; i++)
+    {
+      body();
+    }
+    elapsed = nanos() - start;
+    if (elapsed >= BENCH_MIN_NANOS || iterations >= BENCH_MAX_ITERATIONS)
+    {
+      break;
+    }
+    iterations *= 2;
+  }
+
+  printf("bench=%s,iterations=%lu,ns_per_op=%.1f\n", name, iterations, (double)elapsed / iterations);
+}
+
+static TelegramMessage message(uint32_t userId, bool query, const char *content)
+{
+  TelegramMessage msg = {};
+  snprintf(msg.userID, sizeof(msg.userID), "%u", userId);
+  snprintf(msg.chatID, sizeof(msg.chatID), "%u", userId);
+  strcpy(msg.first_name, "Jan");
+  strcpy(query ? msg.data : msg.text, content);
+  strcpy(msg.queryID, "530495852340961234");
+  msg.messageID = 813;
+  msg.query = query;
+  return msg;
+}
+
+/**
+ * Leave a getUpdates request open on a local listener that never answers.
+ * The Bot API calls of the handlers then return right away, like the
+ * publishes in the MQTT bench, so only the dispatch is measured.
+ */
+static int parkPoller()
+{
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  int reuse = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(TELEGRAM_PORT);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(listener, (sockaddr *)&address, sizeof(address)) != 0 || listen(listener, 1) != 0)
+  {
+    return -1;
+  }
+
+  poller.begin("0:bench", handleMessage);
+  poller.tick();
+  return poller.stats.requests == 1 ? listener : -1;
+}
+
+void setUp()
+{
+  RfCommand command;
+  while (rfQueue.pop(command))
+  {
+  }
+}
+
+void tearDown()
+{
+}
+
+void test_parse_updates()
+{
+  TelegramMessage messages[4];
+  UpdateParser parser;
+  parser.begin(messages, 4);
+  parser.feed(updates, sizeof(updates) - 1);
+  TEST_ASSERT_TRUE(parser.ok());
+  TEST_ASSERT_EQUAL(2, parser.count());
+  TEST_ASSERT_EQUAL_STRING("/on 3", messages[0].text);
+  TEST_ASSERT_EQUAL_STRING("n0", messages[1].data);
+
+  bench("parse_updates", [&]()
+        {
+          parser.begin(messages, 4);
+          parser.feed(updates, sizeof(updates) - 1);
+          sink += parser.count();
+        });
+
+  // Bytes arrive in TLS records, not all at once
+  bench("parse_updates_chunked", [&]()
+        {
+          parser.begin(messages, 4);
+          for (size_t i = 0; i < sizeof(updates) - 1; i += 64)
+          {
+            parser.feed(updates + i, min(sizeof(updates) - 1 - i, (size_t)64));
+          }
+          sink += parser.count();
+        });
+}
+
+void test_rate_limit()
+{
+  RateLimiter limiter;
+  TEST_ASSERT_TRUE(limiter.allow(1000, 0));
+
+  // A full table, so every lookup scans all senders
+  uint32_t now = 0;
+  uint32_t sender = 0;
+  bench("rate_limit_allow", [&]()
+        {
+          now += 50;
+          sender = (sender + 1) % (LIMIT_SENDERS * 2);
+          sink += limiter.allow(sender, now);
+        });
+}
+
+void test_encode_telegram()
+{
+  byte pulses[NewRemoteTransmitter::maxPulses];
+  TEST_ASSERT_TRUE(NewRemoteTransmitter::encodeTelegram(0x123456, false, NewRemoteTransmitter::SWITCH_ON, 3, 0, pulses) > 0);
+
+  bench("encode_telegram", [&]()
+        { sink += NewRemoteTransmitter::encodeTelegram(0x123456, false, NewRemoteTransmitter::SWITCH_ON, 3, 0, pulses); });
+  bench("encode_telegram_dim", [&]()
+        { sink += NewRemoteTransmitter::encodeTelegram(0x123456, false, NewRemoteTransmitter::SWITCH_DIM, 3, 9, pulses); });
+}
+
+void test_handle_callback_channel()
+{
+  TelegramMessage on = message(BENCH_USER, true, "n3");
+  TelegramMessage off = message(BENCH_USER, true, "f3");
+  handleMessage(on);
+  RfCommand command;
+  TEST_ASSERT_TRUE(rfQueue.pop(command));
+  TEST_ASSERT_EQUAL(3, command.channel);
+  TEST_ASSERT_TRUE(command.switchOn);
+
+  // Every press moves a button, so the keyboard is rendered each time
+  bool switchOn = false;
+  bench("handle_callback_channel", [&]()
+        {
+          switchOn = !switchOn;
+          handleMessage(switchOn ? on : off);
+          rfQueue.pop(command);
+          sink += command.switchOn;
+        });
+}
+
+void test_handle_callback_invalid()
+{
+  TelegramMessage msg = message(BENCH_USER, true, "n999");
+  bench("handle_callback_invalid", [&]()
+        { handleMessage(msg); });
+  TEST_ASSERT_EQUAL(0, rfQueue.size());
+}
+
+void test_handle_message_menu()
+{
+  TelegramMessage msg = message(BENCH_USER, false, "/start");
+  bench("handle_message_menu", [&]()
+        { handleMessage(msg); });
+  TEST_ASSERT_EQUAL(0, rfQueue.size());
+}
+
+void test_handle_message_stranger()
+{
+  // Wrong passwords from more senders than the limiter tracks
+  TelegramMessage msg = message(BENCH_USER + 1, false, "guess");
+  uint32_t sender = 0;
+  bench("handle_message_stranger", [&]()
+        {
+          sender = (sender + 1) % (LIMIT_SENDERS * 2);
+          snprintf(msg.userID, sizeof(msg.userID), "%u", BENCH_USER + 1 + sender);
+          handleMessage(msg);
+        });
+  TEST_ASSERT_EQUAL(0, rfQueue.size());
+}
+
+int main(int argc, char **argv)
+{
+  LittleFS.begin();
+  channels.begin(0x123456);
+  numberOfChannels = 16;
+  users[0] = BENCH_USER;
+
+  // The firmware logs every command, which is not what is measured
+  setSerialOutput(nullptr);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_parse_updates);
+  RUN_TEST(test_rate_limit);
+  RUN_TEST(test_encode_telegram);
+  if (parkPoller() >= 0)
+  {
+    RUN_TEST(test_handle_callback_channel);
+    RUN_TEST(test_handle_callback_invalid);
+    RUN_TEST(test_handle_message_menu);
+    RUN_TEST(test_handle_message_stranger);
+  }
+  else
+  {
+    printf("Unable to listen on port %u, dispatch benchmarks skipped\n", TELEGRAM_PORT);
+  }
+  return UNITY_END();
+}
@@ -0,0 +1,155 @@
+#include <string.h>
+#include <unity.h>
+#include "updateparser.h"
+
+/*
+ * UpdateParser against getUpdates responses as the Bot API sends them, run
+ * with "pio test -e native -f test_updateparser".
+ */
+
+#define CAPACITY 4
+
+// A user sends the password, with a display name longer than first_name holds
+static const char longName[] =
+    "{\"ok\":true,\"result\":[{\"update_id\":518004090,\n"
+    "\"message\":{\"message_id\":801,\"from\":{\"id\":123456789,\"is_bot\":false,"
+    "\"first_name\":\"Johanna Wilhelmina Cornelia Maria van der Heijden-Oosterhuis tot Rhoon\","
+    "\"language_code\":\"nl\"},\"chat\":{\"id\":123456789,"
+    "\"first_name\":\"Johanna Wilhelmina Cornelia Maria van der Heijden-Oosterhuis tot Rhoon\","
+    "\"type\":\"private\"},\"date\":1760790000,\"text\":\"s3cret-code\"}}]}";
+
+// A command longer than text holds
+static const char longText[] =
+    "{\"ok\":true,\"result\":[{\"update_id\":518004091,\n"
+    "\"message\":{\"message_id\":802,\"from\":{\"id\":123456789,\"is_bot\":false,\"first_name\":\"Jan\"},"
+    "\"chat\":{\"id\":123456789,\"first_name\":\"Jan\",\"type\":\"private\"},\"date\":1760790010,"
+    "\"text\":\"Scene evening 1=on 2=on 3=dim8 4=off 5=off 6=on 7=dim3 8=on 9=off 10=on 11=on "
+    "12=off 13=dim15 14=on 15=off 16=on 17=on 18=off 19=on 20=dim1\"}}]}";
+
+// A message, a button press and an edited message that is ignored
+static const char mixed[] =
+    "{\"ok\":true,\"result\":["
+    "{\"update_id\":518004101,\"message\":{\"message_id\":812,"
+    "\"from\":{\"id\":123456789,\"is_bot\":false,\"first_name\":\"Jos\\u00e9\",\"language_code\":\"nl\"},"
+    "\"chat\":{\"id\":-1001234567890,\"title\":\"Huis\",\"type\":\"supergroup\"},"
+    "\"date\":1760800000,\"text\":\"/start\",\"entities\":[{\"offset\":0,\"length\":6,\"type\":\"bot_command\"}]}},"
+    "{\"update_id\":518004102,\"callback_query\":{\"id\":\"530495852340961234\","
+    "\"from\":{\"id\":987654321,\"is_bot\":false,\"first_name\":\"Jan\"},"
+    "\"message\":{\"message_id\":813,\"from\":{\"id\":7000000001,\"is_bot\":true,\"first_name\":\"Bridge\"},"
+    "\"chat\":{\"id\":987654321,\"type\":\"private\"},\"date\":1760800001,\"text\":\"Channels\","
+    "\"reply_markup\":{\"inline_keyboard\":[[{\"text\":\"1 on\",\"callback_data\":\"n0\"}]]}},"
+    "\"chat_instance\":\"-4223372036854775808\",\"data\":\"n0\"}},"
+    "{\"update_id\":518004103,\"edited_message\":{\"message_id\":812,"
+    "\"from\":{\"id\":123456789,\"is_bot\":false,\"first_name\":\"Jos\\u00e9\"},"
+    "\"chat\":{\"id\":123456789,\"type\":\"private\"},\"date\":1760800000,\"edit_date\":1760800005,\"text\":\"/stop\"}}"
+    "]}";
+
+static TelegramMessage messages[CAPACITY];
+static UpdateParser parser;
+
+static void parse(const char *response, size_t chunk)
+{
+  parser.begin(messages, CAPACITY);
+  size_t length = strlen(response);
+  for (size_t i = 0; i < length; i += chunk)
+  {
+    parser.feed(response + i, length - i < chunk ? length - i : chunk);
+  }
+}
+
+void setUp()
+{
+  memset(messages, 0xAA, sizeof(messages));
+}
+
+void tearDown()
+{
+}
+
+void test_long_name_keeps_text()
+{
+  parse(longName, strlen(longName));
+  TEST_ASSERT_TRUE(parser.ok());
+  TEST_ASSERT_EQUAL(1, parser.count());
+  TEST_ASSERT_EQUAL_STRING("s3cret-code", messages[0].text);
+  TEST_ASSERT_EQUAL_STRING("", messages[0].first_name);
+  TEST_ASSERT_EQUAL_STRING("123456789", messages[0].userID);
+  TEST_ASSERT_FALSE(messages[0].truncated);
+}
+
+void test_long_text_is_dropped()
+{
+  parse(longText, strlen(longText));
+  TEST_ASSERT_TRUE(parser.ok());
+  TEST_ASSERT_EQUAL(1, parser.count());
+  TEST_ASSERT_EQUAL_STRING("", messages[0].text);
+  TEST_ASSERT_EQUAL_STRING("Jan", messages[0].first_name);
+  TEST_ASSERT_TRUE(messages[0].truncated);
+  TEST_ASSERT_EQUAL(518004091, parser.lastUpdateId());
+}
+
+void test_message_and_callback()
+{
+  parse(mixed, strlen(mixed));
+  TEST_ASSERT_TRUE(parser.ok());
+  TEST_ASSERT_EQUAL(3, parser.updates());
+  TEST_ASSERT_EQUAL(2, parser.count());
+  TEST_ASSERT_EQUAL(518004103, parser.lastUpdateId());
+
+  TEST_ASSERT_FALSE(messages[0].query);
+  TEST_ASSERT_EQUAL_STRING("/start", messages[0].text);
+  TEST_ASSERT_EQUAL_STRING("Jos\xc3\xa9", messages[0].first_name);
+  TEST_ASSERT_EQUAL_STRING("-1001234567890", messages[0].chatID);
+  TEST_ASSERT_EQUAL(812, messages[0].messageID);
+
+  TEST_ASSERT_TRUE(messages[1].query);
+  TEST_ASSERT_EQUAL_STRING("n0", messages[1].data);
+  TEST_ASSERT_EQUAL_STRING("530495852340961234", messages[1].queryID);
+  TEST_ASSERT_EQUAL_STRING("987654321", messages[1].userID);
+  TEST_ASSERT_EQUAL_STRING("987654321", messages[1].chatID);
+  TEST_ASSERT_EQUAL(813, messages[1].messageID);
+  TEST_ASSERT_FALSE(messages[1].truncated);
+}
+
+void test_chunked_matches_whole()
+{
+  // TLS records split the response anywhere, also inside escapes
+  for (size_t chunk = 1; chunk < 8; chunk++)
+  {
+    parse(mixed, chunk);
+    TEST_ASSERT_EQUAL(2, parser.count());
+    TEST_ASSERT_EQUAL_STRING("Jos\xc3\xa9", messages[0].first_name);
+    TEST_ASSERT_EQUAL_STRING("n0", messages[1].data);
+  }
+}
+
+void test_capacity()
+{
+  parser.begin(messages, 1);
+  parser.feed(mixed, strlen(mixed));
+  TEST_ASSERT_EQUAL(1, parser.count());
+  TEST_ASSERT_EQUAL(3, parser.updates());
+  TEST_ASSERT_EQUAL(518004103, parser.lastUpdateId());
+  TEST_ASSERT_EQUAL_STRING("/start", messages[0].text);
+}
+
+void test_error_response()
+{
+  static const char conflict[] =
+      "{\"ok\":false,\"error_code\":409,\"description\":\"Conflict: terminated by other getUpdates request\"}";
+  parse(conflict, strlen(conflict));
+  TEST_ASSERT_FALSE(parser.ok());
+  TEST_ASSERT_EQUAL(0, parser.count());
+}
+
+int main(int argc, char **argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_long_name_keeps_text);
+  RUN_TEST(test_long_text_is_dropped);
+  RUN_TEST(test_message_and_callback);
+  RUN_TEST(test_chunked_matches_whole);
+  RUN_TEST(test_capacity);
+  RUN_TEST(test_error_response);
+  return UNITY_END();
+}